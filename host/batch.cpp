@@ -0,0 +1,357 @@
+//Throughput of the batched engine against one VoiceManager per instance. A set of patch
+//variations, each with its own note and control stream, is rendered once instance by instance
+//and once through BatchEngine for every lane count. Every lane is compared with the instance it
+//stands for, and the throughput is reported as instances x real time on one core, JSON on stdout.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <arm_math.h>
+
+#include "../include/main.h"
+#include "../include/engine.h"
+#include "../include/patch.h"
+#include "../include/lfo.h"
+#include "../include/voicemanager.h"
+#include "../include/denormal.h"
+#include "batchengine.h"
+
+#define SAMPLE_RATE 48000.f
+
+//Largest difference between a lane and its instance that still passes
+static constexpr float kTolerance = 1e-4f;
+
+/** One preview: the controls of the patch and its event stream.
+*/
+struct Instance
+{
+    uint8_t                 controls[NUM_CONTROLS];
+    std::vector<BatchEvent> events;
+};
+
+//Small deterministic generator, so every run renders the same previews
+static uint32_t Next(uint32_t &state)
+{
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+static uint8_t Range(uint32_t &state, int lo, int hi)
+{
+    return lo + Next(state) % (hi - lo + 1);
+}
+
+/** Variations of two sounds with different kernels: a polyBLEP saw and square pad with pink
+    noise and ring modulation, and a naive saw synced to a phase modulated sine. The continuous
+    controls and the phrase differ per instance, some of them sweep the cutoff while playing.
+*/
+static Instance MakeInstance(size_t index, size_t size)
+{
+    Instance inst;
+    uint32_t s = 0x2545f491u + index * 0x9e3779b9u;
+    memcpy(inst.controls, ControlPanel, sizeof(inst.controls));
+
+    uint8_t *c = inst.controls;
+    if(index % 2 == 0)
+    {
+        c[CTRL_OSC1WAVEFORM] = 6 * 26;
+        c[CTRL_OSC2WAVEFORM] = 7 * 26;
+        c[CTRL_NOISETYPE]    = 64;
+        c[CTRL_RINGMOD]      = Range(s, 0, 40);
+    }
+    else
+    {
+        c[CTRL_OSC1WAVEFORM]  = 2 * 26;
+        c[CTRL_OSC2WAVEFORM]  = 0;
+        c[CTRL_OSC2SYNC]      = 1;
+        c[CTRL_OSC2PHASEMOD]  = Range(s, 10, 60);
+        c[CTRL_OSC2TUNECOARSE] = Range(s, 70, 100);
+    }
+    c[CTRL_OSC2TUNEFINE]       = Range(s, 54, 74);
+    c[CTRL_OSCMIX]             = Range(s, 20, 100);
+    c[CTRL_NOISE]              = Range(s, 0, 20);
+    c[CTRL_FILTERCUTOFF]       = Range(s, 30, 110);
+    c[CTRL_FILTERRESONANCE]    = Range(s, 2, 100);
+    if(index % 4 == 1)
+    {
+        //Open enough for the scalar ladder's stand-in, which the batch leaves to VoiceManager
+        c[CTRL_FILTERCUTOFF]    = Range(s, 120, 127);
+        c[CTRL_FILTERRESONANCE] = 0;
+    }
+    c[CTRL_FILTERLFOMOD]       = Range(s, 0, 1) * Range(s, 5, 40);
+    c[CTRL_FILTERVELOCITYMOD]  = Range(s, 0, 30);
+    c[CTRL_FILTERKEYBEDTRACK]  = Range(s, 0, 60);
+    c[CTRL_FILTERATTACK]       = Range(s, 0, 20);
+    c[CTRL_FILTERDECAY]        = Range(s, 0, 30);
+    c[CTRL_FILTERSUSTAIN]      = Range(s, 30, 127);
+    c[CTRL_FILTERRELEASE]      = Range(s, 2, 30);
+    c[CTRL_AMPATTACK]          = Range(s, 0, 10);
+    c[CTRL_AMPDECAY]           = Range(s, 2, 30);
+    c[CTRL_AMPSUSTAIN]         = Range(s, 40, 127);
+    c[CTRL_AMPRELEASE]         = Range(s, 2, 20);
+    c[CTRL_AMPLFOMOD]          = Range(s, 0, 1) * Range(s, 5, 30);
+    c[CTRL_OSC1PWMOD]          = Range(s, 0, 60);
+    c[CTRL_OSC1FREQUENCYMOD]   = Range(s, 0, 1) * Range(s, 1, 3);
+    c[CTRL_LFOWAVEFORM]        = Range(s, 0, 4) * 26;
+    c[CTRL_LFOFREQUENCY]       = Range(s, 5, 60);
+
+    //A chord, then single notes until two thirds in, then everything is released
+    uint32_t release = size * 2 / 3;
+    uint8_t  root    = Range(s, 40, 60);
+    uint8_t  notes[16];
+    size_t   num     = 0;
+    for(int k : {0, 4, 7})
+    {
+        notes[num++] = root + k;
+        inst.events.push_back({0, BATCH_NOTE_ON, (uint8_t)(root + k), Range(s, 60, 127)});
+    }
+    for(uint32_t f = Range(s, 1, 8) * 2400; f < release && num < 16; f += Range(s, 2, 12) * 1200)
+    {
+        notes[num] = Range(s, 36, 84);
+        inst.events.push_back({f, BATCH_NOTE_ON, notes[num++], Range(s, 30, 127)});
+    }
+    if(index % 3 == 0)
+    {
+        for(uint32_t f = 0, k = 0; f < size; f += 2400, k++)
+        {
+            inst.events.push_back({f, BATCH_CONTROL, CTRL_FILTERCUTOFF, (uint8_t)(40 + (k * 5) % 80)});
+        }
+    }
+    for(size_t n = 0; n < num; n++)
+    {
+        inst.events.push_back({release, BATCH_NOTE_OFF, notes[n], 0});
+    }
+    std::stable_sort(inst.events.begin(), inst.events.end(),
+                     [](const BatchEvent &a, const BatchEvent &b) { return a.frame < b.frame; });
+    return inst;
+}
+
+/** The reference: one instance through its own VoiceManager, events applied like the batch does.
+*/
+static void RenderInstance(const Instance &inst, float *out, size_t size)
+{
+    std::unique_ptr<VoiceManager<NUM_VOICES>> mgr(new VoiceManager<NUM_VOICES>);
+    custom::Lfo                               lfos[NUM_LFOS];
+    float                                     lfo_out[NUM_LFOS][BLOCK_SIZE];
+    Patch                                     patch;
+    size_t                                    next = 0;
+
+    memcpy(patch.controls, inst.controls, sizeof(patch.controls));
+    PatchCompute(patch, SAMPLE_RATE);
+    mgr->Init(SAMPLE_RATE);
+    mgr->ApplyPatch(patch);
+    for(int i = 0; i < NUM_LFOS; i++)
+    {
+        lfos[i].Init(SAMPLE_RATE / BLOCK_SIZE);
+        lfos[i].SetWaveform(patch.lfo[i].waveform);
+        lfos[i].SetFreq(patch.lfo[i].freq);
+    }
+
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        for(; next < inst.events.size() && inst.events[next].frame < i + BLOCK_SIZE; next++)
+        {
+            const BatchEvent &e = inst.events[next];
+            switch(e.type)
+            {
+                case BATCH_NOTE_ON: mgr->OnNoteOn(e.data1, e.data2); break;
+                case BATCH_NOTE_OFF: mgr->OnNoteOff(e.data1, 0); break;
+                case BATCH_CONTROL:
+                    patch.controls[e.data1] = e.data2;
+                    PatchCompute(patch, SAMPLE_RATE);
+                    mgr->ApplyPatch(patch);
+                    for(int l = 0; l < NUM_LFOS; l++)
+                    {
+                        lfos[l].SetWaveform(patch.lfo[l].waveform);
+                        lfos[l].SetFreq(patch.lfo[l].freq);
+                    }
+                    break;
+            }
+        }
+        for(int l = 0; l < NUM_LFOS; l++)
+        {
+            lfos[l].ProcessBlock(lfo_out[l], BLOCK_SIZE);
+        }
+        arm_fill_f32(0, out + i, BLOCK_SIZE);
+        mgr->ProcessBlock(out + i, patch.values, lfo_out, BLOCK_SIZE);
+    }
+}
+
+/** Renders every instance through batches of lanes, grouped by layout. The lanes left over in
+    the last batch of a group run silent copies, and instances the batch does not support fall
+    back to their own VoiceManager. Returns the render time in ns, excluding setup.
+*/
+template <size_t lanes>
+static double RenderBatched(const std::vector<Instance> &instances, std::vector<std::vector<float>> &out,
+                            size_t size, size_t &batches, std::vector<size_t> &rejected, size_t &scalar)
+{
+    std::unique_ptr<BatchEngine<lanes>> engine(new BatchEngine<lanes>);
+    std::vector<float>                  spare(size);
+    std::vector<bool>                   done(instances.size(), false);
+    double                              ns = 0.0;
+    batches = 0;
+    scalar  = 0;
+    rejected.assign(instances.size(), 0);
+
+    for(size_t first = 0; first < instances.size(); first++)
+    {
+        if(done[first])
+        {
+            continue;
+        }
+        Patch patch;
+        memcpy(patch.controls, instances[first].controls, sizeof(patch.controls));
+        PatchCompute(patch, SAMPLE_RATE);
+        if(!BatchEngine<lanes>::Supports(patch))
+        {
+            auto start = std::chrono::steady_clock::now();
+            RenderInstance(instances[first], out[first].data(), size);
+            auto end   = std::chrono::steady_clock::now();
+            ns += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            done[first] = true;
+            scalar++;
+            continue;
+        }
+        BatchLayout layout = BatchLayout::FromPatch(patch);
+
+        //Fill the lanes with the next instances of the same layout
+        size_t         used = 0, lane_instance[lanes], lane_rejected[lanes];
+        BatchEventList events[lanes];
+        float         *lane_out[lanes];
+        engine->Init(SAMPLE_RATE, instances[first].controls);
+        for(size_t i = first; i < instances.size() && used < lanes; i++)
+        {
+            memcpy(patch.controls, instances[i].controls, sizeof(patch.controls));
+            PatchCompute(patch, SAMPLE_RATE);
+            if(done[i] || !BatchEngine<lanes>::Supports(patch) || !(BatchLayout::FromPatch(patch) == layout))
+            {
+                continue;
+            }
+            done[i]        = true;
+            engine->SetPatch(used, instances[i].controls);
+            events[used]        = {instances[i].events.data(), instances[i].events.size()};
+            lane_out[used]      = out[i].data();
+            lane_instance[used] = i;
+            used++;
+        }
+        for(size_t l = used; l < lanes; l++)
+        {
+            events[l]   = {NULL, 0};
+            lane_out[l] = spare.data();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        engine->Render(events, lane_out, size, lane_rejected);
+        auto end   = std::chrono::steady_clock::now();
+        ns += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        batches++;
+        for(size_t l = 0; l < used; l++)
+        {
+            rejected[lane_instance[l]] = lane_rejected[l];
+        }
+    }
+    return ns;
+}
+
+template <size_t lanes>
+static bool Report(const std::vector<Instance> &instances, const std::vector<std::vector<float>> &reference,
+                   size_t size, double scalar_ns)
+{
+    std::vector<std::vector<float>> out(instances.size(), std::vector<float>(size));
+    std::vector<size_t>             rejected;
+    size_t                          batches, scalar, open = 0, rejected_controls = 0, rejected_lanes = 0;
+    double                          ns      = RenderBatched<lanes>(instances, out, size, batches, rejected, scalar);
+    float                           max_err = 0.f;
+    for(size_t i = 0; i < instances.size(); i++)
+    {
+        open += instances[i].controls[CTRL_FILTERRESONANCE] == 0;
+        //A lane that dropped controls renders another sound on purpose, it fails on its own
+        rejected_controls += rejected[i];
+        rejected_lanes += rejected[i] > 0;
+        if(rejected[i] > 0)
+        {
+            continue;
+        }
+        for(size_t j = 0; j < size; j++)
+        {
+            max_err = std::max(max_err, fabsf(out[i][j] - reference[i][j]));
+        }
+    }
+    //Exactly the instances without resonance have to fall back
+    bool   pass   = max_err <= kTolerance && rejected_lanes == 0 && scalar == open;
+    double audio  = (double)instances.size() * size / SAMPLE_RATE;
+    printf(",\n  {\"engine\": \"batch\", \"lanes\": %zu, \"batches\": %zu, \"scalar\": %zu, "
+           "\"realtime_per_core\": %.1f, \"speedup\": %.2f, \"max_error\": %.3g, \"rejected_controls\": %zu, "
+           "\"rejected_lanes\": %zu, \"status\": \"%s\"}",
+           lanes, batches, scalar, audio / (ns * 1e-9), scalar_ns / ns, max_err, rejected_controls, rejected_lanes,
+           pass ? "pass" : "fail");
+    return pass;
+}
+
+static void Usage()
+{
+    fprintf(stderr, "usage: dualie-batch [--instances N] [--seconds S] [--lanes 8|16]\n");
+}
+
+int main(int argc, char **argv)
+{
+    size_t num_instances = 64;
+    float  seconds       = 2.f;
+    size_t only_lanes    = 0;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--instances") && i + 1 < argc)
+            num_instances = std::max(1, atoi(argv[++i]));
+        else if(!strcmp(argv[i], "--seconds") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--lanes") && i + 1 < argc)
+            only_lanes = atoi(argv[++i]);
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+    if(only_lanes != 0 && only_lanes != 8 && only_lanes != 16)
+    {
+        Usage();
+        return 2;
+    }
+
+    EnableFlushToZero();
+    size_t                          size = std::max(1, (int)(seconds * SAMPLE_RATE / BLOCK_SIZE)) * BLOCK_SIZE;
+    std::vector<Instance>           instances;
+    std::vector<std::vector<float>> reference(num_instances, std::vector<float>(size));
+    for(size_t i = 0; i < num_instances; i++)
+    {
+        instances.push_back(MakeInstance(i, size));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < num_instances; i++)
+    {
+        RenderInstance(instances[i], reference[i].data(), size);
+    }
+    auto   end       = std::chrono::steady_clock::now();
+    double scalar_ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    double audio     = (double)num_instances * size / SAMPLE_RATE;
+
+    printf("{\"instances\": %zu, \"seconds\": %.2f, \"results\": [\n", num_instances, size / SAMPLE_RATE);
+    printf("  {\"engine\": \"scalar\", \"lanes\": 1, \"batches\": %zu, \"realtime_per_core\": %.1f, \"speedup\": 1.00}",
+           num_instances, audio / (scalar_ns * 1e-9));
+    bool pass = true;
+    if(only_lanes != 16)
+        pass &= Report<8>(instances, reference, size, scalar_ns);
+    if(only_lanes != 8)
+        pass &= Report<16>(instances, reference, size, scalar_ns);
+    printf("\n]}\n");
+
+    if(!pass)
+        fprintf(stderr, "dualie-batch: a lane differs from its instance, dropped controls, or a patch ran on the wrong engine\n");
+    return pass ? 0 : 1;
+}
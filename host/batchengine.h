@@ -0,0 +1,548 @@
+//Batched host engine for bouncing many short previews. Not used by the firmware.
+//lanes independent 12 voice instances run side by side: voice slot v of every instance lives in
+//the same lane interleaved modules (host/lanes.h), so one pass over a slot advances all of them.
+//Control rate work (patches, LFOs, modulation routing, voice allocation) stays per instance and
+//reuses the engine's own classes.
+#pragma once
+#ifndef DUALIE_HOST_BATCHENGINE_H
+#define DUALIE_HOST_BATCHENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <Utility/dsp.h>
+
+#include "../include/main.h"
+#include "../include/patch.h"
+#include "../include/lfo.h"
+#include "../include/modmatrix.h"
+#include "../include/voice.h"
+#include "lanes.h"
+
+enum
+{
+    BATCH_NOTE_ON,
+    BATCH_NOTE_OFF,
+    BATCH_CONTROL, //data1 is a CTRL_* index and data2 its 0-127 value
+};
+
+/** One event of an instance's stream. frame counts samples from the start of the render, the
+    event takes effect at the start of the block it falls in, like MIDI handled between blocks.
+*/
+struct BatchEvent
+{
+    uint32_t frame;
+    uint8_t  type;
+    uint8_t  data1;
+    uint8_t  data2;
+};
+
+/** The events of one instance, sorted by frame.
+*/
+struct BatchEventList
+{
+    const BatchEvent *events;
+    size_t            size;
+};
+
+/** The settings that select a kernel rather than feed one. They are shared by every instance of
+    a batch, group instances by layout before batching them.
+*/
+struct BatchLayout
+{
+    uint8_t osc1_waveform, osc2_waveform, noise_mode;
+    bool    sync, phase_mod;
+
+    static BatchLayout FromPatch(const Patch &patch)
+    {
+        BatchLayout layout;
+        layout.osc1_waveform = patch.values[CTRL_OSC1WAVEFORM] < custom::Oscillator::WAVE_LAST
+                                   ? patch.values[CTRL_OSC1WAVEFORM] : custom::Oscillator::WAVE_SIN;
+        layout.osc2_waveform = patch.values[CTRL_OSC2WAVEFORM] < custom::Oscillator::WAVE_LAST
+                                   ? patch.values[CTRL_OSC2WAVEFORM] : custom::Oscillator::WAVE_SIN;
+        layout.noise_mode    = patch.values[CTRL_NOISETYPE] == custom::Noise::MODE_PINK;
+        layout.sync          = patch.values[CTRL_OSC2SYNC] != 0.f;
+        layout.phase_mod     = patch.values[CTRL_OSC2PHASEMOD] != 0.f;
+        return layout;
+    }
+
+    inline bool operator==(const BatchLayout &other) const
+    {
+        return osc1_waveform == other.osc1_waveform && osc2_waveform == other.osc2_waveform
+               && noise_mode == other.noise_mode && sync == other.sync && phase_mod == other.phase_mod;
+    }
+};
+
+/** lanes instances of the 1x engine with the ladder filter, rendered together. Every lane gives
+    the output of its own VoiceManager, host/batch.cpp checks them against each other. Two
+    differences remain: the open ladder stand-in is not used, and a lane's noise generators keep
+    running while its noise is turned down and another lane's is not.
+*/
+template <size_t lanes>
+class BatchEngine
+{
+  public:
+    BatchEngine() {}
+    ~BatchEngine() {}
+
+    /** Every lane starts out silent with controls, NUM_CONTROLS values of 0-127 that also fix
+        the layout of the batch. Fails if the batch engine does not support them.
+    */
+    bool Init(float sample_rate, const uint8_t *controls)
+    {
+        Patch patch;
+        memcpy(patch.controls, controls, sizeof(patch.controls));
+        PatchCompute(patch, sample_rate);
+        if(!Supports(patch))
+        {
+            return false;
+        }
+
+        sample_rate_ = sample_rate;
+        layout_      = BatchLayout::FromPatch(patch);
+        SelectKernels();
+        for(size_t v = 0; v < NUM_VOICES; v++)
+        {
+            VoiceLanes &voice = voices_[v];
+            voice.osc1.Init(sample_rate);
+            voice.osc2.Init(sample_rate);
+            voice.noise.Init(v);
+            voice.filt.Init(sample_rate);
+            voice.filt_env.Init();
+            voice.amp_env.Init();
+            for(size_t l = 0; l < lanes; l++)
+            {
+                voice.note[l]     = 0;
+                voice.velocity[l] = 0.f;
+                voice.freq[l]     = 0.f;
+                voice.gate[l]     = 0;
+                //Not a pitch, so the next block tunes osc2
+                voice.osc2_pitch[l] = NAN;
+            }
+        }
+        for(size_t l = 0; l < lanes; l++)
+        {
+            Lane &lane = lanes_[l];
+            lane.mod.Init();
+            for(int i = 0; i < NUM_LFOS; i++)
+            {
+                lane.lfos[i].Init(sample_rate / BLOCK_SIZE);
+            }
+            ApplyPatch(l, patch);
+        }
+        return true;
+    }
+
+    /** Whether a patch can run in a batch at all, only the ladder filter is supported. The lanes
+        do not model the open stand-in of the scalar ladder, so no resonance that allows it either.
+    */
+    static bool Supports(const Patch &patch)
+    {
+        return patch.values[CTRL_FILTERTYPE] == FILTER_LADDER
+               && !custom::MoogLadder::MayOpen(patch.values[CTRL_FILTERRESONANCE]);
+    }
+
+    /** Replaces the patch of one lane, like EngineLoadPreset without a crossfade. Fails and leaves
+        the lane alone if the patch is not supported or has a different layout.
+    */
+    bool SetPatch(size_t lane, const uint8_t *controls)
+    {
+        Patch patch;
+        memcpy(patch.controls, controls, sizeof(patch.controls));
+        PatchCompute(patch, sample_rate_);
+        if(!Supports(patch) || !(BatchLayout::FromPatch(patch) == layout_))
+        {
+            return false;
+        }
+        ApplyPatch(lane, patch);
+        return true;
+    }
+
+    bool SetControl(size_t lane, uint8_t param, uint8_t value)
+    {
+        uint8_t controls[NUM_CONTROLS];
+        if(param >= NUM_CONTROLS)
+        {
+            return false;
+        }
+        memcpy(controls, lanes_[lane].patch.controls, sizeof(controls));
+        controls[param] = value;
+        return SetPatch(lane, controls);
+    }
+
+    /** Takes the first voice of the lane that is neither held nor sounding, else the first one
+        in its release, like VoiceManager.
+    */
+    void NoteOn(size_t lane, uint8_t note, uint8_t velocity)
+    {
+        size_t v, released = NUM_VOICES;
+        for(v = 0; v < NUM_VOICES; v++)
+        {
+            if(!voices_[v].gate[lane] && !voices_[v].amp_env.IsRunning(lane))
+            {
+                break;
+            }
+            released = released == NUM_VOICES && !voices_[v].gate[lane] ? v : released;
+        }
+        v = v < NUM_VOICES ? v : released;
+        if(v == NUM_VOICES)
+        {
+            return;
+        }
+        VoiceLanes &voice = voices_[v];
+        voice.note[lane]     = note;
+        voice.velocity[lane] = velocity / 127.f;
+        voice.freq[lane]     = daisysp::mtof(note);
+        voice.gate[lane]     = 1;
+        voice.osc1.SetFreq(lane, voice.freq[lane]);
+        voice.osc2.SetFreq(lane, voice.freq[lane]);
+        voice.osc2_pitch[lane] = NAN;
+    }
+
+    void NoteOff(size_t lane, uint8_t note)
+    {
+        for(size_t v = 0; v < NUM_VOICES; v++)
+        {
+            VoiceLanes &voice = voices_[v];
+            if((voice.gate[lane] || voice.amp_env.IsRunning(lane)) && voice.note[lane] == note)
+            {
+                voice.gate[lane] = 0;
+            }
+        }
+    }
+
+    /** Renders BLOCK_SIZE samples of every lane, lane l to out[l].
+    */
+    void ProcessBlock(float *const *out)
+    {
+        Block mix;
+        PrepareBlock();
+        memset(mix, 0, sizeof(mix));
+        for(size_t v = 0; v < NUM_VOICES; v++)
+        {
+            Block voice_out;
+            RenderVoice(voices_[v], voice_out);
+            for(size_t i = 0; i < BLOCK_SIZE; i++)
+            {
+                for(size_t l = 0; l < lanes; l++)
+                {
+                    mix[i][l] += voice_out[i][l];
+                }
+            }
+        }
+        for(size_t l = 0; l < lanes; l++)
+        {
+            for(size_t i = 0; i < BLOCK_SIZE; i++)
+            {
+                out[l][i] = mix[i][l];
+            }
+        }
+    }
+
+    /** Renders size samples (a multiple of BLOCK_SIZE) of every lane to out[l], applying the
+        events of lane l from events[l] on the way. A control is rejected like in SetControl, if
+        it would change the layout or leave a patch the batch does not support, such as another
+        filter type or resonance low enough for the open stand-in. The lane keeps its patch and no
+        longer matches its VoiceManager. Returns the number of rejected events, and counts them
+        per lane in rejected[l] unless that is NULL.
+    */
+    size_t Render(const BatchEventList *events, float *const *out, size_t size, size_t *rejected = NULL)
+    {
+        size_t next[lanes], total = 0;
+        float *block_out[lanes];
+        for(size_t l = 0; l < lanes; l++)
+        {
+            next[l] = 0;
+            if(rejected != NULL)
+            {
+                rejected[l] = 0;
+            }
+        }
+        for(size_t i = 0; i < size; i += BLOCK_SIZE)
+        {
+            for(size_t l = 0; l < lanes; l++)
+            {
+                for(; next[l] < events[l].size && events[l].events[next[l]].frame < i + BLOCK_SIZE; next[l]++)
+                {
+                    if(!Apply(l, events[l].events[next[l]]))
+                    {
+                        total++;
+                        if(rejected != NULL)
+                        {
+                            rejected[l]++;
+                        }
+                    }
+                }
+                block_out[l] = out[l] + i;
+            }
+            ProcessBlock(block_out);
+        }
+        return total;
+    }
+
+  private:
+    typedef float Block[BLOCK_SIZE][lanes];
+    typedef void (custom::OscillatorLanes<lanes>::*OscKernel)(float (*)[lanes], const float (*)[lanes],
+                                                                const float (*)[lanes], const float (*)[lanes],
+                                                                float (*)[lanes], size_t);
+
+    //Voice slot v of every lane
+    struct VoiceLanes
+    {
+        custom::OscillatorLanes<lanes> osc1, osc2;
+        custom::NoiseLanes<lanes>      noise;
+        custom::MoogLadderLanes<lanes> filt;
+        custom::AdsrLanes<lanes>       filt_env, amp_env;
+        uint8_t                        note[lanes];
+        float                          velocity[lanes], freq[lanes], osc2_pitch[lanes];
+        int32_t                        gate[lanes];
+    };
+
+    //Everything of an instance that runs at control rate
+    struct Lane
+    {
+        Patch       patch;
+        custom::Lfo lfos[NUM_LFOS];
+        ModMatrix   mod;
+    };
+
+    bool Apply(size_t lane, const BatchEvent &event)
+    {
+        switch(event.type)
+        {
+            case BATCH_NOTE_ON: NoteOn(lane, event.data1, event.data2); return true;
+            case BATCH_NOTE_OFF: NoteOff(lane, event.data1); return true;
+            case BATCH_CONTROL: return SetControl(lane, event.data1, event.data2);
+            default: return false;
+        }
+    }
+
+    void ApplyPatch(size_t l, const Patch &patch)
+    {
+        lanes_[l].patch = patch;
+        for(size_t v = 0; v < NUM_VOICES; v++)
+        {
+            voices_[v].filt.SetRes(l, patch.values[CTRL_FILTERRESONANCE]);
+            voices_[v].filt_env.SetCoeffs(l, patch.filt_env);
+            voices_[v].amp_env.SetCoeffs(l, patch.amp_env);
+        }
+        for(int i = 0; i < NUM_LFOS; i++)
+        {
+            lanes_[l].lfos[i].SetWaveform(patch.lfo[i].waveform);
+            lanes_[l].lfos[i].SetFreq(patch.lfo[i].freq);
+        }
+    }
+
+    static inline void Gather(const custom::BlockSignal &in, Block out, size_t l)
+    {
+        for(size_t i = 0; i < BLOCK_SIZE; i++)
+        {
+            out[i][l] = in[i];
+        }
+    }
+
+    //The modulation of every lane as VoiceManager::PrepareBlock computes it, gathered into blocks
+    void PrepareBlock()
+    {
+        any_noise_ = false;
+        any_ring_  = false;
+        for(size_t l = 0; l < lanes; l++)
+        {
+            Lane        &lane   = lanes_[l];
+            const float *values = lane.patch.values;
+            float        lfo_out[NUM_LFOS][BLOCK_SIZE];
+            const float *sources[MOD_SRC_LAST];
+            for(int i = 0; i < NUM_LFOS; i++)
+            {
+                lane.lfos[i].ProcessBlock(lfo_out[i], BLOCK_SIZE);
+                sources[i] = lfo_out[i];
+            }
+            lane.mod.RoutePatch(values);
+            lane.mod.Compile();
+            lane.mod.Process(sources);
+
+            Gather(lane.mod.Get(MOD_DST_OSC1_PW), pw1_, l);
+            Gather(lane.mod.Get(MOD_DST_OSC2_PW), pw2_, l);
+            Gather(lane.mod.Get(MOD_DST_OSC1_FM), fm1_, l);
+            Gather(lane.mod.Get(MOD_DST_OSC2_FM), fm2_, l);
+            Gather(lane.mod.Get(MOD_DST_FILTER), filt_mod_, l);
+            Gather(lane.mod.Get(MOD_DST_AMP), amp_mod_, l);
+            filt_constant_[l] = lane.mod.IsConstant(MOD_DST_FILTER);
+            amp_constant_[l]  = lane.mod.IsConstant(MOD_DST_AMP);
+
+            mix_[l]   = values[CTRL_OSCMIX];
+            noise_[l] = values[CTRL_NOISE];
+            ring_[l]  = values[CTRL_RINGMOD];
+            pm_[l]    = values[CTRL_OSC2PHASEMOD];
+            any_noise_ |= noise_[l] != 0.f;
+            any_ring_ |= ring_[l] != 0.f;
+        }
+    }
+
+    //Voice::ProcessBlock for slot voice of every lane
+    void RenderVoice(VoiceLanes &voice, Block buf)
+    {
+        Block osc1_out, osc2_out, sync_vector, pm_vector, ring_out, noise_out, env_out, filt_freq;
+
+        (voice.osc1.*osc1_kernel_)(osc1_out, pw1_, fm1_, NULL, sync_vector, BLOCK_SIZE);
+
+        //Voice::ProcessBlock retunes osc2 every block, powf only needs to run when the pitch moved
+        for(size_t l = 0; l < lanes; l++)
+        {
+            const float *values = lanes_[l].patch.values;
+            float        pitch  = voice.note[l] + values[CTRL_OSC2TUNECOARSE] + values[CTRL_OSC2TUNEFINE];
+            if(pitch != voice.osc2_pitch[l])
+            {
+                voice.osc2_pitch[l] = pitch;
+                voice.osc2.SetFreq(l, daisysp::mtof(pitch));
+            }
+        }
+        if(layout_.phase_mod)
+        {
+            for(size_t i = 0; i < BLOCK_SIZE; i++)
+            {
+                for(size_t l = 0; l < lanes; l++)
+                {
+                    pm_vector[i][l] = osc1_out[i][l] * pm_[l];
+                }
+            }
+        }
+        (voice.osc2.*osc2_kernel_)(osc2_out, pw2_, fm2_, pm_vector, sync_vector, BLOCK_SIZE);
+
+        //Per lane factors of the mixer and filter, from the note held by the voice
+        float split_high[lanes], split_low[lanes], cutoff[lanes];
+        for(size_t l = 0; l < lanes; l++)
+        {
+            const float *values = lanes_[l].patch.values;
+            split_high[l]       = !values[CTRL_OSCSPLIT] || voice.note[l] > 63;
+            split_low[l]        = !values[CTRL_OSCSPLIT] || voice.note[l] < 64;
+            float velocity_freq = 20000.f * values[CTRL_FILTERVELOCITYMOD] * voice.velocity[l];
+            float kbd_freq      = voice.freq[l] * values[CTRL_FILTERKEYBEDTRACK];
+            cutoff[l]           = values[CTRL_FILTERCUTOFF] + (velocity_freq + kbd_freq);
+        }
+
+        for(size_t i = 0; i < BLOCK_SIZE; i++)
+        {
+            for(size_t l = 0; l < lanes; l++)
+            {
+                float o1       = osc1_out[i][l] * split_high[l];
+                float o2       = osc2_out[i][l] * split_low[l];
+                ring_out[i][l] = o1 * o2;
+                buf[i][l]      = o1 * (1 - mix_[l]) + o2 * mix_[l];
+            }
+        }
+        if(any_ring_)
+        {
+            for(size_t i = 0; i < BLOCK_SIZE; i++)
+            {
+                for(size_t l = 0; l < lanes; l++)
+                {
+                    buf[i][l] = buf[i][l] * (1 - ring_[l]) + ring_out[i][l] * ring_[l];
+                }
+            }
+        }
+        if(any_noise_)
+        {
+            voice.noise.ProcessBlock(noise_out, noise_, layout_.noise_mode, BLOCK_SIZE);
+            for(size_t i = 0; i < BLOCK_SIZE; i++)
+            {
+                for(size_t l = 0; l < lanes; l++)
+                {
+                    buf[i][l] += noise_out[i][l];
+                }
+            }
+        }
+
+        //Cutoff and amplifier in the order Voice::ProcessBlock multiplies them
+        voice.filt_env.ProcessBlock(env_out, voice.gate, BLOCK_SIZE);
+        for(size_t i = 0; i < BLOCK_SIZE; i++)
+        {
+            for(size_t l = 0; l < lanes; l++)
+            {
+                float env = env_out[i][l], mod = filt_mod_[i][l];
+                filt_freq[i][l] = filt_constant_[l] ? env * (cutoff[l] * mod) : (mod * env) * cutoff[l];
+            }
+        }
+        voice.filt.ProcessBlock(buf, filt_freq, BLOCK_SIZE);
+
+        voice.amp_env.ProcessBlock(env_out, voice.gate, BLOCK_SIZE);
+        for(size_t i = 0; i < BLOCK_SIZE; i++)
+        {
+            for(size_t l = 0; l < lanes; l++)
+            {
+                float env = env_out[i][l], mod = amp_mod_[i][l], velocity = voice.velocity[l];
+                buf[i][l] *= amp_constant_[l] ? env * (velocity * mod) : (env * mod) * velocity;
+            }
+        }
+    }
+
+    template <uint8_t waveform>
+    void ResolveOsc1()
+    {
+        using custom::Oscillator;
+        typedef custom::OscillatorLanes<lanes> Osc;
+        if(layout_.sync)
+        {
+            osc1_kernel_ = &Osc::template ProcessBlock<waveform, Oscillator::SYNC_MASTER, false>;
+        }
+        else
+        {
+            osc1_kernel_ = &Osc::template ProcessBlock<waveform, Oscillator::SYNC_NONE, false>;
+        }
+    }
+
+    template <uint8_t waveform>
+    void ResolveOsc2()
+    {
+        using custom::Oscillator;
+        typedef custom::OscillatorLanes<lanes> Osc;
+        switch(layout_.sync | layout_.phase_mod << 1)
+        {
+            case 0: osc2_kernel_ = &Osc::template ProcessBlock<waveform, Oscillator::SYNC_NONE, false>; break;
+            case 1: osc2_kernel_ = &Osc::template ProcessBlock<waveform, Oscillator::SYNC_SLAVE, false>; break;
+            case 2: osc2_kernel_ = &Osc::template ProcessBlock<waveform, Oscillator::SYNC_NONE, true>; break;
+            default: osc2_kernel_ = &Osc::template ProcessBlock<waveform, Oscillator::SYNC_SLAVE, true>; break;
+        }
+    }
+
+    void SelectKernels()
+    {
+        using custom::Oscillator;
+        switch(layout_.osc1_waveform)
+        {
+            case Oscillator::WAVE_TRI: ResolveOsc1<Oscillator::WAVE_TRI>(); break;
+            case Oscillator::WAVE_SAW: ResolveOsc1<Oscillator::WAVE_SAW>(); break;
+            case Oscillator::WAVE_RAMP: ResolveOsc1<Oscillator::WAVE_RAMP>(); break;
+            case Oscillator::WAVE_SQUARE: ResolveOsc1<Oscillator::WAVE_SQUARE>(); break;
+            case Oscillator::WAVE_POLYBLEP_TRI: ResolveOsc1<Oscillator::WAVE_POLYBLEP_TRI>(); break;
+            case Oscillator::WAVE_POLYBLEP_SAW: ResolveOsc1<Oscillator::WAVE_POLYBLEP_SAW>(); break;
+            case Oscillator::WAVE_POLYBLEP_SQUARE: ResolveOsc1<Oscillator::WAVE_POLYBLEP_SQUARE>(); break;
+            default: ResolveOsc1<Oscillator::WAVE_SIN>(); break;
+        }
+        switch(layout_.osc2_waveform)
+        {
+            case Oscillator::WAVE_TRI: ResolveOsc2<Oscillator::WAVE_TRI>(); break;
+            case Oscillator::WAVE_SAW: ResolveOsc2<Oscillator::WAVE_SAW>(); break;
+            case Oscillator::WAVE_RAMP: ResolveOsc2<Oscillator::WAVE_RAMP>(); break;
+            case Oscillator::WAVE_SQUARE: ResolveOsc2<Oscillator::WAVE_SQUARE>(); break;
+            case Oscillator::WAVE_POLYBLEP_TRI: ResolveOsc2<Oscillator::WAVE_POLYBLEP_TRI>(); break;
+            case Oscillator::WAVE_POLYBLEP_SAW: ResolveOsc2<Oscillator::WAVE_POLYBLEP_SAW>(); break;
+            case Oscillator::WAVE_POLYBLEP_SQUARE: ResolveOsc2<Oscillator::WAVE_POLYBLEP_SQUARE>(); break;
+            default: ResolveOsc2<Oscillator::WAVE_SIN>(); break;
+        }
+    }
+
+    VoiceLanes  voices_[NUM_VOICES];
+    Lane        lanes_[lanes];
+    BatchLayout layout_;
+    OscKernel   osc1_kernel_, osc2_kernel_;
+    float       sample_rate_;
+    //Written by PrepareBlock for the voices of the block
+    Block       pw1_, pw2_, fm1_, fm2_, filt_mod_, amp_mod_;
+    float       mix_[lanes], noise_[lanes], ring_[lanes], pm_[lanes];
+    int32_t     filt_constant_[lanes], amp_constant_[lanes];
+    bool        any_noise_, any_ring_;
+};
+
+#endif
@@ -0,0 +1,1041 @@
+//Host-side golden-output regression and micro-benchmark suite for the DSP modules.
+//Every scenario renders a fixed, deterministic buffer. With --record the buffers are
+//stored as raw float32 files, with --check they are compared against the stored ones.
+//Timings are always reported as ns/sample in JSON on stdout, plus cycles/sample on x86 hosts
+//and a quality metric (aliasing level, approximation error) for the scenarios that measure one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <complex>
+#include <vector>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <arm_math.h>
+
+#include "../include/main.h"
+#include "../include/engine.h"
+#include "../include/voice.h"
+#include "../include/oscillator.h"
+#include "../include/moogladder.h"
+#include "../include/zdffilter.h"
+#include "../include/adsr.h"
+#include "../include/noise.h"
+#include "../include/sine.h"
+#include "../include/denormal.h"
+
+#define SAMPLE_RATE 48000.f
+#define RENDER_SAMPLES 48000
+
+struct Scenario
+{
+    const char *name;
+    const char *module;
+    void (*render)(float *out, size_t size);
+    //Optional, returns a level in dB reported under metric_name
+    const char *metric_name;
+    float (*metric)(const float *buf, size_t size);
+};
+
+static uint8_t default_controls[NUM_CONTROLS];
+
+/* Oscillator scenarios */
+
+static void RenderOsc(float *out, size_t size, uint8_t waveform, float freq, bool pwm)
+{
+    custom::Oscillator osc;
+    float pw[BLOCK_SIZE], sync[BLOCK_SIZE];
+    osc.Init(SAMPLE_RATE);
+    osc.SetWaveform(waveform);
+    osc.SetFreq(freq);
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        for(size_t j = 0; j < BLOCK_SIZE && pwm; j++)
+        {
+            pw[j] = 0.5f + 0.4f * sinf(TWOPI_F * 2.f * (i + j) / SAMPLE_RATE);
+        }
+        osc.ProcessBlock(out + i,
+                         pwm ? custom::BlockSignal::Block(pw) : custom::BlockSignal::Constant(0.5f),
+                         custom::BlockSignal::Constant(0.f), custom::BlockSignal::Constant(0.f), sync, BLOCK_SIZE);
+    }
+}
+
+#define OSC_SCENARIO(wave)                                   \
+    static void RenderOsc_##wave(float *out, size_t size)    \
+    {                                                        \
+        RenderOsc(out, size, custom::Oscillator::wave, 440.f, false); \
+    }
+OSC_SCENARIO(WAVE_SIN)
+OSC_SCENARIO(WAVE_TRI)
+OSC_SCENARIO(WAVE_SAW)
+OSC_SCENARIO(WAVE_RAMP)
+OSC_SCENARIO(WAVE_SQUARE)
+OSC_SCENARIO(WAVE_POLYBLEP_TRI)
+OSC_SCENARIO(WAVE_POLYBLEP_SAW)
+OSC_SCENARIO(WAVE_POLYBLEP_SQUARE)
+
+static void RenderOscPwm(float *out, size_t size)
+{
+    RenderOsc(out, size, custom::Oscillator::WAVE_POLYBLEP_SQUARE, 220.f, true);
+}
+
+static void RenderOscHigh(float *out, size_t size)
+{
+    RenderOsc(out, size, custom::Oscillator::WAVE_POLYBLEP_SAW, 4186.f, false);
+}
+
+//One scenario per block kernel. Modulated kernels get a pw and fm buffer, a slave is reset by a
+//150 Hz master pattern and a master writes its own wraps.
+template <uint8_t waveform, uint8_t sync, bool modulated>
+static void RenderOscKernel(float *out, size_t size)
+{
+    custom::Oscillator osc;
+    float pw[BLOCK_SIZE], fm[BLOCK_SIZE], sync_vector[BLOCK_SIZE];
+    osc.Init(SAMPLE_RATE);
+    osc.SetWaveform(waveform);
+    osc.SetSync(sync);
+    osc.SetFreq(440.f);
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        for(size_t j = 0; j < BLOCK_SIZE; j++)
+        {
+            //2 Hz triangle, cheap enough to stay out of the kernel timing
+            float lfo      = 4.f * fabsf((float)((i + j) % 24000) / 24000.f - 0.5f) - 1.f;
+            pw[j]          = 0.5f + 0.4f * lfo;
+            fm[j]          = 0.01f * lfo;
+            sync_vector[j] = (i + j) % 320 == 0;
+        }
+        osc.ProcessBlock(out + i,
+                         modulated ? custom::BlockSignal::Block(pw) : custom::BlockSignal::Constant(0.5f),
+                         modulated ? custom::BlockSignal::Block(fm) : custom::BlockSignal::Constant(0.f),
+                         custom::BlockSignal::Constant(0.f), sync_vector, BLOCK_SIZE);
+    }
+}
+
+#define OSC_KERNEL_SCENARIOS(wave, name)                                                                              \
+    {"osc_kernel_" name, "oscillator", RenderOscKernel<custom::Oscillator::wave, custom::Oscillator::SYNC_NONE, false>},          \
+    {"osc_kernel_" name "_mod", "oscillator", RenderOscKernel<custom::Oscillator::wave, custom::Oscillator::SYNC_NONE, true>},    \
+    {"osc_kernel_" name "_master", "oscillator", RenderOscKernel<custom::Oscillator::wave, custom::Oscillator::SYNC_MASTER, false>}, \
+    {"osc_kernel_" name "_master_mod", "oscillator", RenderOscKernel<custom::Oscillator::wave, custom::Oscillator::SYNC_MASTER, true>}, \
+    {"osc_kernel_" name "_slave", "oscillator", RenderOscKernel<custom::Oscillator::wave, custom::Oscillator::SYNC_SLAVE, false>},  \
+    {"osc_kernel_" name "_slave_mod", "oscillator", RenderOscKernel<custom::Oscillator::wave, custom::Oscillator::SYNC_SLAVE, true>},
+
+/* Filter scenarios, fed with a naive 110 Hz saw */
+
+template <typename Filter>
+static void RenderFilter(Filter &filt, float *out, size_t size, float start_freq, float end_freq)
+{
+    float freq[BLOCK_SIZE];
+    float ph    = 0.f;
+    float f     = start_freq;
+    float ratio = powf(end_freq / start_freq, 1.f / size);
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        for(size_t j = 0; j < BLOCK_SIZE; j++)
+        {
+            out[i + j] = 1.f - 2.f * ph;
+            freq[j]    = f;
+            ph += 110.f / SAMPLE_RATE;
+            ph -= ph >= 1.f ? 1.f : 0.f;
+            f *= ratio;
+        }
+        //A fixed cutoff takes the scalar path, a sweep the per sample one
+        filt.ProcessBlock(out + i,
+                          start_freq == end_freq ? custom::BlockSignal::Constant(start_freq) : custom::BlockSignal::Block(freq),
+                          BLOCK_SIZE);
+    }
+}
+
+//Cutoff swept exponentially between 200 Hz and 6.4 kHz by a 440 Hz triangle
+template <typename Filter>
+static void RenderFilterFm(Filter &filt, float *out, size_t size)
+{
+    float freq[BLOCK_SIZE];
+    float ph = 0.f, lfo = 0.f;
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        for(size_t j = 0; j < BLOCK_SIZE; j++)
+        {
+            out[i + j] = 1.f - 2.f * ph;
+            freq[j]    = 200.f * exp2f(5.f * (lfo < 0.5f ? 2.f * lfo : 2.f - 2.f * lfo));
+            ph += 110.f / SAMPLE_RATE;
+            ph -= ph >= 1.f ? 1.f : 0.f;
+            lfo += 440.f / SAMPLE_RATE;
+            lfo -= lfo >= 1.f ? 1.f : 0.f;
+        }
+        filt.ProcessBlock(out + i, custom::BlockSignal::Block(freq), BLOCK_SIZE);
+    }
+}
+
+static void RenderLadder(float *out, size_t size, float start_freq, float end_freq, float res, bool open = true)
+{
+    custom::MoogLadder filt;
+    filt.Init(SAMPLE_RATE);
+    filt.SetRes(res);
+    filt.SetOpenApproximation(open);
+    RenderFilter(filt, out, size, start_freq, end_freq);
+}
+
+static void RenderLadderFm(float *out, size_t size)
+{
+    custom::MoogLadder filt;
+    filt.Init(SAMPLE_RATE);
+    filt.SetRes(0.7f);
+    RenderFilterFm(filt, out, size);
+}
+
+//A short burst into a dark resonant filter followed by silence, the tail is what gets measured
+static void RenderLadderTail(float *out, size_t size)
+{
+    custom::MoogLadder filt;
+    filt.Init(SAMPLE_RATE);
+    filt.SetRes(0.5f);
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        for(size_t j = 0; j < BLOCK_SIZE; j++)
+        {
+            out[i + j] = i + j < 1024 ? ((i + j) & 64 ? 1.f : -1.f) : 0.f;
+        }
+        filt.ProcessBlock(out + i, custom::BlockSignal::Constant(300.f), BLOCK_SIZE);
+    }
+}
+
+static void RenderLadderDark(float *out, size_t size) { RenderLadder(out, size, 500.f, 500.f, 0.f); }
+static void RenderLadderOpen(float *out, size_t size) { RenderLadder(out, size, 20000.f, 20000.f, 0.f); }
+static void RenderLadderOpenExact(float *out, size_t size) { RenderLadder(out, size, 20000.f, 20000.f, 0.f, false); }
+//Closes from fully open to 8 kHz, switching from the stand-in to the ladder on the way
+static void RenderLadderOpenSweep(float *out, size_t size) { RenderLadder(out, size, 22000.f, 8000.f, 0.f); }
+static void RenderLadderRes(float *out, size_t size) { RenderLadder(out, size, 2000.f, 2000.f, 1.f); }
+static void RenderLadderSelfOsc(float *out, size_t size) { RenderLadder(out, size, 1000.f, 1000.f, 1.8f); }
+static void RenderLadderSweep(float *out, size_t size) { RenderLadder(out, size, 100.f, 12000.f, 0.7f); }
+
+static void RenderZdf(float *out, size_t size, uint8_t mode, float start_freq, float end_freq, float res)
+{
+    custom::ZdfFilter filt;
+    filt.Init(SAMPLE_RATE);
+    filt.SetMode(mode);
+    filt.SetRes(res);
+    RenderFilter(filt, out, size, start_freq, end_freq);
+}
+
+template <uint8_t mode>
+static void RenderZdfFm(float *out, size_t size)
+{
+    custom::ZdfFilter filt;
+    filt.Init(SAMPLE_RATE);
+    filt.SetMode(mode);
+    filt.SetRes(0.7f);
+    RenderFilterFm(filt, out, size);
+}
+
+static void RenderLadder2Dark(float *out, size_t size) { RenderZdf(out, size, custom::ZdfFilter::MODE_LADDER2, 500.f, 500.f, 0.f); }
+static void RenderLadder2Res(float *out, size_t size) { RenderZdf(out, size, custom::ZdfFilter::MODE_LADDER2, 2000.f, 2000.f, 1.f); }
+static void RenderLadder2Sweep(float *out, size_t size) { RenderZdf(out, size, custom::ZdfFilter::MODE_LADDER2, 100.f, 12000.f, 0.7f); }
+static void RenderSvfLowpass(float *out, size_t size) { RenderZdf(out, size, custom::ZdfFilter::MODE_LOWPASS, 2000.f, 2000.f, 0.5f); }
+static void RenderSvfBandpass(float *out, size_t size) { RenderZdf(out, size, custom::ZdfFilter::MODE_BANDPASS, 2000.f, 2000.f, 0.5f); }
+static void RenderSvfHighpass(float *out, size_t size) { RenderZdf(out, size, custom::ZdfFilter::MODE_HIGHPASS, 2000.f, 2000.f, 0.5f); }
+static void RenderSvfSweep(float *out, size_t size) { RenderZdf(out, size, custom::ZdfFilter::MODE_LOWPASS, 100.f, 12000.f, 0.7f); }
+
+/* Saturator scenarios, a hot sine lying exactly on an analysis bin so every harmonic folded
+   back above Nyquist lands on a bin of its own. The cutoff stays below the 1x ADAA limit
+   so all saturators see the same filter */
+
+#define ALIAS_FFT_SIZE 4096
+#define ALIAS_BIN 419
+
+static void RenderLadderSaturator(float *out, size_t size, uint8_t saturator)
+{
+    custom::MoogLadder filt;
+    filt.Init(SAMPLE_RATE);
+    filt.SetSaturator(saturator);
+    filt.SetRes(0.5f);
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        for(size_t j = 0; j < BLOCK_SIZE; j++)
+        {
+            out[i + j] = 2.f * sinf(2.f * (float)M_PI * ALIAS_BIN * ((i + j) % ALIAS_FFT_SIZE) / ALIAS_FFT_SIZE);
+        }
+        filt.ProcessBlock(out + i, custom::BlockSignal::Constant(8000.f), BLOCK_SIZE);
+    }
+}
+
+static void RenderLadderSatPade(float *out, size_t size) { RenderLadderSaturator(out, size, custom::MoogLadder::SATURATOR_PADE); }
+static void RenderLadderSatLut(float *out, size_t size) { RenderLadderSaturator(out, size, custom::MoogLadder::SATURATOR_LUT); }
+static void RenderLadderSatAdaa(float *out, size_t size) { RenderLadderSaturator(out, size, custom::MoogLadder::SATURATOR_ADAA); }
+
+static void Fft(std::complex<double> *x, size_t n)
+{
+    for(size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for(; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if(i < j)
+            std::swap(x[i], x[j]);
+    }
+    for(size_t len = 2; len <= n; len <<= 1)
+    {
+        std::complex<double> w = std::polar(1.0, -2.0 * M_PI / len);
+        for(size_t i = 0; i < n; i += len)
+        {
+            std::complex<double> wk = 1.0;
+            for(size_t k = 0; k < len / 2; k++, wk *= w)
+            {
+                std::complex<double> a = x[i + k], b = x[i + k + len / 2] * wk;
+                x[i + k]           = a + b;
+                x[i + k + len / 2] = a - b;
+            }
+        }
+    }
+}
+
+//Power of everything that is not a harmonic of ALIAS_BIN, relative to the fundamental,
+//measured on the settled last frame
+static float AliasingLevel(const float *buf, size_t size)
+{
+    std::vector<std::complex<double>> x(buf + size - ALIAS_FFT_SIZE, buf + size);
+    Fft(x.data(), ALIAS_FFT_SIZE);
+    double fundamental = std::norm(x[ALIAS_BIN]);
+    double alias       = 0.0;
+    for(size_t k = 1; k < ALIAS_FFT_SIZE / 2; k++)
+    {
+        if(k % ALIAS_BIN)
+            alias += std::norm(x[k]);
+    }
+    return (float)(10.0 * log10(alias / fundamental + 1e-30));
+}
+
+/* Sine scenarios, an irrational phase step so every part of the cycle is hit */
+
+#define SINE_STEP 0.0618034f
+
+template <uint8_t accuracy>
+static void RenderSine(float *out, size_t size)
+{
+    float x[BLOCK_SIZE];
+    float phase = -0.5f;
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        for(size_t j = 0; j < BLOCK_SIZE; j++)
+        {
+            phase += SINE_STEP;
+            phase -= phase >= 1.5f ? 2.0f : 0.0f;
+            x[j] = phase;
+        }
+        custom::SineBlock<accuracy>(out + i, x, BLOCK_SIZE);
+    }
+}
+
+//Largest absolute error against the double precision sine, replaying RenderSine's phases
+static float SineError(const float *buf, size_t size)
+{
+    double max_err = 0.0;
+    float  phase   = -0.5f;
+    for(size_t i = 0; i < size; i++)
+    {
+        phase += SINE_STEP;
+        phase -= phase >= 1.5f ? 2.0f : 0.0f;
+        max_err = std::max(max_err, fabs(buf[i] - sin(2.0 * M_PI * phase)));
+    }
+    return (float)(20.0 * log10(max_err + 1e-30));
+}
+
+//Inputs on the edges of the wrap to one cycle: the integers from -64 to 64, the floats right
+//next to them, values too close below one to survive the wrap, and the quarter points
+static float SineEdgeInput(size_t i)
+{
+    float base = (float)((int)(i / 8 % 129) - 64);
+    switch(i % 8)
+    {
+        case 0: return base;
+        case 1: return nextafterf(base, -INFINITY);
+        case 2: return nextafterf(base, INFINITY);
+        case 3: return base - 1e-9f;
+        case 4: return base + 0.25f;
+        case 5: return base + 0.5f;
+        case 6: return base - 0.25f;
+        default: return -1e-9f * (float)(i % 1000);
+    }
+}
+
+template <uint8_t accuracy>
+static void RenderSineEdges(float *out, size_t size)
+{
+    float x[BLOCK_SIZE];
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        for(size_t j = 0; j < BLOCK_SIZE; j++)
+        {
+            x[j] = SineEdgeInput(i + j);
+        }
+        custom::SineBlock<accuracy>(out + i, x, BLOCK_SIZE);
+    }
+}
+
+static float SineEdgeError(const float *buf, size_t size)
+{
+    double max_err = 0.0;
+    for(size_t i = 0; i < size; i++)
+    {
+        max_err = std::max(max_err, fabs(buf[i] - sin(2.0 * M_PI * (double)SineEdgeInput(i))));
+    }
+    return (float)(20.0 * log10(max_err + 1e-30));
+}
+
+/* Noise scenarios */
+
+static void RenderNoise(float *out, size_t size, uint8_t mode)
+{
+    custom::Noise noise;
+    noise.Init(1);
+    noise.SetMode(mode);
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        noise.ProcessBlock(out + i, BLOCK_SIZE);
+    }
+}
+
+static void RenderNoiseWhite(float *out, size_t size) { RenderNoise(out, size, custom::Noise::MODE_WHITE); }
+static void RenderNoisePink(float *out, size_t size) { RenderNoise(out, size, custom::Noise::MODE_PINK); }
+
+/* Envelope scenarios, gate held for the first half and released for the second */
+
+static void RenderAdsr(float *out, size_t size, float a, float d, float s, float r)
+{
+    custom::Adsr env;
+    env.Init(SAMPLE_RATE);
+    env.SetTime(custom::ADSR_SEG_ATTACK, a);
+    env.SetTime(custom::ADSR_SEG_DECAY, d);
+    env.SetSustainLevel(s);
+    env.SetTime(custom::ADSR_SEG_RELEASE, r);
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        env.ProcessBlock(out + i, BLOCK_SIZE, i < size / 2);
+    }
+}
+
+static void RenderAdsrPluck(float *out, size_t size) { RenderAdsr(out, size, 0.f, 0.2f, 0.f, 0.1f); }
+static void RenderAdsrPad(float *out, size_t size) { RenderAdsr(out, size, 0.25f, 0.3f, 0.6f, 0.4f); }
+static void RenderAdsrGate(float *out, size_t size) { RenderAdsr(out, size, 0.f, 0.f, 1.f, 0.f); }
+static void RenderAdsrSlow(float *out, size_t size) { RenderAdsr(out, size, 1.f, 1.f, 0.5f, 2.f); }
+
+/* Full engine scenarios, 12 voice chords */
+
+struct Control
+{
+    int     param;
+    uint8_t value;
+};
+
+//MIDI clock fed to the engine at clock_bpm, with every tick delayed by up to 2 ms as if read by
+//a busy main loop. 0 renders without a clock.
+static float clock_bpm;
+
+//Control changes sent before every block, a knob sweep from a sequencer. 0 sends none.
+static int render_ccs_per_block;
+
+//Sends one cutoff change without crossfade halfway through the preset crossfade
+static bool render_cc_mid_fade;
+
+//Voice oversampling of the render, and whether it plays LEAD_NOTE alone instead of a chord
+static uint8_t render_oversample = 1;
+static bool    render_lead;
+#define LEAD_NOTE 88
+
+static uint8_t RenderNote(uint8_t n) { return render_lead ? LEAD_NOTE : 36 + n * 5; }
+static uint8_t RenderNotes() { return render_lead ? 1 : NUM_VOICES; }
+
+//Notes pressed by the last RenderEngine and the voices sounding after its first block, -1 for
+//other renders. A chord sent before one block has to get a voice per note
+static int render_notes, render_voices = -1;
+
+static void RenderEngine(float *out, size_t size, const Control *controls, size_t num_controls, bool release,
+                         const uint8_t *switch_to = NULL)
+{
+    double   tick_us    = 60e6 / (clock_bpm * 24.f);
+    double   next_tick  = 0.0;
+    uint32_t jitter     = 1;
+    memcpy(ControlPanel, default_controls, sizeof(ControlPanel));
+    EngineInit(SAMPLE_RATE, render_oversample);
+    for(size_t i = 0; i < num_controls; i++)
+    {
+        HandleControls(controls[i].value, controls[i].param, true);
+    }
+    EngineUpdate();
+    for(uint8_t n = 0; n < RenderNotes(); n++)
+    {
+        EngineNoteOn(RenderNote(n), 100);
+    }
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        if(switch_to && i == size / 4)
+        {
+            EngineLoadPreset(switch_to, true);
+        }
+        if(switch_to && render_cc_mid_fade && i == size / 4 + PATCH_CROSSFADE_BLOCKS / 2 * BLOCK_SIZE)
+        {
+            HandleControls(20, CTRL_FILTERCUTOFF, true);
+            EngineUpdate();
+        }
+        //Ticks that arrived during the previous block are handled before this one
+        double now_us = i * 1e6 / SAMPLE_RATE;
+        while(clock_bpm > 0.f && next_tick <= now_us)
+        {
+            if(next_tick == 0.0)
+            {
+                EngineClockStart();
+            }
+            jitter = jitter * 1664525u + 1013904223u;
+            EngineClockTick((uint32_t)(next_tick + (jitter >> 21) * (2000.0 / 2048.0)) + 1000);
+            next_tick += tick_us;
+        }
+        if(release && i == size / 2)
+        {
+            for(uint8_t n = 0; n < RenderNotes(); n++)
+            {
+                EngineNoteOff(RenderNote(n), 0);
+            }
+        }
+        //Cutoff goes up and down once a second, the envelope release is nudged along with it
+        for(int c = 0; c < render_ccs_per_block; c++)
+        {
+            size_t  step  = (i / BLOCK_SIZE * render_ccs_per_block + c) / 8 % 254;
+            uint8_t value = step < 127 ? step : 253 - step;
+            HandleControls(value, c % 4 ? CTRL_FILTERCUTOFF : CTRL_AMPRELEASE, true);
+        }
+        if(render_ccs_per_block)
+        {
+            EngineUpdate();
+        }
+        EngineProcessBlock(out + i, BLOCK_SIZE);
+        if(i == 0)
+        {
+            render_notes  = RenderNotes();
+            render_voices = EngineNumActiveVoices();
+        }
+    }
+    //Release every voice, EngineInit resets the rest of the state for the next render
+    for(uint8_t n = 0; n < RenderNotes(); n++)
+    {
+        EngineNoteOff(RenderNote(n), 0);
+    }
+}
+
+static const Control kPatchDefault[] = {{CTRL_AMPRELEASE, 2}};
+
+//Long release through dark resonant filters, most of the render is the release tail
+static const Control kPatchTail[] = {
+    {CTRL_FILTERCUTOFF, 60},
+    {CTRL_FILTERRESONANCE, 80},
+    {CTRL_AMPRELEASE, 127},
+};
+
+static const Control kPatchPolyblepRes[] = {
+    {CTRL_OSC1WAVEFORM, 7 * 26},
+    {CTRL_OSC2WAVEFORM, 6 * 26},
+    {CTRL_OSC2TUNECOARSE, 96},
+    {CTRL_FILTERCUTOFF, 90},
+    {CTRL_FILTERRESONANCE, 120},
+};
+
+static const Control kPatchLfoMod[] = {
+    {CTRL_OSC1WAVEFORM, 4 * 26},
+    {CTRL_OSC1PWMOD, 100},
+    {CTRL_OSC2FREQUENCYMOD, 20},
+    {CTRL_FILTERCUTOFF, 110},
+    {CTRL_FILTERLFOMOD, 60},
+    {CTRL_AMPLFOMOD, 40},
+    {CTRL_LFOWAVEFORM, 1 * 26},
+    {CTRL_LFOFREQUENCY, 30},
+};
+
+static const Control kPatchPad[] = {
+    {CTRL_OSC1WAVEFORM, 6 * 26},
+    {CTRL_OSC2WAVEFORM, 5 * 26},
+    {CTRL_OSC2TUNEFINE, 70},
+    {CTRL_NOISE, 10},
+    {CTRL_FILTERCUTOFF, 100},
+    {CTRL_FILTERATTACK, 8},
+    {CTRL_FILTERSUSTAIN, 80},
+    {CTRL_AMPATTACK, 10},
+    {CTRL_AMPRELEASE, 20},
+};
+
+//Two operator bell: osc1 phase modulates osc2 a twelfth above, only osc2 is heard
+static const Control kPatchFmBell[] = {
+    {CTRL_OSC2TUNECOARSE, 114},
+    {CTRL_OSC2PHASEMOD, 60},
+    {CTRL_OSCMIX, 127},
+    {CTRL_FILTERCUTOFF, 120},
+    {CTRL_AMPDECAY, 40},
+    {CTRL_AMPSUSTAIN, 20},
+};
+
+//Saw against a sine a fifth above through the ring modulator
+static const Control kPatchRingMod[] = {
+    {CTRL_OSC1WAVEFORM, 6 * 26},
+    {CTRL_OSC2TUNECOARSE, 83},
+    {CTRL_RINGMOD, 100},
+    {CTRL_FILTERCUTOFF, 110},
+};
+
+#define COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+static void RenderChordDefault(float *out, size_t size)
+{
+    RenderEngine(out, size, kPatchDefault, COUNT(kPatchDefault), false);
+}
+static void RenderChordPolyblepRes(float *out, size_t size)
+{
+    RenderEngine(out, size, kPatchPolyblepRes, COUNT(kPatchPolyblepRes), false);
+}
+static void RenderChordLfoMod(float *out, size_t size)
+{
+    RenderEngine(out, size, kPatchLfoMod, COUNT(kPatchLfoMod), false);
+}
+static const Control kPatchLfoSync[] = {
+    {CTRL_OSC1WAVEFORM, 4 * 26},
+    {CTRL_OSC1PWMOD, 100},
+    {CTRL_FILTERCUTOFF, 110},
+    {CTRL_FILTERLFOMOD, 60},
+    {CTRL_LFOWAVEFORM, 1 * 26},
+    {CTRL_LFOFREQUENCY, 7 * 8}, //quarter note
+    {CTRL_LFOTEMPOSYNC, 127},
+};
+
+static void RenderChordLfoClock(float *out, size_t size)
+{
+    clock_bpm = 132.f;
+    RenderEngine(out, size, kPatchLfoSync, COUNT(kPatchLfoSync), false);
+    clock_bpm = 0.f;
+}
+
+static void RenderChordFmBell(float *out, size_t size)
+{
+    RenderEngine(out, size, kPatchFmBell, COUNT(kPatchFmBell), true);
+}
+
+static void RenderChordRingMod(float *out, size_t size)
+{
+    RenderEngine(out, size, kPatchRingMod, COUNT(kPatchRingMod), false);
+}
+
+static void RenderChordCcSweep(float *out, size_t size)
+{
+    render_ccs_per_block = 32;
+    RenderEngine(out, size, kPatchLfoMod, COUNT(kPatchLfoMod), false);
+    render_ccs_per_block = 0;
+}
+
+//Control changes per published patch in the last render
+static float ControlsCoalesced(const float *, size_t)
+{
+    ControlStats stats = EngineGetControlStats();
+    return stats.patches ? (float)stats.received / stats.patches : 0.f;
+}
+
+/* A note behind a control change that misses the pending patch, as sent by two passes of the
+   firmware's main loop within one block */
+
+#define NOTE_AFTER_CC_BLOCK 8
+
+//The resonance goes up for the block before NOTE_AFTER_CC_BLOCK, then note 60 starts with the
+//filter opened. With late, the cutoff and the note are sent right behind the resonance, before
+//the audio side has taken it, instead of in the next block
+static void RenderNoteAfterCc(float *out, size_t size, bool late)
+{
+    memcpy(ControlPanel, default_controls, sizeof(ControlPanel));
+    EngineInit(SAMPLE_RATE);
+    HandleControls(20, CTRL_FILTERCUTOFF, true);
+    EngineUpdate();
+    for(size_t i = 0; i < size; i += BLOCK_SIZE)
+    {
+        if(i == (NOTE_AFTER_CC_BLOCK - 1) * BLOCK_SIZE)
+        {
+            HandleControls(100, CTRL_FILTERRESONANCE, true);
+            EngineUpdate();
+        }
+        if(i == (NOTE_AFTER_CC_BLOCK - (late ? 1 : 0)) * BLOCK_SIZE)
+        {
+            HandleControls(127, CTRL_FILTERCUTOFF, true);
+            EngineNoteOn(60, 100);
+        }
+        EngineUpdate();
+        EngineProcessBlock(out + i, BLOCK_SIZE);
+    }
+    EngineNoteOff(60, 0);
+}
+
+static void RenderNoteAfterCcLate(float *out, size_t size) { RenderNoteAfterCc(out, size, true); }
+
+//Largest difference in dB, from the block the note was sent through its first block on the new
+//patch, against the note sent together with the controls
+static float NoteAfterCcError(const float *buf, size_t size)
+{
+    std::vector<float> ref(size);
+    RenderNoteAfterCc(ref.data(), size, false);
+    float max_err = 0.f;
+    for(size_t i = (NOTE_AFTER_CC_BLOCK - 1) * BLOCK_SIZE; i < (NOTE_AFTER_CC_BLOCK + 1) * BLOCK_SIZE; i++)
+    {
+        max_err = std::max(max_err, fabsf(buf[i] - ref[i]));
+    }
+    return 20.f * log10f(max_err + 1e-30f);
+}
+
+/* The polyblep_res patch through the lighter filter models, compare with engine_chord12_polyblep_res */
+
+#define FILTER_MODEL_PATCH(name, type)             \
+    static const Control kPatch##name[] = {        \
+        {CTRL_OSC1WAVEFORM, 7 * 26},               \
+        {CTRL_OSC2WAVEFORM, 6 * 26},               \
+        {CTRL_OSC2TUNECOARSE, 96},                 \
+        {CTRL_FILTERCUTOFF, 90},                   \
+        {CTRL_FILTERRESONANCE, 120},               \
+        {CTRL_FILTERTYPE, type * 26},              \
+    };                                             \
+    static void RenderChord##name(float *out, size_t size) \
+    {                                              \
+        RenderEngine(out, size, kPatch##name, COUNT(kPatch##name), false); \
+    }
+FILTER_MODEL_PATCH(Ladder2, FILTER_LADDER2)
+FILTER_MODEL_PATCH(SvfLowpass, FILTER_SVF_LOWPASS)
+FILTER_MODEL_PATCH(SvfBandpass, FILTER_SVF_BANDPASS)
+
+/* Oversampled voices against polyBLEP. Leads are osc1 alone, so every partial is a harmonic of
+   LEAD_NOTE or an alias */
+
+static const Control kPatchSaw[] = {{CTRL_OSC1WAVEFORM, 2 * 26}, {CTRL_OSC2WAVEFORM, 2 * 26}};
+static const Control kPatchPolyblepSaw[] = {{CTRL_OSC1WAVEFORM, 6 * 26}, {CTRL_OSC2WAVEFORM, 6 * 26}};
+static const Control kPatchLeadSaw[] = {{CTRL_OSC1WAVEFORM, 2 * 26}, {CTRL_OSCMIX, 0}};
+static const Control kPatchLeadPolyblepSaw[] = {{CTRL_OSC1WAVEFORM, 6 * 26}, {CTRL_OSCMIX, 0}};
+static const Control kPatchLeadSquare[] = {{CTRL_OSC1WAVEFORM, 4 * 26}, {CTRL_OSCMIX, 0}};
+static const Control kPatchLeadPolyblepSquare[] = {{CTRL_OSC1WAVEFORM, 7 * 26}, {CTRL_OSCMIX, 0}};
+
+static void RenderOversampled(float *out, size_t size, const Control *controls, size_t num_controls,
+                              uint8_t oversample, bool lead)
+{
+    render_oversample = oversample;
+    render_lead       = lead;
+    RenderEngine(out, size, controls, num_controls, false);
+    render_oversample = 1;
+    render_lead       = false;
+}
+
+#define OVERSAMPLED_SCENARIO(name, patch, oversample, lead)           \
+    static void Render##name(float *out, size_t size)                \
+    {                                                                 \
+        RenderOversampled(out, size, patch, COUNT(patch), oversample, lead); \
+    }
+OVERSAMPLED_SCENARIO(ChordSaw, kPatchSaw, 1, false)
+OVERSAMPLED_SCENARIO(ChordSawOs2, kPatchSaw, 2, false)
+OVERSAMPLED_SCENARIO(ChordPolyblepSaw, kPatchPolyblepSaw, 1, false)
+OVERSAMPLED_SCENARIO(ChordDefaultOs2, kPatchDefault, 2, false)
+OVERSAMPLED_SCENARIO(LeadSaw, kPatchLeadSaw, 1, true)
+OVERSAMPLED_SCENARIO(LeadSawOs2, kPatchLeadSaw, 2, true)
+OVERSAMPLED_SCENARIO(LeadPolyblepSaw, kPatchLeadPolyblepSaw, 1, true)
+OVERSAMPLED_SCENARIO(LeadPolyblepSawOs2, kPatchLeadPolyblepSaw, 2, true)
+OVERSAMPLED_SCENARIO(LeadSquare, kPatchLeadSquare, 1, true)
+OVERSAMPLED_SCENARIO(LeadSquareOs2, kPatchLeadSquare, 2, true)
+OVERSAMPLED_SCENARIO(LeadPolyblepSquare, kPatchLeadPolyblepSquare, 1, true)
+
+#define LEAD_FFT_SIZE 8192
+
+//Power away from the harmonics of LEAD_NOTE relative to the power on them, measured on the
+//last frame through a Blackman-Harris window (sidelobes below -92 dB, main lobe 4 bins wide)
+static float LeadAliasing(const float *buf, size_t size)
+{
+    std::vector<std::complex<double>> x(LEAD_FFT_SIZE);
+    for(size_t i = 0; i < LEAD_FFT_SIZE; i++)
+    {
+        double w = 2.0 * M_PI * i / LEAD_FFT_SIZE;
+        x[i]     = buf[size - LEAD_FFT_SIZE + i]
+               * (0.35875 - 0.48829 * cos(w) + 0.14128 * cos(2.0 * w) - 0.01168 * cos(3.0 * w));
+    }
+    Fft(x.data(), LEAD_FFT_SIZE);
+    double f0       = 440.0 * pow(2.0, (LEAD_NOTE - 69) / 12.0);
+    double bin_hz   = SAMPLE_RATE / LEAD_FFT_SIZE;
+    double harmonic = 0.0, alias = 0.0;
+    //Skips the bins next to DC, where the window leaks any offset
+    for(size_t k = 4; k < LEAD_FFT_SIZE / 2; k++)
+    {
+        double f = k * bin_hz;
+        double h = std::max(1.0, round(f / f0));
+        if(fabs(f - h * f0) <= 4.0 * bin_hz)
+            harmonic += std::norm(x[k]);
+        else
+            alias += std::norm(x[k]);
+    }
+    return (float)(10.0 * log10(alias / harmonic + 1e-30));
+}
+
+static void RenderChordPadRelease(float *out, size_t size)
+{
+    RenderEngine(out, size, kPatchPad, COUNT(kPatchPad), true);
+}
+
+static void RenderChordTail(float *out, size_t size)
+{
+    RenderEngine(out, size, kPatchTail, COUNT(kPatchTail), true);
+}
+
+//Starts on the default patch and switches everything to the pad patch a quarter in
+static void RenderChordPresetSwitch(float *out, size_t size)
+{
+    uint8_t pad[NUM_CONTROLS];
+    memcpy(pad, default_controls, sizeof(pad));
+    for(size_t i = 0; i < COUNT(kPatchPad); i++)
+    {
+        pad[kPatchPad[i].param] = kPatchPad[i].value;
+    }
+    RenderEngine(out, size, kPatchDefault, COUNT(kPatchDefault), false, pad);
+}
+
+//The same switch with a cutoff change in the middle of the crossfade, which has to keep gliding
+static void RenderChordPresetSwitchCc(float *out, size_t size)
+{
+    render_cc_mid_fade = true;
+    RenderChordPresetSwitch(out, size);
+    render_cc_mid_fade = false;
+}
+
+static const Scenario kScenarios[] = {
+    {"osc_sin", "oscillator", RenderOsc_WAVE_SIN},
+    {"osc_tri", "oscillator", RenderOsc_WAVE_TRI},
+    {"osc_saw", "oscillator", RenderOsc_WAVE_SAW},
+    {"osc_ramp", "oscillator", RenderOsc_WAVE_RAMP},
+    {"osc_square", "oscillator", RenderOsc_WAVE_SQUARE},
+    {"osc_polyblep_tri", "oscillator", RenderOsc_WAVE_POLYBLEP_TRI},
+    {"osc_polyblep_saw", "oscillator", RenderOsc_WAVE_POLYBLEP_SAW},
+    {"osc_polyblep_square", "oscillator", RenderOsc_WAVE_POLYBLEP_SQUARE},
+    {"osc_polyblep_square_pwm", "oscillator", RenderOscPwm},
+    {"osc_polyblep_saw_c8", "oscillator", RenderOscHigh},
+    OSC_KERNEL_SCENARIOS(WAVE_SIN, "sin")
+    OSC_KERNEL_SCENARIOS(WAVE_TRI, "tri")
+    OSC_KERNEL_SCENARIOS(WAVE_SAW, "saw")
+    OSC_KERNEL_SCENARIOS(WAVE_RAMP, "ramp")
+    OSC_KERNEL_SCENARIOS(WAVE_SQUARE, "square")
+    OSC_KERNEL_SCENARIOS(WAVE_POLYBLEP_TRI, "polyblep_tri")
+    OSC_KERNEL_SCENARIOS(WAVE_POLYBLEP_SAW, "polyblep_saw")
+    OSC_KERNEL_SCENARIOS(WAVE_POLYBLEP_SQUARE, "polyblep_square")
+    {"ladder_dark", "moogladder", RenderLadderDark},
+    {"ladder_open", "moogladder", RenderLadderOpen},
+    {"ladder_open_exact", "moogladder", RenderLadderOpenExact},
+    {"ladder_open_sweep", "moogladder", RenderLadderOpenSweep},
+    {"ladder_resonant", "moogladder", RenderLadderRes},
+    {"ladder_self_osc", "moogladder", RenderLadderSelfOsc},
+    {"ladder_sweep", "moogladder", RenderLadderSweep},
+    {"ladder_tail", "moogladder", RenderLadderTail},
+    {"ladder_fm", "moogladder", RenderLadderFm},
+    {"ladder_sat_pade", "moogladder", RenderLadderSatPade, "alias_db", AliasingLevel},
+    {"ladder_sat_lut", "moogladder", RenderLadderSatLut, "alias_db", AliasingLevel},
+    {"ladder_sat_adaa", "moogladder", RenderLadderSatAdaa, "alias_db", AliasingLevel},
+    {"ladder2_dark", "zdffilter", RenderLadder2Dark},
+    {"ladder2_resonant", "zdffilter", RenderLadder2Res},
+    {"ladder2_sweep", "zdffilter", RenderLadder2Sweep},
+    {"ladder2_fm", "zdffilter", RenderZdfFm<custom::ZdfFilter::MODE_LADDER2>},
+    {"svf_lowpass", "zdffilter", RenderSvfLowpass},
+    {"svf_bandpass", "zdffilter", RenderSvfBandpass},
+    {"svf_highpass", "zdffilter", RenderSvfHighpass},
+    {"svf_sweep", "zdffilter", RenderSvfSweep},
+    {"svf_fm", "zdffilter", RenderZdfFm<custom::ZdfFilter::MODE_LOWPASS>},
+    {"sine_table", "sine", RenderSine<custom::SINE_TABLE>, "error_db", SineError},
+    {"sine_cubic", "sine", RenderSine<custom::SINE_CUBIC>, "error_db", SineError},
+    {"sine_poly", "sine", RenderSine<custom::SINE_POLY>, "error_db", SineError},
+    {"sine_table_edges", "sine", RenderSineEdges<custom::SINE_TABLE>, "error_db", SineEdgeError},
+    {"sine_cubic_edges", "sine", RenderSineEdges<custom::SINE_CUBIC>, "error_db", SineEdgeError},
+    {"sine_poly_edges", "sine", RenderSineEdges<custom::SINE_POLY>, "error_db", SineEdgeError},
+    {"noise_white", "noise", RenderNoiseWhite},
+    {"noise_pink", "noise", RenderNoisePink},
+    {"adsr_pluck", "adsr", RenderAdsrPluck},
+    {"adsr_pad", "adsr", RenderAdsrPad},
+    {"adsr_gate", "adsr", RenderAdsrGate},
+    {"adsr_slow", "adsr", RenderAdsrSlow},
+    {"engine_chord12_default", "engine", RenderChordDefault},
+    {"engine_chord12_polyblep_res", "engine", RenderChordPolyblepRes},
+    {"engine_chord12_lfo_mod", "engine", RenderChordLfoMod},
+    {"engine_chord12_lfo_clock", "engine", RenderChordLfoClock},
+    {"engine_chord12_fm_bell", "engine", RenderChordFmBell},
+    {"engine_chord12_ring_mod", "engine", RenderChordRingMod},
+    {"engine_chord12_cc_sweep", "engine", RenderChordCcSweep, "ccs_per_patch", ControlsCoalesced},
+    {"engine_note_after_cc", "engine", RenderNoteAfterCcLate, "first_block_error", NoteAfterCcError},
+    {"engine_chord12_ladder2", "engine", RenderChordLadder2},
+    {"engine_chord12_svf_lowpass", "engine", RenderChordSvfLowpass},
+    {"engine_chord12_svf_bandpass", "engine", RenderChordSvfBandpass},
+    {"engine_chord12_saw", "engine", RenderChordSaw},
+    {"engine_chord12_saw_os2", "engine", RenderChordSawOs2},
+    {"engine_chord12_polyblep_saw", "engine", RenderChordPolyblepSaw},
+    {"engine_chord12_default_os2", "engine", RenderChordDefaultOs2},
+    {"engine_lead_saw", "engine", RenderLeadSaw, "alias_db", LeadAliasing},
+    {"engine_lead_saw_os2", "engine", RenderLeadSawOs2, "alias_db", LeadAliasing},
+    {"engine_lead_polyblep_saw", "engine", RenderLeadPolyblepSaw, "alias_db", LeadAliasing},
+    {"engine_lead_polyblep_saw_os2", "engine", RenderLeadPolyblepSawOs2, "alias_db", LeadAliasing},
+    {"engine_lead_square", "engine", RenderLeadSquare, "alias_db", LeadAliasing},
+    {"engine_lead_square_os2", "engine", RenderLeadSquareOs2, "alias_db", LeadAliasing},
+    {"engine_lead_polyblep_square", "engine", RenderLeadPolyblepSquare, "alias_db", LeadAliasing},
+    {"engine_chord12_pad_release", "engine", RenderChordPadRelease},
+    {"engine_chord12_preset_switch", "engine", RenderChordPresetSwitch},
+    {"engine_chord12_preset_switch_cc", "engine", RenderChordPresetSwitchCc},
+    {"engine_chord12_release_tail", "engine", RenderChordTail},
+};
+
+/* Golden file handling */
+
+static bool WriteGolden(const char *dir, const char *name, const float *buf, size_t size)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.f32", dir, name);
+    FILE *f = fopen(path, "wb");
+    if(f == NULL)
+        return false;
+    size_t written = fwrite(buf, sizeof(float), size, f);
+    fclose(f);
+    return written == size;
+}
+
+//Returns the largest absolute difference, or -1 if the reference is missing or has the wrong length
+static float CompareGolden(const char *dir, const char *name, const float *buf, size_t size)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.f32", dir, name);
+    FILE *f = fopen(path, "rb");
+    if(f == NULL)
+        return -1.f;
+    std::vector<float> ref(size + 1);
+    size_t read = fread(ref.data(), sizeof(float), size + 1, f);
+    fclose(f);
+    if(read != size)
+        return -1.f;
+    float max_err = 0.f;
+    for(size_t i = 0; i < size; i++)
+    {
+        float err = fabsf(ref[i] - buf[i]);
+        //NaN in either buffer is always a failure
+        if(!(err <= max_err))
+            max_err = isnan(err) ? INFINITY : err;
+    }
+    return max_err;
+}
+
+//Time stamp counter where there is one, 0 elsewhere
+static uint64_t ReadCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: dualie-bench [--record DIR | --check DIR] [--tolerance T]\n"
+            "                    [--iterations N] [--only SUBSTRING] [--no-ftz]\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *record_dir = NULL;
+    const char *check_dir  = NULL;
+    const char *only       = NULL;
+    float       tolerance  = 1e-4f;
+    int         iterations = 5;
+    bool        ftz        = true;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--record") && i + 1 < argc)
+            record_dir = argv[++i];
+        else if(!strcmp(argv[i], "--check") && i + 1 < argc)
+            check_dir = argv[++i];
+        else if(!strcmp(argv[i], "--tolerance") && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--iterations") && i + 1 < argc)
+            iterations = std::max(1, atoi(argv[++i]));
+        else if(!strcmp(argv[i], "--only") && i + 1 < argc)
+            only = argv[++i];
+        else if(!strcmp(argv[i], "--no-ftz"))
+            ftz = false;
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+
+    memcpy(default_controls, ControlPanel, sizeof(ControlPanel));
+    //--no-ftz shows what the denormal guards in the DSP code alone achieve
+    EnableFlushToZero(ftz);
+
+    std::vector<float> buf(RENDER_SAMPLES);
+    int                failures = 0;
+    bool               first    = true;
+
+    printf("{\"sample_rate\": %d, \"block_size\": %d, \"samples\": %d, \"ftz\": %s, \"results\": [\n",
+           (int)SAMPLE_RATE, BLOCK_SIZE, RENDER_SAMPLES, ftz ? "true" : "false");
+    for(const Scenario &s : kScenarios)
+    {
+        if(only && !strstr(s.name, only))
+            continue;
+
+        //Golden output is taken from the first render, timing from the fastest of all renders
+        double   best_ns     = INFINITY;
+        uint64_t best_cycles = UINT64_MAX;
+        render_voices        = -1;
+        for(int it = 0; it < iterations; it++)
+        {
+            auto     start        = std::chrono::steady_clock::now();
+            uint64_t start_cycles = ReadCycles();
+            s.render(buf.data(), RENDER_SAMPLES);
+            uint64_t end_cycles = ReadCycles();
+            auto     end        = std::chrono::steady_clock::now();
+            best_ns     = std::min(best_ns, (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            best_cycles = std::min(best_cycles, end_cycles - start_cycles);
+            if(it == 0 && record_dir && !WriteGolden(record_dir, s.name, buf.data(), RENDER_SAMPLES))
+            {
+                fprintf(stderr, "dualie-bench: could not write %s/%s.f32\n", record_dir, s.name);
+                failures++;
+            }
+        }
+
+        int voices = render_voices;
+        if(voices >= 0 && voices < render_notes)
+        {
+            fprintf(stderr, "dualie-bench: %s sounds %d of %d notes\n", s.name, voices, render_notes);
+            failures++;
+        }
+
+        const char *status  = "unchecked";
+        float       max_err = 0.f;
+        if(check_dir)
+        {
+            //Re-render once more so the compared buffer is independent of iteration count
+            s.render(buf.data(), RENDER_SAMPLES);
+            max_err = CompareGolden(check_dir, s.name, buf.data(), RENDER_SAMPLES);
+            status  = max_err < 0.f ? "missing" : (max_err <= tolerance ? "pass" : "fail");
+            if(strcmp(status, "pass"))
+                failures++;
+        }
+
+        printf("%s  {\"name\": \"%s\", \"module\": \"%s\", \"ns_per_sample\": %.3f",
+               first ? "" : ",\n", s.name, s.module, best_ns / RENDER_SAMPLES);
+        if(best_cycles)
+            printf(", \"cycles_per_sample\": %.1f", (double)best_cycles / RENDER_SAMPLES);
+        if(voices >= 0)
+            printf(", \"voices\": %d", voices);
+        if(s.metric)
+            printf(", \"%s\": %.1f", s.metric_name, s.metric(buf.data(), RENDER_SAMPLES));
+        printf(", \"golden\": \"%s\", \"max_error\": %g}", status, max_err);
+        first = false;
+    }
+    printf("\n]}\n");
+
+    if(failures)
+        fprintf(stderr, "dualie-bench: %d scenario(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+#include <math.h>
+
+#include "arm_common_tables.h"
+
+float32_t sinTable_f32[FAST_MATH_TABLE_SIZE + 1];
+
+static struct SinTableInit
+{
+    SinTableInit()
+    {
+        for(int i = 0; i <= FAST_MATH_TABLE_SIZE; i++)
+        {
+            sinTable_f32[i] = (float32_t)sin(2.0 * M_PI * i / FAST_MATH_TABLE_SIZE);
+        }
+    }
+} sin_table_init;
@@ -0,0 +1,12 @@
+#pragma once
+#ifndef DUALIE_HOST_ARM_COMMON_TABLES_H
+#define DUALIE_HOST_ARM_COMMON_TABLES_H
+
+#include "arm_math.h"
+
+#define FAST_MATH_TABLE_SIZE 512
+
+//Filled at startup with the same values as the CMSIS table: sin(2*pi*i/512), i = 0..512
+extern float32_t sinTable_f32[FAST_MATH_TABLE_SIZE + 1];
+
+#endif
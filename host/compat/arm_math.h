@@ -0,0 +1,81 @@
+//Portable stand-ins for the CMSIS-DSP functions used by the engine, so it can be
+//built and measured on a host machine. Semantics follow the CMSIS reference C code.
+#pragma once
+#ifndef DUALIE_HOST_ARM_MATH_H
+#define DUALIE_HOST_ARM_MATH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+typedef float float32_t;
+
+static inline void arm_fill_f32(float32_t value, float32_t *pDst, uint32_t blockSize)
+{
+    for(uint32_t i = 0; i < blockSize; i++)
+        pDst[i] = value;
+}
+
+static inline void arm_copy_f32(const float32_t *pSrc, float32_t *pDst, uint32_t blockSize)
+{
+    memmove(pDst, pSrc, blockSize * sizeof(float32_t));
+}
+
+static inline void arm_scale_f32(const float32_t *pSrc, float32_t scale, float32_t *pDst, uint32_t blockSize)
+{
+    for(uint32_t i = 0; i < blockSize; i++)
+        pDst[i] = pSrc[i] * scale;
+}
+
+static inline void arm_offset_f32(const float32_t *pSrc, float32_t offset, float32_t *pDst, uint32_t blockSize)
+{
+    for(uint32_t i = 0; i < blockSize; i++)
+        pDst[i] = pSrc[i] + offset;
+}
+
+static inline void arm_add_f32(const float32_t *pSrcA, const float32_t *pSrcB, float32_t *pDst, uint32_t blockSize)
+{
+    for(uint32_t i = 0; i < blockSize; i++)
+        pDst[i] = pSrcA[i] + pSrcB[i];
+}
+
+static inline void arm_sub_f32(const float32_t *pSrcA, const float32_t *pSrcB, float32_t *pDst, uint32_t blockSize)
+{
+    for(uint32_t i = 0; i < blockSize; i++)
+        pDst[i] = pSrcA[i] - pSrcB[i];
+}
+
+static inline void arm_mult_f32(const float32_t *pSrcA, const float32_t *pSrcB, float32_t *pDst, uint32_t blockSize)
+{
+    for(uint32_t i = 0; i < blockSize; i++)
+        pDst[i] = pSrcA[i] * pSrcB[i];
+}
+
+static inline void arm_abs_f32(const float32_t *pSrc, float32_t *pDst, uint32_t blockSize)
+{
+    for(uint32_t i = 0; i < blockSize; i++)
+        pDst[i] = fabsf(pSrc[i]);
+}
+
+static inline void arm_negate_f32(const float32_t *pSrc, float32_t *pDst, uint32_t blockSize)
+{
+    for(uint32_t i = 0; i < blockSize; i++)
+        pDst[i] = -pSrc[i];
+}
+
+static inline void arm_clip_f32(const float32_t *pSrc, float32_t *pDst, float32_t low, float32_t high, uint32_t numSamples)
+{
+    for(uint32_t i = 0; i < numSamples; i++)
+        pDst[i] = pSrc[i] > high ? high : (pSrc[i] < low ? low : pSrc[i]);
+}
+
+static inline void arm_min_f32(const float32_t *pSrc, uint32_t blockSize, float32_t *pResult, uint32_t *pIndex)
+{
+    uint32_t index = 0;
+    for(uint32_t i = 1; i < blockSize; i++)
+        index = pSrc[i] < pSrc[index] ? i : index;
+    *pResult = pSrc[index];
+    *pIndex  = index;
+}
+
+#endif
@@ -0,0 +1,204 @@
+/* Checks libdualie.so the way an embedding host uses it, through the C interface only.
+   Two instances with different patches and phrases are rendered together in one process,
+   each in calls of varying length that do not line up with the block size. Every instance is
+   rendered again on its own in whole blocks, and both renders must give the same bits. A
+   chord sent at one frame must get a voice per note, and a burst of note offs larger than the
+   engine's note queue must still release every voice. The render time is reported as JSON on
+   stdout. */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/dualie.h"
+
+#define SAMPLE_RATE 48000
+#define SECONDS 2
+#define FRAMES (SAMPLE_RATE * SECONDS)
+#define MAX_EVENTS 64
+
+static double NowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* A chord and a cutoff sweep, shifted by the instance index */
+static uint32_t MakeEvents(int index, DualieEvent *events)
+{
+    uint32_t n = 0;
+    int      i;
+    for(i = 0; i < 4; i++)
+    {
+        DualieEvent on  = {(uint32_t)(i * 997 + index * 131), DUALIE_EVENT_NOTE_ON, (uint8_t)(48 + index * 5 + i * 4), 100, 0};
+        DualieEvent off = {FRAMES / 2 + i * 577, DUALIE_EVENT_NOTE_OFF, on.data1, 0, 0};
+        events[n++]     = on;
+        events[n++]     = off;
+    }
+    for(i = 0; i < 32; i++)
+    {
+        DualieEvent cc = {(uint32_t)(i * FRAMES / 40 + 5), DUALIE_EVENT_CONTROL, 14, (uint8_t)(40 + (i * 3 + index * 20) % 80), 0};
+        events[n++]    = cc;
+    }
+    return n;
+}
+
+static DualieInstance *Create(int index)
+{
+    DualieInstance *inst = dualie_create(SAMPLE_RATE, MAX_EVENTS);
+    DualieEvent     events[MAX_EVENTS];
+    uint8_t         controls[DUALIE_NUM_CONTROLS];
+    int             c;
+    if(inst == NULL)
+    {
+        return NULL;
+    }
+    for(c = 0; c < DUALIE_NUM_CONTROLS; c++)
+    {
+        controls[c] = (uint8_t)dualie_get_control(inst, c);
+    }
+    controls[0]  = index ? 6 * 26 : 2 * 26; /* CTRL_OSC1WAVEFORM */
+    controls[15] = index ? 90 : 30;         /* CTRL_FILTERRESONANCE */
+    dualie_load_controls(inst, controls, 0);
+    dualie_push_events(inst, events, MakeEvents(index, events));
+    return inst;
+}
+
+/* Sends a 12 note chord at frame 0. Returns the voices sounding after the first block */
+static uint32_t ChordAtOneFrame(void)
+{
+    float           out[DUALIE_BLOCK_SIZE];
+    DualieInstance *inst = dualie_create(SAMPLE_RATE, 12);
+    DualieEvent     events[12];
+    uint32_t        voices;
+    int             i;
+    if(inst == NULL)
+    {
+        return 0;
+    }
+    for(i = 0; i < 12; i++)
+    {
+        DualieEvent on = {0, DUALIE_EVENT_NOTE_ON, (uint8_t)(48 + i * 3), 100, 0};
+        events[i]      = on;
+    }
+    dualie_push_events(inst, events, 12);
+    dualie_render(inst, out, NULL, DUALIE_BLOCK_SIZE);
+    voices = dualie_active_voices(inst);
+    dualie_destroy(inst);
+    return voices;
+}
+
+/* Holds 12 notes, then sends a control and 72 note offs at one frame. Returns the voices left */
+static uint32_t ReleaseBurst(void)
+{
+    static float    out[SAMPLE_RATE];
+    DualieInstance *inst = dualie_create(SAMPLE_RATE, 128);
+    DualieEvent     events[73];
+    uint32_t        n = 0, voices;
+    int             i;
+    if(inst == NULL)
+    {
+        return ~0u;
+    }
+    for(i = 0; i < 12; i++)
+    {
+        DualieEvent on = {0, DUALIE_EVENT_NOTE_ON, (uint8_t)(60 + i), 100, 0};
+        events[n++]    = on;
+    }
+    dualie_push_events(inst, events, n);
+    dualie_render(inst, out, NULL, SAMPLE_RATE / 10);
+
+    n = 0;
+    {
+        DualieEvent cc = {0, DUALIE_EVENT_CONTROL, 14, 30, 0};
+        events[n++]    = cc;
+    }
+    for(i = 0; i < 72; i++)
+    {
+        DualieEvent off = {0, DUALIE_EVENT_NOTE_OFF, (uint8_t)i, 0, 0};
+        events[n++]     = off;
+    }
+    dualie_push_events(inst, events, n);
+    dualie_render(inst, out, NULL, SAMPLE_RATE);
+    voices = dualie_active_voices(inst);
+    dualie_destroy(inst);
+    return voices;
+}
+
+int main(void)
+{
+    static float    together[2][FRAMES], right[FRAMES], alone[FRAMES];
+    DualieInstance *inst[2];
+    uint32_t        pos = 0, call = 0, chord, hanging;
+    int             i, failures = 0;
+    double          start, seconds;
+
+    if(dualie_api_version() != DUALIE_API_VERSION)
+    {
+        fprintf(stderr, "dualie-embed: library version %u, expected %d\n", dualie_api_version(), DUALIE_API_VERSION);
+        return 1;
+    }
+    inst[0] = Create(0);
+    inst[1] = Create(1);
+    if(inst[0] == NULL || inst[1] == NULL)
+    {
+        fprintf(stderr, "dualie-embed: could not create an instance\n");
+        return 1;
+    }
+
+    start = NowSeconds();
+    while(pos < FRAMES)
+    {
+        /* 1 to 100 frames per call, the way a host with an odd buffer size would call it */
+        uint32_t n = 1 + (call++ * 37) % 100;
+        n          = n < FRAMES - pos ? n : FRAMES - pos;
+        dualie_render(inst[0], together[0] + pos, right + pos, n);
+        dualie_render(inst[1], together[1] + pos, NULL, n);
+        pos += n;
+    }
+    seconds = NowSeconds() - start;
+    failures += memcmp(together[0], right, sizeof(right)) != 0;
+    dualie_destroy(inst[0]);
+    dualie_destroy(inst[1]);
+
+    printf("{\"frames\": %d, \"instances\": 2, \"realtime\": %.1f, \"results\": [\n", FRAMES, 2 * SECONDS / seconds);
+    for(i = 0; i < 2; i++)
+    {
+        DualieInstance *solo = Create(i);
+        float           peak = 0.f;
+        uint32_t        f;
+        int             identical;
+        dualie_render(solo, alone, NULL, FRAMES / DUALIE_BLOCK_SIZE * DUALIE_BLOCK_SIZE);
+        dualie_render(solo, alone + FRAMES / DUALIE_BLOCK_SIZE * DUALIE_BLOCK_SIZE, NULL, FRAMES % DUALIE_BLOCK_SIZE);
+        dualie_destroy(solo);
+        identical = !memcmp(alone, together[i], sizeof(alone));
+        for(f = 0; f < FRAMES; f++)
+        {
+            peak = alone[f] > peak ? alone[f] : (-alone[f] > peak ? -alone[f] : peak);
+        }
+        failures += !identical || peak == 0.f;
+        printf("%s  {\"instance\": %d, \"peak\": %.3f, \"identical\": %s}", i ? ",\n" : "", i, peak,
+               identical ? "true" : "false");
+    }
+    chord   = ChordAtOneFrame();
+    hanging = ReleaseBurst();
+    printf("\n], \"chord_voices\": %u, \"hanging_after_release_burst\": %u}\n", chord, hanging);
+
+    if(chord != 12)
+    {
+        fprintf(stderr, "dualie-embed: a 12 note chord at one frame sounds %u voices\n", chord);
+    }
+    if(hanging)
+    {
+        fprintf(stderr, "dualie-embed: %u voices still sound after releasing every note\n", hanging);
+    }
+    if(failures)
+    {
+        fprintf(stderr, "dualie-embed: instances are not independent of each other or of the call size\n");
+    }
+    return failures || chord != 12 || hanging ? 1 : 0;
+}
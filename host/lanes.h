@@ -0,0 +1,466 @@
+//Lane interleaved copies of the voice modules for the batched host engine. Not used by the firmware.
+//Each class holds the state of lanes independent instances side by side, and every signal is
+//laid out as [sample][lane], so one sample of all instances is a contiguous run of floats.
+//The per lane loops have no branches and no calls, so they compile to vector code.
+//The arithmetic follows the scalar modules operation by operation. host/batch.cpp checks
+//every lane against the scalar engine, so keep both sides in step when changing either.
+#pragma once
+#ifndef DUALIE_HOST_LANES_H
+#define DUALIE_HOST_LANES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <Utility/dsp.h>
+
+#include "../include/oscillator.h"
+#include "../include/adsr.h"
+#include "../include/noise.h"
+#include "../include/sine.h"
+#include "../include/denormal.h"
+
+//Accuracy of WAVE_SIN, must match the one src/oscillator.cpp is built with
+#ifndef DUALIE_OSC_SINE
+#define DUALIE_OSC_SINE SINE_POLY
+#endif
+
+namespace custom
+{
+//fclamp without the libm calls, the same result for everything but NaN
+static inline float LaneClamp(float x, float lo, float hi)
+{
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+/** Oscillator for lanes instances. The waveform, sync role and phase modulation are template
+    arguments shared by all lanes, frequency, pulse width and modulation are per lane.
+*/
+template <size_t lanes>
+class OscillatorLanes
+{
+  public:
+    void Init(float sample_rate)
+    {
+        sr_recip_ = 1.0f / sample_rate;
+        for(size_t l = 0; l < lanes; l++)
+        {
+            phase_[l] = 0.0f;
+            last_[l]  = 0.0f;
+            SetFreq(l, 100.0f);
+        }
+    }
+
+    inline void SetFreq(size_t lane, float f) { phase_inc_[lane] = (TWOPI_F * f) * sr_recip_; }
+
+    /** Oscillator::ProcessBlock for every lane. pw and fm hold a value for every sample, pm is
+        only read when phase_mod is set. sync is written by a master and read by a slave.
+    */
+    template <uint8_t waveform, uint8_t sync, bool phase_mod>
+    void ProcessBlock(float (*buf)[lanes], const float (*pw)[lanes], const float (*fm)[lanes],
+                      const float (*pm)[lanes], float (*sync_vector)[lanes], size_t size)
+    {
+        //Local copies, so the state cannot alias the buffers and stays in vector registers
+        const float two_pi_recip = 1.0f / TWOPI_F;
+        float       phase[lanes], inc[lanes], last[lanes];
+        for(size_t l = 0; l < lanes; l++)
+        {
+            phase[l] = phase_[l];
+            inc[l]   = phase_inc_[l];
+            last[l]  = last_[l];
+        }
+        for(size_t i = 0; i < size; i++)
+        {
+            for(size_t l = 0; l < lanes; l++)
+            {
+                float p = phase[l];
+                if(sync == Oscillator::SYNC_SLAVE)
+                {
+                    p *= sync_vector[i][l] == 0.0f;
+                }
+                p += inc[l] + fm[i][l];
+                bool wrapped = p > TWOPI_F;
+                p            = wrapped ? p - TWOPI_F : p;
+                if(sync == Oscillator::SYNC_MASTER)
+                {
+                    sync_vector[i][l] = wrapped;
+                }
+                phase[l] = p;
+
+                float t = p * two_pi_recip;
+                if(phase_mod)
+                {
+                    t = SineWrap(t + pm[i][l]);
+                    p = t * TWOPI_F;
+                }
+                buf[i][l] = Shape<waveform>(p, t, LaneClamp(pw[i][l], 0.f, 1.f), inc[l], last[l]);
+            }
+        }
+        for(size_t l = 0; l < lanes; l++)
+        {
+            phase_[l] = phase[l];
+            last_[l]  = last[l];
+        }
+    }
+
+  private:
+    //x mod 1 for x from 0 to just above 2, exact like fmodf
+    static inline float Wrap(float x)
+    {
+        x = x >= 1.0f ? x - 1.0f : x;
+        return x >= 1.0f ? x - 1.0f : x;
+    }
+
+    //Both ends of the polyBLEP are evaluated and the one that applies is selected
+    static inline float Polyblep(float phase_inc, float t)
+    {
+        float dt   = phase_inc * (1.0f / TWOPI_F);
+        float a    = t / dt;
+        float b    = (t - 1.0f) / dt;
+        float rise = a + a - a * a - 1.0f;
+        float fall = b * b + b + b + 1.0f;
+        return t < dt ? rise : (t > 1.0f - dt ? fall : 0.0f);
+    }
+
+    template <uint8_t waveform>
+    static inline float Shape(float phase, float t, float p, float phase_inc, float &last)
+    {
+        const float double_pi_recip = 2.0f * (1.0f / TWOPI_F);
+        float       out;
+        switch(waveform)
+        {
+            case Oscillator::WAVE_SIN: out = Sine<DUALIE_OSC_SINE>(t); break;
+            case Oscillator::WAVE_TRI: out = (fabsf(phase * double_pi_recip - 1.0f) - 0.5f) * 2.0f; break;
+            case Oscillator::WAVE_SAW: out = -(phase * double_pi_recip - 1.0f); break;
+            case Oscillator::WAVE_RAMP: out = phase * double_pi_recip - 1.0f; break;
+            case Oscillator::WAVE_SQUARE: out = phase < p * TWOPI_F ? 1.0f : -1.0f; break;
+            case Oscillator::WAVE_POLYBLEP_TRI:
+                out = phase < PI_F ? 1.0f : -1.0f;
+                out += Polyblep(phase_inc, t);
+                out -= Polyblep(phase_inc, Wrap(t + 0.5f));
+                out  = phase_inc * out + (1.0f - phase_inc) * last;
+                last = out;
+                break;
+            case Oscillator::WAVE_POLYBLEP_SAW:
+                out = (2.0f * t) - 1.0f;
+                out -= Polyblep(phase_inc, t);
+                out *= -1.0f;
+                break;
+            case Oscillator::WAVE_POLYBLEP_SQUARE:
+                out = phase < p * TWOPI_F ? 1.0f : -1.0f;
+                out += Polyblep(phase_inc, t);
+                out -= Polyblep(phase_inc, Wrap(t + (1.0f - p)));
+                out *= 0.707f;
+                break;
+            default: out = 0.0f; break;
+        }
+        return out;
+    }
+
+    float sr_recip_;
+    float phase_[lanes], phase_inc_[lanes], last_[lanes];
+};
+
+/** MoogLadder for lanes instances, with the Padé saturator and the 2x interpolation the voices
+    use at 1x. The open ladder stand-in is not modelled, every lane runs the full ladder.
+*/
+template <size_t lanes>
+class MoogLadderLanes
+{
+  public:
+    void Init(float sample_rate)
+    {
+        //The same expressions as MoogLadder::compute_coeffs with oversample_ = 2
+        max_freq_ = sample_rate * 0.2125f * kInterpolation;
+        wc_scale_ = (float)(2.0f * PI_F / ((float)kInterpolation * sample_rate));
+        for(size_t l = 0; l < lanes; l++)
+        {
+            for(int s = 0; s < 4; s++)
+            {
+                z0_[s][l] = 0.f;
+                z1_[s][l] = 0.f;
+            }
+            oldinput_[l] = 0.f;
+            SetRes(l, 0.2f);
+        }
+    }
+
+    inline void SetRes(size_t lane, float res) { K_[lane] = 4.0f * daisysp::fclamp(res, 0.0f, kMaxResonance); }
+
+    /** Filters buf in place, freq holds the cutoff of every lane for every sample.
+    */
+    void ProcessBlock(float (*buf)[lanes], const float (*freq)[lanes], size_t size)
+    {
+        //Local copies, so the state cannot alias the buffers and stays in vector registers
+        float z0[4][lanes], z1[4][lanes], oldinput[lanes], k[lanes], alpha[lanes], qadjust[lanes];
+        for(size_t l = 0; l < lanes; l++)
+        {
+            for(int s = 0; s < 4; s++)
+            {
+                z0[s][l] = z0_[s][l];
+                z1[s][l] = z1_[s][l];
+            }
+            oldinput[l] = oldinput_[l];
+            k[l]        = K_[l];
+        }
+
+        //A block without cutoff modulation in any lane needs its coefficients only once
+        bool constant = true;
+        for(size_t i = 1; i < size; i++)
+        {
+            for(size_t l = 0; l < lanes; l++)
+            {
+                constant &= freq[i][l] == freq[0][l];
+            }
+        }
+        Coeffs(freq[0], alpha, qadjust);
+
+        for(size_t i = 0; i < size; i++)
+        {
+            if(!constant)
+            {
+                Coeffs(freq[i], alpha, qadjust);
+            }
+            for(size_t l = 0; l < lanes; l++)
+            {
+                float input  = buf[i][l];
+                float total  = 0.0f;
+                float interp = 0.0f;
+                for(int os = 0; os < kInterpolation; os++)
+                {
+                    float u = (interp * oldinput[l] + (1.0f - interp) * input)
+                              - (z1[3][l] - kPassbandGain * input) * k[l] * qadjust[l];
+                    u = SatPade(u);
+                    for(int s = 0; s < 4; s++)
+                    {
+                        //MoogLadder::LPF
+                        float ft = u * (1.0f / 1.3f) + (0.3f / 1.3f) * z0[s][l] - z1[s][l];
+                        ft       = ft * alpha[l] + z1[s][l];
+                        z1[s][l] = ft;
+                        z0[s][l] = u;
+                        u        = ft;
+                    }
+                    total += u * (1.0f / kInterpolation);
+                    interp += 1.0f / kInterpolation;
+                }
+                oldinput[l] = input;
+                buf[i][l]   = total;
+            }
+        }
+
+        for(size_t l = 0; l < lanes; l++)
+        {
+            for(int s = 0; s < 4; s++)
+            {
+                z0_[s][l] = FlushDenormal(z0[s][l]);
+                z1_[s][l] = FlushDenormal(z1[s][l]);
+            }
+            oldinput_[l] = FlushDenormal(oldinput[l]);
+        }
+    }
+
+  private:
+    static const int       kInterpolation = 2;
+    static constexpr float kMaxResonance  = 1.8f;
+    static constexpr float kPassbandGain  = 0.5f;
+
+    static inline float SatPade(float x)
+    {
+        x        = LaneClamp(x, -3.0f, 3.0f);
+        float x2 = x * x;
+        return x * (27.0f + x2) / (27.0f + 9.0f * x2);
+    }
+
+    inline void Coeffs(const float *freq, float *alpha, float *qadjust) const
+    {
+        for(size_t l = 0; l < lanes; l++)
+        {
+            float wc   = LaneClamp(freq[l], 5.0f, max_freq_) * wc_scale_;
+            float wc2  = wc * wc;
+            alpha[l]   = 0.9892f * wc - 0.4324f * wc2 + 0.1381f * wc * wc2 - 0.0202f * wc2 * wc2;
+            qadjust[l] = 1.006f + 0.0536f * wc - 0.095f * wc2 - 0.05f * wc2 * wc2;
+        }
+    }
+
+    float max_freq_, wc_scale_;
+    float z0_[4][lanes], z1_[4][lanes], oldinput_[lanes], K_[lanes];
+};
+
+/** Adsr for lanes instances, every lane with its own coefficients and gate. The segment of each
+    lane is a 32 bit integer next to its level, so both fit the same vector width.
+*/
+template <size_t lanes>
+class AdsrLanes
+{
+  public:
+    void Init()
+    {
+        for(size_t l = 0; l < lanes; l++)
+        {
+            x_[l]    = 0.0f;
+            mode_[l] = ADSR_SEG_IDLE;
+            gate_[l] = 0;
+        }
+    }
+
+    inline void SetCoeffs(size_t lane, const AdsrCoeffs &coeffs)
+    {
+        attack_d0_[lane]     = coeffs.attackD0;
+        attack_target_[lane] = coeffs.attackTarget;
+        decay_d0_[lane]      = coeffs.decayD0;
+        release_d0_[lane]    = coeffs.releaseD0;
+        sus_level_[lane]     = coeffs.susLevel;
+    }
+
+    inline bool IsRunning(size_t lane) const { return mode_[lane] != ADSR_SEG_IDLE; }
+
+    /** Adsr::ProcessBlock for every lane, gate holds each lane's gate for the whole block.
+    */
+    void ProcessBlock(float (*buf)[lanes], const int32_t *gate, size_t size)
+    {
+        //The gate is constant over a block, so only its first sample can see an edge
+        for(size_t l = 0; l < lanes; l++)
+        {
+            int32_t mode = mode_[l];
+            mode         = gate[l] && !gate_[l] ? ADSR_SEG_ATTACK : mode;
+            mode         = !gate[l] && gate_[l] ? ADSR_SEG_RELEASE : mode;
+            mode_[l]     = mode;
+            gate_[l]     = gate[l];
+        }
+
+        for(size_t i = 0; i < size; i++)
+        {
+            for(size_t l = 0; l < lanes; l++)
+            {
+                int32_t mode   = mode_[l];
+                float   x      = x_[l];
+                bool    attack = mode == ADSR_SEG_ATTACK;
+                bool    decay  = mode == ADSR_SEG_DECAY;
+                float   d0     = decay ? decay_d0_[l] : (mode == ADSR_SEG_RELEASE ? release_d0_[l] : attack_d0_[l]);
+                float   target = attack ? attack_target_[l] : (decay ? sus_level_[l] : -0.01f);
+                float   next   = x + d0 * (target - x);
+
+                next = decay && fabsf(next - sus_level_[l]) < 1e-5f ? sus_level_[l] : next;
+                //Attack tops out at 1 and decays, decay and release bottom out at 0 and go idle
+                bool peaked   = attack && next > 1.0f;
+                bool finished = !attack && next < 0.0f;
+                next          = peaked ? 1.0f : (finished ? 0.0f : next);
+                next          = mode == ADSR_SEG_IDLE ? x : next;
+                mode          = peaked ? ADSR_SEG_DECAY : mode;
+                mode          = finished && mode != ADSR_SEG_IDLE ? ADSR_SEG_IDLE : mode;
+
+                buf[i][l] = mode_[l] == ADSR_SEG_IDLE ? 0.0f : next;
+                x_[l]     = next;
+                mode_[l]  = mode;
+            }
+        }
+    }
+
+  private:
+    float   attack_d0_[lanes], attack_target_[lanes], decay_d0_[lanes], release_d0_[lanes], sus_level_[lanes];
+    float   x_[lanes];
+    int32_t mode_[lanes], gate_[lanes];
+};
+
+/** Noise for lanes instances, each lane runs the NOISE_LANES generators of one custom::Noise.
+    The mode is shared by all lanes.
+*/
+template <size_t lanes>
+class NoiseLanes
+{
+  public:
+    /** Every lane gets the generators custom::Noise::Init(seed) would.
+    */
+    void Init(uint32_t seed)
+    {
+        for(int g = 0; g < NOISE_LANES; g++)
+        {
+            uint32_t s = Hash(seed * NOISE_LANES + g + 1);
+            for(size_t l = 0; l < lanes; l++)
+            {
+                state_[g][l] = s ? s : 0x9e3779b9;
+            }
+        }
+        for(size_t l = 0; l < lanes; l++)
+        {
+            for(int r = 0; r < NOISE_PINK_ROWS; r++)
+            {
+                rows_[r][l] = 0.0f;
+            }
+            pink_sum_[l]  = 0.0f;
+            pink_last_[l] = 0.0f;
+        }
+        pink_counter_ = 0;
+    }
+
+    /** Writes size samples of every lane scaled by its amp, size must be a multiple of NOISE_LANES.
+    */
+    void ProcessBlock(float (*buf)[lanes], const float *amp, bool pink, size_t size)
+    {
+        const float kIntToFloat = 4.6566129e-010f;
+        for(size_t i = 0; i < size; i += NOISE_LANES)
+        {
+            for(int g = 0; g < NOISE_LANES; g++)
+            {
+                for(size_t l = 0; l < lanes; l++)
+                {
+                    uint32_t x = state_[g][l];
+                    x ^= x << 13;
+                    x ^= x >> 17;
+                    x ^= x << 5;
+                    state_[g][l]  = x;
+                    buf[i + g][l] = (int32_t)x * (amp[l] * kIntToFloat);
+                }
+            }
+        }
+        if(!pink)
+        {
+            return;
+        }
+
+        //Every lane refreshes the same row, so only the sums run per lane
+        const float kPinkScale = 1.0f / sqrtf(NOISE_PINK_ROWS + 1);
+        for(size_t i = 0; i < size; i++)
+        {
+            pink_counter_ = (pink_counter_ + 1) & ((1u << NOISE_PINK_ROWS) - 1);
+            int row       = pink_counter_ ? __builtin_ctz(pink_counter_) : -1;
+            for(size_t l = 0; l < lanes; l++)
+            {
+                if(row >= 0)
+                {
+                    pink_sum_[l] += pink_last_[l] - rows_[row][l];
+                    rows_[row][l] = pink_last_[l];
+                }
+                else
+                {
+                    pink_sum_[l] = 0.0f;
+                    for(int r = 0; r < NOISE_PINK_ROWS; r++)
+                    {
+                        pink_sum_[l] += rows_[r][l];
+                    }
+                }
+                pink_last_[l] = buf[i][l];
+                buf[i][l]     = (pink_sum_[l] + buf[i][l]) * kPinkScale;
+            }
+        }
+    }
+
+  private:
+    //lowbias32, as in src/noise.cpp
+    static inline uint32_t Hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352d;
+        x ^= x >> 15;
+        x *= 0x846ca68b;
+        x ^= x >> 16;
+        return x;
+    }
+
+    uint32_t state_[NOISE_LANES][lanes];
+    float    rows_[NOISE_PINK_ROWS][lanes];
+    float    pink_sum_[lanes], pink_last_[lanes];
+    uint32_t pink_counter_;
+};
+} // namespace custom
+
+#endif
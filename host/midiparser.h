@@ -0,0 +1,137 @@
+//Incremental MIDI byte stream parser for the host tools. Not used by the firmware, which
+//gets its messages from the libDaisy MIDI handler.
+#pragma once
+#ifndef DUALIE_HOST_MIDIPARSER_H
+#define DUALIE_HOST_MIDIPARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** One complete channel or system message. data1 and data2 are 0 when the message has fewer
+    data bytes.
+*/
+struct MidiMessage
+{
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+/** Assembles messages from raw bytes as they arrive, one byte at a time, so a message may be
+    split across any number of reads.
+    - Running status: data bytes after a complete channel message repeat its status
+    - Real time bytes (0xF8-0xFF) are returned immediately, even in the middle of a message
+    - System exclusive data is skipped up to the next status byte
+    - Stray data bytes without a status are dropped and counted
+*/
+class MidiParser
+{
+  public:
+    MidiParser() { Reset(); }
+
+    void Reset()
+    {
+        running_ = 0;
+        status_  = 0;
+        count_   = 0;
+        needed_  = 0;
+        sysex_   = false;
+        dropped_ = 0;
+    }
+
+    /** Feeds one byte, returns true when it completes a message, which is then in msg.
+    */
+    bool Parse(uint8_t byte, MidiMessage &msg)
+    {
+        if(byte >= 0xF8)
+        {
+            msg.status = byte;
+            msg.data1 = msg.data2 = 0;
+            return true;
+        }
+        if(byte & 0x80)
+        {
+            sysex_ = byte == 0xF0;
+            count_ = 0;
+            if(byte >= 0xF0)
+            {
+                //System common messages cancel running status
+                running_ = 0;
+                needed_  = SystemCommonLength(byte);
+                status_  = byte;
+                if(needed_ == 0 && !sysex_ && byte != 0xF7)
+                {
+                    msg.status = byte;
+                    msg.data1 = msg.data2 = 0;
+                    return true;
+                }
+                return false;
+            }
+            running_ = status_ = byte;
+            needed_  = ChannelLength(byte);
+            return false;
+        }
+
+        //Data byte
+        if(sysex_)
+        {
+            return false;
+        }
+        if(needed_ == 0 || count_ >= needed_)
+        {
+            if(running_ == 0)
+            {
+                dropped_++;
+                return false;
+            }
+            status_ = running_;
+            needed_ = ChannelLength(running_);
+            count_  = 0;
+        }
+        data_[count_++] = byte;
+        if(count_ < needed_)
+        {
+            return false;
+        }
+        msg.status = status_;
+        msg.data1  = data_[0];
+        msg.data2  = needed_ > 1 ? data_[1] : 0;
+        if(running_ == 0)
+        {
+            needed_ = 0;
+        }
+        return true;
+    }
+
+    /** Data bytes dropped because no status byte preceded them.
+    */
+    uint32_t GetDropped() const { return dropped_; }
+
+  private:
+    static uint8_t ChannelLength(uint8_t status)
+    {
+        uint8_t type = status & 0xF0;
+        return type == 0xC0 || type == 0xD0 ? 1 : 2;
+    }
+
+    static uint8_t SystemCommonLength(uint8_t status)
+    {
+        switch(status)
+        {
+            case 0xF1:
+            case 0xF3: return 1;
+            case 0xF2: return 2;
+            default: return 0;
+        }
+    }
+
+    uint8_t  running_;
+    uint8_t  status_;
+    uint8_t  needed_;
+    uint8_t  count_;
+    uint8_t  data_[2];
+    bool     sysex_;
+    uint32_t dropped_;
+};
+
+#endif
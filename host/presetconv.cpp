@@ -0,0 +1,195 @@
+//Converts between the editable preset sheet (etc/presets.csv) and the binary bank
+//that is flashed to QSPI.
+//
+//  dualie-presetconv csv2bin presets.csv presets.bin
+//  dualie-presetconv bin2csv presets.bin presets.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <vector>
+
+#include "../include/main.h"
+#include "../include/preset.h"
+
+static std::string Trim(const std::string &s)
+{
+    size_t start = s.find_first_not_of(" \t\r\n");
+    size_t end   = s.find_last_not_of(" \t\r\n");
+    return start == std::string::npos ? "" : s.substr(start, end - start + 1);
+}
+
+static std::vector<std::string> SplitCsv(const std::string &line)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for(;;)
+    {
+        size_t comma = line.find(',', start);
+        fields.push_back(Trim(line.substr(start, comma - start)));
+        if(comma == std::string::npos)
+            return fields;
+        start = comma + 1;
+    }
+}
+
+static int CsvToBin(const char *in_path, const char *out_path)
+{
+    FILE *in = fopen(in_path, "r");
+    if(in == NULL)
+    {
+        perror(in_path);
+        return 1;
+    }
+
+    //Columns are matched by name, so the sheet may reorder them
+    int                       column_param[NUM_CONTROLS + 1];
+    size_t                    num_columns = 0;
+    std::vector<PresetRecord> records;
+    char                      line[1024];
+    int                       line_number = 0;
+
+    while(fgets(line, sizeof(line), in))
+    {
+        line_number++;
+        std::vector<std::string> fields = SplitCsv(line);
+        if(fields.size() == 1 && fields[0].empty())
+            continue;
+
+        if(num_columns == 0)
+        {
+            if(fields[0] != "NAME" || fields.size() != NUM_CONTROLS + 1)
+            {
+                fprintf(stderr, "%s:%d: expected a NAME header followed by all %d controls\n", in_path, line_number, NUM_CONTROLS);
+                fclose(in);
+                return 1;
+            }
+            for(size_t c = 1; c < fields.size(); c++)
+            {
+                column_param[c] = -1;
+                for(int p = 0; p < NUM_CONTROLS; p++)
+                {
+                    if(fields[c] == PresetControlName(p))
+                        column_param[c] = p;
+                }
+                for(size_t prev = 1; prev < c && column_param[c] >= 0; prev++)
+                {
+                    if(column_param[prev] == column_param[c])
+                        column_param[c] = -1;
+                }
+                if(column_param[c] < 0)
+                {
+                    fprintf(stderr, "%s:%d: unknown or repeated control %s\n", in_path, line_number, fields[c].c_str());
+                    fclose(in);
+                    return 1;
+                }
+            }
+            num_columns = fields.size();
+            continue;
+        }
+
+        if(fields.size() != num_columns)
+        {
+            fprintf(stderr, "%s:%d: expected %zu fields, got %zu\n", in_path, line_number, num_columns, fields.size());
+            fclose(in);
+            return 1;
+        }
+        if(records.size() == PRESET_MAX_COUNT)
+        {
+            fprintf(stderr, "%s:%d: more than %d presets\n", in_path, line_number, PRESET_MAX_COUNT);
+            fclose(in);
+            return 1;
+        }
+
+        PresetRecord record;
+        memset(&record, 0, sizeof(record));
+        memcpy(record.name, fields[0].c_str(), std::min(fields[0].size(), (size_t)PRESET_NAME_LENGTH));
+        for(size_t c = 1; c < num_columns; c++)
+        {
+            char *end;
+            long  value = strtol(fields[c].c_str(), &end, 10);
+            if(*end != '\0' || fields[c].empty() || value < 0 || value > 127)
+            {
+                fprintf(stderr, "%s:%d: %s must be 0-127\n", in_path, line_number, PresetControlName(column_param[c]));
+                fclose(in);
+                return 1;
+            }
+            record.controls[column_param[c]] = (uint8_t)value;
+        }
+        records.push_back(record);
+    }
+    fclose(in);
+
+    if(records.empty())
+    {
+        fprintf(stderr, "%s: no presets\n", in_path);
+        return 1;
+    }
+
+    std::vector<uint8_t> bank(PresetBankSize(records.size()));
+    memcpy(bank.data() + sizeof(PresetBankHeader), records.data(), records.size() * sizeof(PresetRecord));
+    PresetBankFinalize(bank.data(), records.size());
+
+    FILE *out = fopen(out_path, "wb");
+    if(out == NULL || fwrite(bank.data(), 1, bank.size(), out) != bank.size())
+    {
+        perror(out_path);
+        return 1;
+    }
+    fclose(out);
+    return 0;
+}
+
+static int BinToCsv(const char *in_path, const char *out_path)
+{
+    FILE *in = fopen(in_path, "rb");
+    if(in == NULL)
+    {
+        perror(in_path);
+        return 1;
+    }
+    //The largest bank any header may describe
+    std::vector<uint8_t> bank(sizeof(PresetBankHeader) + PRESET_MAX_COUNT * PRESET_MAX_RECORD_SIZE);
+    size_t               size = fread(bank.data(), 1, bank.size(), in);
+    fclose(in);
+    if(!PresetBankValid(bank.data(), size))
+    {
+        fprintf(stderr, "%s: not a valid preset bank\n", in_path);
+        return 1;
+    }
+
+    FILE *out = fopen(out_path, "w");
+    if(out == NULL)
+    {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(out, "NAME");
+    for(int p = 0; p < NUM_CONTROLS; p++)
+        fprintf(out, ", %s", PresetControlName(p));
+    for(uint16_t i = 0; i < PresetBankCount(bank.data()); i++)
+    {
+        uint8_t controls[NUM_CONTROLS] = {0};
+        char    name[PRESET_NAME_LENGTH + 1];
+        PresetBankRead(bank.data(), i, controls, name);
+        fprintf(out, "\n%s", name);
+        for(int p = 0; p < NUM_CONTROLS; p++)
+            fprintf(out, ", %d", controls[p]);
+    }
+    fclose(out);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc == 4 && !strcmp(argv[1], "csv2bin"))
+        return CsvToBin(argv[2], argv[3]);
+    if(argc == 4 && !strcmp(argv[1], "bin2csv"))
+        return BinToCsv(argv[2], argv[3]);
+
+    fprintf(stderr, "usage: dualie-presetconv csv2bin IN.csv OUT.bin\n"
+                    "       dualie-presetconv bin2csv IN.bin OUT.csv\n");
+    return 2;
+}
@@ -0,0 +1,208 @@
+//Offline renderer for large polyphony. A dense pad stack is rendered through one VoiceManager
+//with its voices spread over a work stealing thread pool, for 1 up to --threads threads.
+//Every voice renders into its own cache line aligned block and the blocks are summed in voice
+//order, so each thread count must give the same bits as the single threaded
+//VoiceManager::ProcessBlock. Speedup and scaling efficiency are reported as JSON on stdout.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <arm_math.h>
+
+#include "../include/main.h"
+#include "../include/engine.h"
+#include "../include/patch.h"
+#include "../include/lfo.h"
+#include "../include/voicemanager.h"
+#include "../include/denormal.h"
+#include "threadpool.h"
+
+#define SAMPLE_RATE 48000.f
+
+struct Control
+{
+    uint8_t param;
+    uint8_t value;
+};
+
+//Detuned polyBLEP saw and square with a slow filter sweep, every voice stays busy
+static const Control kPatchPad[] = {
+    {CTRL_OSC1WAVEFORM, 6 * 26},
+    {CTRL_OSC2WAVEFORM, 5 * 26},
+    {CTRL_OSC2TUNEFINE, 70},
+    {CTRL_NOISE, 10},
+    {CTRL_FILTERCUTOFF, 100},
+    {CTRL_FILTERRESONANCE, 40},
+    {CTRL_FILTERLFOMOD, 30},
+    {CTRL_FILTERATTACK, 8},
+    {CTRL_FILTERSUSTAIN, 80},
+    {CTRL_AMPATTACK, 10},
+    {CTRL_AMPRELEASE, 20},
+    {CTRL_LFOFREQUENCY, 10},
+};
+
+//One voice's block, aligned so two voices never share a cache line
+struct alignas(64) VoiceBlock
+{
+    float buf[VOICE_MAX_BLOCK];
+};
+
+static void InitThread()
+{
+    EnableFlushToZero();
+}
+
+/** Renders size samples of the pad stack, through VoiceManager::ProcessBlock when pool is NULL.
+    Returns the render time in ns.
+*/
+template <size_t voices>
+static double Render(float *out, size_t size, uint8_t oversample, ThreadPool *pool)
+{
+    std::unique_ptr<VoiceManager<voices>> mgr(new VoiceManager<voices>);
+    std::vector<VoiceBlock>               blocks(voices);
+    custom::Lfo                           lfos[NUM_LFOS];
+    float                                 lfo_out[NUM_LFOS][BLOCK_SIZE];
+    Patch                                 patch;
+
+    memcpy(patch.controls, ControlPanel, sizeof(patch.controls));
+    for(const Control &c : kPatchPad)
+    {
+        patch.controls[c.param] = c.value;
+    }
+    PatchCompute(patch, SAMPLE_RATE);
+    mgr->Init(SAMPLE_RATE, oversample);
+    mgr->ApplyPatch(patch);
+    for(int i = 0; i < NUM_LFOS; i++)
+    {
+        lfos[i].Init(SAMPLE_RATE / BLOCK_SIZE);
+        lfos[i].SetWaveform(patch.lfo[i].waveform);
+        lfos[i].SetFreq(patch.lfo[i].freq);
+    }
+
+    const float                      *values = patch.values;
+    const std::function<void(size_t)> render_voice
+        = [&](size_t v) { mgr->RenderVoice(v, blocks[v].buf, values); };
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0, block = 0; i < size; i += BLOCK_SIZE, block++)
+    {
+        //One note per block, a voice only counts as taken once its envelope has run
+        if(block < voices)
+        {
+            mgr->OnNoteOn(36 + (block * 7) % 60, 100);
+        }
+        for(int l = 0; l < NUM_LFOS; l++)
+        {
+            lfos[l].ProcessBlock(lfo_out[l], BLOCK_SIZE);
+        }
+
+        arm_fill_f32(0, out + i, BLOCK_SIZE);
+        if(pool == NULL)
+        {
+            mgr->ProcessBlock(out + i, values, lfo_out, BLOCK_SIZE);
+            continue;
+        }
+        mgr->PrepareBlock(values, lfo_out);
+        pool->Run(voices, render_voice);
+        mgr->MixVoices(out + i, blocks[0].buf, sizeof(VoiceBlock) / sizeof(float));
+    }
+    auto end = std::chrono::steady_clock::now();
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+//Powers of two up to max, then max itself
+static size_t NextThreadCount(size_t threads, size_t max)
+{
+    return threads < max && threads * 2 > max ? max : threads * 2;
+}
+
+template <size_t voices>
+static int Report(size_t size, uint8_t oversample, size_t max_threads, const char *out_path)
+{
+    std::vector<float> serial(size), threaded(size);
+    double             serial_ns = Render<voices>(serial.data(), size, oversample, NULL);
+    double             one_ns    = 0.0;
+    int                failures  = 0;
+
+    printf("{\"voices\": %zu, \"oversample\": %d, \"samples\": %zu, \"serial_ns_per_sample\": %.3f, \"results\": [\n",
+           voices, oversample, size, serial_ns / size);
+    for(size_t threads = 1; threads <= max_threads; threads = NextThreadCount(threads, max_threads))
+    {
+        ThreadPool pool(threads, InitThread);
+        double     ns        = Render<voices>(threaded.data(), size, oversample, &pool);
+        bool       identical = !memcmp(serial.data(), threaded.data(), size * sizeof(float));
+        one_ns               = threads == 1 ? ns : one_ns;
+        failures += !identical;
+        printf("%s  {\"threads\": %zu, \"ns_per_sample\": %.3f, \"speedup\": %.2f, \"efficiency\": %.2f, \"identical\": %s}",
+               threads == 1 ? "" : ",\n", threads, ns / size, one_ns / ns, one_ns / ns / threads,
+               identical ? "true" : "false");
+    }
+    printf("\n]}\n");
+
+    if(out_path)
+    {
+        FILE *f = fopen(out_path, "wb");
+        if(f == NULL || fwrite(serial.data(), sizeof(float), size, f) != size)
+        {
+            fprintf(stderr, "dualie-render: could not write %s\n", out_path);
+            failures++;
+        }
+        if(f)
+            fclose(f);
+    }
+    if(failures)
+        fprintf(stderr, "dualie-render: output differs from the single threaded render\n");
+    return failures ? 1 : 0;
+}
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: dualie-render [--voices 16|32|64|128|256] [--seconds S] [--threads N]\n"
+            "                     [--oversample 1|2] [--out FILE]\n");
+}
+
+int main(int argc, char **argv)
+{
+    size_t      voices     = 128;
+    float       seconds    = 2.f;
+    size_t      threads    = std::max(1u, std::thread::hardware_concurrency());
+    int         oversample = 1;
+    const char *out_path   = NULL;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--voices") && i + 1 < argc)
+            voices = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--seconds") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = std::max(1, atoi(argv[++i]));
+        else if(!strcmp(argv[i], "--oversample") && i + 1 < argc)
+            oversample = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--out") && i + 1 < argc)
+            out_path = argv[++i];
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+
+    EnableFlushToZero();
+    size_t size = std::max(1, (int)(seconds * SAMPLE_RATE / BLOCK_SIZE)) * BLOCK_SIZE;
+    switch(voices)
+    {
+        case 16: return Report<16>(size, oversample, threads, out_path);
+        case 32: return Report<32>(size, oversample, threads, out_path);
+        case 64: return Report<64>(size, oversample, threads, out_path);
+        case 128: return Report<128>(size, oversample, threads, out_path);
+        case 256: return Report<256>(size, oversample, threads, out_path);
+        default: Usage(); return 2;
+    }
+}
@@ -0,0 +1,289 @@
+//Real time safety check of the audio path, built with DUALIE_RTCHECK=1 (include/rtcheck.h).
+//Plays scenes that reach as much of the audio side as possible, through the engine directly
+//and through the C interface, and fails if anything inside a real time scope allocated,
+//locked, made a blocking call or ran far over the block deadline. Also reports the deepest
+//stack the scenes used, by painting, and the peak of the scratch arena (include/scratch.h).
+//
+//  dualie-rtcheck [--seconds S] [--budget-us US]
+//      Every filter model with every waveform at both oversampling factors: chords beyond the
+//      voice count, control sweeps over every control, crossfaded patch changes and clock.
+//  dualie-rtcheck --self-test
+//      Makes one of each kind of violation inside a scope and fails unless all are caught.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <mutex>
+#include <vector>
+#include <arm_math.h>
+
+#include "../include/main.h"
+#include "../include/engine.h"
+#include "../include/oscillator.h"
+#include "../include/voice.h"
+#include "../include/dualie.h"
+#include "../include/rtcheck.h"
+#include "../include/scratch.h"
+#include "../include/stackpaint.h"
+#include "../include/denormal.h"
+
+#define SAMPLE_RATE 48000.f
+
+#if !DUALIE_RTCHECK
+#error "dualie-rtcheck needs the engine built with DUALIE_RTCHECK=1"
+#endif
+
+//Deadline of one block, the default budget is a multiple so only runaway loops are reported
+#define DEADLINE_NS (BLOCK_SIZE * 1e9 / SAMPLE_RATE)
+
+//The scenes run on a thread with a stack of its own, so all of the painted depth is known to be mapped
+#define THREAD_STACK_BYTES (1024 * 1024)
+#define STACK_PAINT_BYTES (256 * 1024)
+
+struct Counts
+{
+    uint32_t scenes, blocks;
+    size_t   stack_bytes;
+};
+
+struct RunArgs
+{
+    float    seconds;
+    uint32_t budget_ns;
+    int      result;
+};
+
+//Paints the stack below the scene, the caller takes the high water mark once it returns
+static void SceneStart()
+{
+    StackPaint(STACK_PAINT_BYTES);
+}
+
+static void SceneEnd(Counts &counts, size_t blocks)
+{
+    size_t stack = StackHighWater();
+    counts.stack_bytes = stack > counts.stack_bytes ? stack : counts.stack_bytes;
+    counts.scenes++;
+    counts.blocks += blocks;
+}
+
+//Events for the block, the same for both paths: notes beyond the voice count, one control
+//moved per block and a crossfaded patch change every second
+static void SceneEvents(size_t block, std::vector<DualieEvent> &out, const uint8_t *patch)
+{
+    const size_t second = (size_t)(SAMPLE_RATE / BLOCK_SIZE);
+    out.clear();
+    if(block % 24 == 0)
+    {
+        uint8_t root = 36 + (block / 24 * 7) % 48;
+        for(int n = 0; n < 4; n++)
+        {
+            out.push_back({0, DUALIE_EVENT_NOTE_ON, (uint8_t)(root + n * 3), 100, 0});
+            out.push_back({0, DUALIE_EVENT_NOTE_OFF, (uint8_t)(root + n * 3 + 24), 0, 0});
+        }
+    }
+    uint8_t param = block % NUM_CONTROLS;
+    //Waveform and filter type stay as the scene set them
+    if(param != CTRL_OSC1WAVEFORM && param != CTRL_OSC2WAVEFORM && param != CTRL_FILTERTYPE)
+    {
+        out.push_back({0, DUALIE_EVENT_CONTROL, param, (uint8_t)((block * 37) % 128), 0});
+    }
+    if(block % 4 == 0)
+    {
+        out.push_back({0, DUALIE_EVENT_CLOCK, 0, 0, 0});
+    }
+    if(block % second == second - 1)
+    {
+        for(int i = 0; i < NUM_CONTROLS; i++)
+        {
+            out.push_back({0, DUALIE_EVENT_CONTROL, (uint8_t)i, patch[i], 0});
+        }
+    }
+}
+
+static void ScenePatch(uint8_t waveform, uint8_t filter, uint8_t *patch)
+{
+    memcpy(patch, DefaultControls, NUM_CONTROLS);
+    patch[CTRL_OSC1WAVEFORM]    = waveform * 26;
+    patch[CTRL_OSC2WAVEFORM]    = (custom::Oscillator::WAVE_LAST - 1 - waveform) * 26;
+    patch[CTRL_FILTERTYPE]      = filter * 26;
+    patch[CTRL_FILTERRESONANCE] = 100;
+    patch[CTRL_OSC2PHASEMOD]    = 40;
+    patch[CTRL_RINGMOD]         = 40;
+    patch[CTRL_NOISE]           = 30;
+}
+
+//The engine as the firmware drives it, events between blocks
+static void RunEngine(Engine &engine, uint8_t oversample, const uint8_t *patch, size_t blocks, uint32_t budget_ns)
+{
+    memcpy(engine.GetControls(), DefaultControls, NUM_CONTROLS);
+    engine.Init(SAMPLE_RATE, oversample);
+    engine.LoadPreset(patch);
+    std::vector<DualieEvent> events;
+    events.reserve(128);
+    float    buf[BLOCK_SIZE];
+    uint32_t clock_us = 0;
+    for(size_t block = 0; block < blocks; block++)
+    {
+        SceneEvents(block, events, patch);
+        for(const DualieEvent &e : events)
+        {
+            switch(e.type)
+            {
+                case DUALIE_EVENT_NOTE_ON: engine.NoteOn(e.data1, e.data2); break;
+                case DUALIE_EVENT_NOTE_OFF: engine.NoteOff(e.data1, e.data2); break;
+                case DUALIE_EVENT_CONTROL: engine.HandleControls(e.data2, e.data1, true); break;
+                case DUALIE_EVENT_CLOCK: engine.ClockTick(clock_us += 20833); break;
+                default: break;
+            }
+        }
+        engine.Update();
+        RT_SCOPE("block", budget_ns);
+        engine.ProcessBlock(buf, BLOCK_SIZE);
+    }
+}
+
+//The C interface, created outside and rendered inside real time scopes, in odd sized calls
+static void RunLibrary(const uint8_t *patch, size_t blocks, uint32_t budget_ns)
+{
+    DualieInstance *inst = dualie_create(SAMPLE_RATE, 256);
+    dualie_load_controls(inst, patch, 0);
+    std::vector<DualieEvent> events;
+    events.reserve(128);
+    float left[BLOCK_SIZE * 2], right[BLOCK_SIZE * 2];
+    for(size_t block = 0; block < blocks; block++)
+    {
+        SceneEvents(block, events, patch);
+        RT_SCOPE("host callback", budget_ns);
+        dualie_push_events(inst, events.data(), (uint32_t)events.size());
+        uint32_t frames = block % 3 == 0 ? BLOCK_SIZE - 5 : (block % 3 == 1 ? BLOCK_SIZE + 5 : BLOCK_SIZE);
+        dualie_render(inst, left, right, frames);
+    }
+    dualie_destroy(inst);
+}
+
+static int Run(float seconds, uint32_t budget_ns)
+{
+    static Engine engine;
+    const size_t  blocks = (size_t)(seconds * SAMPLE_RATE / BLOCK_SIZE);
+    Counts        counts = {0, 0, 0};
+    uint8_t       patch[NUM_CONTROLS];
+    for(uint8_t oversample = 1; oversample <= VOICE_MAX_OVERSAMPLE; oversample++)
+    {
+        for(uint8_t filter = 0; filter < FILTER_LAST; filter++)
+        {
+            for(uint8_t waveform = 0; waveform < custom::Oscillator::WAVE_LAST; waveform++)
+            {
+                ScenePatch(waveform, filter, patch);
+                SceneStart();
+                RunEngine(engine, oversample, patch, blocks, budget_ns);
+                SceneEnd(counts, blocks);
+            }
+        }
+    }
+    for(uint8_t filter = 0; filter < FILTER_LAST; filter++)
+    {
+        ScenePatch(custom::Oscillator::WAVE_POLYBLEP_SAW, filter, patch);
+        SceneStart();
+        RunLibrary(patch, blocks, budget_ns);
+        SceneEnd(counts, blocks);
+    }
+    printf("{\"scenes\": %u, \"blocks\": %u, \"budget_us\": %.1f, \"violations\": %u, \"stack_bytes\": %zu, "
+           "\"scratch_bytes\": %zu, \"scratch_capacity\": %zu, \"scratch_full\": %u}\n",
+           counts.scenes, counts.blocks, budget_ns / 1e3, RtViolations(), counts.stack_bytes, Scratch().PeakBytes(),
+           Scratch().CapacityBytes(), Scratch().Overflows());
+    return RtViolations() ? 1 : 0;
+}
+
+static void *RunThread(void *arg)
+{
+    RunArgs *run = (RunArgs *)arg;
+    EnableFlushToZero();
+    run->result = Run(run->seconds, run->budget_ns);
+    return NULL;
+}
+
+//Run on a thread whose whole stack is allocated up front
+static int RunOnThread(float seconds, uint32_t budget_ns)
+{
+    RunArgs        run   = {seconds, budget_ns, 1};
+    void          *stack = aligned_alloc(4096, THREAD_STACK_BYTES);
+    pthread_attr_t attr;
+    pthread_t      thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, THREAD_STACK_BYTES);
+    if(stack == NULL || pthread_create(&thread, &attr, RunThread, &run) != 0)
+    {
+        fprintf(stderr, "dualie-rtcheck: cannot start the scene thread\n");
+        free(stack);
+        return 1;
+    }
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    free(stack);
+    return run.result;
+}
+
+//One of each kind, every one has to be reported
+static int SelfTest()
+{
+    static std::mutex mutex;
+    const uint32_t    expected = 5;
+    {
+        RT_SCOPE("self test", 1000);
+        float *volatile p = new float[16];
+        {
+            RT_ALLOW();
+            //Not reported
+            delete[] p;
+        }
+        mutex.lock();
+        mutex.unlock();
+        fprintf(stderr, "rtcheck: printing from a real time scope\n");
+        RT_CHECK_VLA(4096, float);
+        volatile float x = 0.f;
+        for(int i = 0; i < 10000000; i++)
+        {
+            x = x + 1.f;
+        }
+    }
+    uint32_t caught = RtViolations();
+    printf("{\"self_test\": true, \"expected\": %u, \"violations\": %u}\n", expected, caught);
+    return caught == expected ? 0 : 1;
+}
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: dualie-rtcheck [--seconds S] [--budget-us US]\n"
+            "       dualie-rtcheck --self-test\n");
+}
+
+int main(int argc, char **argv)
+{
+    float seconds   = 2.f;
+    float budget_us = 10.f * DEADLINE_NS / 1e3;
+    bool  self_test = false;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--seconds") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--budget-us") && i + 1 < argc)
+            budget_us = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--self-test"))
+            self_test = true;
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+    if(seconds <= 0.f || budget_us <= 0.f)
+    {
+        Usage();
+        return 2;
+    }
+    EnableFlushToZero();
+    return self_test ? SelfTest() : RunOnThread(seconds, (uint32_t)(budget_us * 1e3f));
+}
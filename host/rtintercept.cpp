@@ -0,0 +1,343 @@
+//Interposes the libc calls that must not happen on the audio side, see include/rtcheck.h.
+//Linked into executables built with DUALIE_RTCHECK=1. Definitions here take the place of
+//libc's for the whole process; outside of a real time scope they only pass the call on.
+//
+//Set DUALIE_RTCHECK_ABORT=1 to abort at the first violation, e.g. under a debugger.
+
+#undef _FORTIFY_SOURCE
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "../include/rtcheck.h"
+
+#if !DUALIE_RTCHECK
+#error "rtintercept.cpp is only linked into DUALIE_RTCHECK=1 builds"
+#endif
+
+//Stack frames kept for a report, and distinct call stacks reported in full
+#define RT_FRAMES 24
+#define RT_SEEN 256
+
+static thread_local const char *rt_scope;
+static thread_local int         rt_depth;
+static thread_local int         rt_allow;
+static thread_local bool        rt_reporting;
+
+static std::atomic<uint32_t> rt_violations{0};
+static std::atomic<uint64_t> rt_seen[RT_SEEN];
+static bool                  rt_abort;
+
+__attribute__((constructor)) static void RtInit()
+{
+    const char *env = getenv("DUALIE_RTCHECK_ABORT");
+    rt_abort        = env && env[0] == '1';
+    //The first backtrace loads the unwinder, which allocates, so that happens here
+    void *frames[4];
+    backtrace(frames, 4);
+}
+
+//CPU time of the calling thread, so time the host scheduler gave to others is not counted
+static uint64_t NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+RealtimeScope::RealtimeScope(const char *name, uint32_t budget_ns)
+: outer_(rt_scope), budget_ns_(budget_ns), start_ns_(budget_ns ? NowNs() : 0)
+{
+    rt_scope = name;
+    rt_depth++;
+}
+
+RealtimeScope::~RealtimeScope()
+{
+    if(budget_ns_)
+    {
+        uint64_t elapsed = NowNs() - start_ns_;
+        if(elapsed > budget_ns_)
+        {
+            char detail[64];
+            snprintf(detail, sizeof(detail), "%.1f us, budget %.1f us", elapsed / 1e3, budget_ns_ / 1e3);
+            RtViolation("over budget", detail);
+        }
+    }
+    rt_depth--;
+    rt_scope = outer_;
+}
+
+RealtimeAllow::RealtimeAllow()
+{
+    rt_allow++;
+}
+
+RealtimeAllow::~RealtimeAllow()
+{
+    rt_allow--;
+}
+
+bool RtInRealtime()
+{
+    return rt_depth > 0 && rt_allow == 0 && !rt_reporting;
+}
+
+uint32_t RtViolations()
+{
+    return rt_violations.load(std::memory_order_relaxed);
+}
+
+//True the first time a call stack is seen, so a violation in every block is printed once
+static bool FirstSeen(void *const *frames, int count)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for(int i = 0; i < count; i++)
+    {
+        hash = (hash ^ (uint64_t)(uintptr_t)frames[i]) * 1099511628211ull;
+    }
+    hash |= 1;
+    for(int i = 0; i < RT_SEEN; i++)
+    {
+        std::atomic<uint64_t> &slot     = rt_seen[(hash + i) % RT_SEEN];
+        uint64_t               expected = 0;
+        if(slot.load(std::memory_order_relaxed) == hash)
+        {
+            return false;
+        }
+        if(slot.compare_exchange_strong(expected, hash) || expected == hash)
+        {
+            return expected == 0;
+        }
+    }
+    //Table full, keep quiet rather than flood
+    return false;
+}
+
+//Not inlined, so the reported stack starts two frames up at whoever broke the rule
+__attribute__((noinline)) static void Report(const char *kind, const char *detail)
+{
+    //Everything below may call what is being checked
+    rt_reporting = true;
+    rt_violations.fetch_add(1, std::memory_order_relaxed);
+    void *frames[RT_FRAMES];
+    int   count = backtrace(frames, RT_FRAMES);
+    if(FirstSeen(frames, count))
+    {
+        char line[256];
+        int  len = snprintf(line, sizeof(line), "rtcheck: %s%s%s in real time scope '%s'\n", kind, detail ? ": " : "",
+                            detail ? detail : "", rt_scope);
+        if(write(STDERR_FILENO, line, len < (int)sizeof(line) ? len : sizeof(line) - 1) < 0)
+        {
+            //Nothing left to report to
+        }
+        //Skips Report and RtViolation or the interposer
+        backtrace_symbols_fd(frames + 2, count > 2 ? count - 2 : 0, STDERR_FILENO);
+    }
+    rt_reporting = false;
+    if(rt_abort)
+    {
+        abort();
+    }
+}
+
+void RtViolation(const char *kind, const char *detail)
+{
+    if(RtInRealtime())
+    {
+        Report(kind, detail);
+        //Keeps this frame on the stack instead of a tail call, Report skips it
+        __asm__ volatile("" ::: "memory");
+    }
+}
+
+__attribute__((always_inline)) static inline void Check(const char *call)
+{
+    if(RtInRealtime())
+    {
+        Report(call, NULL);
+    }
+}
+
+//The next definition of a symbol, normally libc's. The lookup itself may allocate
+template <typename F>
+static F Next(F &cache, const char *name)
+{
+    if(cache == NULL)
+    {
+        rt_allow++;
+        cache = (F)dlsym(RTLD_NEXT, name);
+        rt_allow--;
+    }
+    return cache;
+}
+
+#define FORWARD(ret, name, params, args)         \
+    ret name params                              \
+    {                                            \
+        static ret(*real) params;                \
+        Check(#name);                            \
+        return Next(real, #name) args;           \
+    }
+
+extern "C" {
+
+/* Heap, glibc exports its allocator under these names so no lookup is needed */
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void  __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    Check("malloc");
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    Check("calloc");
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    Check("realloc");
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if(ptr)
+    {
+        Check("free");
+    }
+    __libc_free(ptr);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    Check("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    Check("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    Check("posix_memalign");
+    if(alignment < sizeof(void *) || (alignment & (alignment - 1)))
+    {
+        return 22; //EINVAL
+    }
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr || size == 0 ? 0 : 12; //ENOMEM
+}
+
+/* Locks, std::mutex and friends end up here */
+
+FORWARD(int, pthread_mutex_lock, (pthread_mutex_t * mutex), (mutex))
+FORWARD(int, sem_wait, (sem_t * sem), (sem))
+FORWARD(int, pthread_join, (pthread_t thread, void **result), (thread, result))
+
+/* Syscalls that block or take unbounded time */
+
+FORWARD(ssize_t, read, (int fd, void *buf, size_t count), (fd, buf, count))
+FORWARD(ssize_t, write, (int fd, const void *buf, size_t count), (fd, buf, count))
+FORWARD(int, close, (int fd), (fd))
+FORWARD(int, nanosleep, (const struct timespec *req, struct timespec *rem), (req, rem))
+FORWARD(int, clock_nanosleep, (clockid_t clock, int flags, const struct timespec *req, struct timespec *rem),
+        (clock, flags, req, rem))
+FORWARD(int, usleep, (useconds_t usec), (usec))
+FORWARD(unsigned int, sleep, (unsigned int seconds), (seconds))
+FORWARD(int, sched_yield, (void), ())
+FORWARD(int, poll, (struct pollfd * fds, nfds_t count, int timeout), (fds, count, timeout))
+FORWARD(int, select, (int count, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout),
+        (count, readfds, writefds, exceptfds, timeout))
+
+int open(const char *path, int flags, ...)
+{
+    static int (*real)(const char *, int, ...);
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = (flags & (O_CREAT | O_TMPFILE)) ? va_arg(args, int) : 0;
+    va_end(args);
+    Check("open");
+    return Next(real, "open")(path, flags, mode);
+}
+
+int openat(int dir, const char *path, int flags, ...)
+{
+    static int (*real)(int, const char *, int, ...);
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = (flags & (O_CREAT | O_TMPFILE)) ? va_arg(args, int) : 0;
+    va_end(args);
+    Check("openat");
+    return Next(real, "openat")(dir, path, flags, mode);
+}
+
+/* stdio locks the stream and may flush, printing from the audio side is the classic one */
+
+FORWARD(size_t, fwrite, (const void *ptr, size_t size, size_t count, FILE *stream), (ptr, size, count, stream))
+FORWARD(int, fputs, (const char *s, FILE *stream), (s, stream))
+FORWARD(int, puts, (const char *s), (s))
+FORWARD(int, fflush, (FILE * stream), (stream))
+FORWARD(int, vfprintf, (FILE * stream, const char *format, va_list args), (stream, format, args))
+
+int printf(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int result = vfprintf(stdout, format, args);
+    va_end(args);
+    return result;
+}
+
+int fprintf(FILE *stream, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int result = vfprintf(stream, format, args);
+    va_end(args);
+    return result;
+}
+
+//What printf and fprintf become with _FORTIFY_SOURCE
+int __printf_chk(int, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int result = vfprintf(stdout, format, args);
+    va_end(args);
+    return result;
+}
+
+int __fprintf_chk(FILE *stream, int, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int result = vfprintf(stream, format, args);
+    va_end(args);
+    return result;
+}
+
+}
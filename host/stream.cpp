@@ -0,0 +1,513 @@
+//Runs the engine as a long lived streaming process. Raw MIDI bytes are read from stdin or a FIFO
+//and parsed as they arrive, and interleaved PCM is written to stdout one period at a time, so
+//the synth can be piped into existing audio tools, e.g.
+//  dualie-stream --input /tmp/midi --realtime | aplay -f FLOAT_LE -c 2 -r 48000
+//Messages take the same path as in main(): notes go to EngineNoteOn/EngineNoteOff, controls to
+//HandleControls, and every period publishes the changes with EngineUpdate before it renders.
+//Latency from the arrival of a message to the write of the first period that contains it is
+//reported as JSON on stderr at exit, and every --stats seconds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+#include <algorithm>
+#include <arm_math.h>
+
+#include "../include/main.h"
+#include "../include/engine.h"
+#include "../include/preset.h"
+#include "../include/denormal.h"
+#include "midiparser.h"
+
+//Largest period, 85 ms at 48 kHz
+#define STREAM_MAX_PERIOD 4096
+
+//Output gain of AudioCallbackBlock
+#define STREAM_GAIN 0.5f
+
+static volatile sig_atomic_t stop;
+
+static void OnSignal(int)
+{
+    stop = 1;
+}
+
+static uint64_t NowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** Fixed size latency histogram with 2 us buckets up to 100 ms, so a process that runs for
+    days keeps constant memory. Longer values are counted in the last bucket, max stays exact.
+*/
+class Histogram
+{
+  public:
+    Histogram() : counts_(kBuckets + 1, 0), count_(0), sum_(0), max_(0) {}
+
+    void Add(uint64_t ns)
+    {
+        counts_[std::min<uint64_t>(ns / kBucketNs, kBuckets)]++;
+        count_++;
+        sum_ += ns;
+        max_ = std::max(max_, ns);
+    }
+
+    //Upper edge of the bucket that holds the fraction p of all values, in us
+    double PercentileUs(double p) const
+    {
+        uint64_t rank = (uint64_t)ceil(p * count_), seen = 0;
+        for(size_t i = 0; i <= kBuckets; i++)
+        {
+            seen += counts_[i];
+            if(seen >= rank && seen > 0)
+            {
+                return i == kBuckets ? max_ / 1e3 : std::min((i + 1) * kBucketNs, max_) / 1e3;
+            }
+        }
+        return 0.0;
+    }
+
+    void Print(FILE *f, const char *name) const
+    {
+        fprintf(f, "\"%s\": {\"count\": %llu, \"mean_us\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}",
+                name, (unsigned long long)count_, count_ ? sum_ / 1e3 / count_ : 0.0, PercentileUs(0.5),
+                PercentileUs(0.99), max_ / 1e3);
+    }
+
+  private:
+    static const size_t   kBuckets  = 50000;
+    static const uint64_t kBucketNs = 2000;
+
+    std::vector<uint64_t> counts_;
+    uint64_t              count_, sum_, max_;
+};
+
+struct Options
+{
+    const char *input       = NULL;
+    const char *presets     = NULL;
+    size_t      period      = BLOCK_SIZE;
+    float       sample_rate = 48000.f;
+    int         channels    = 2;
+    bool        s16         = false;
+    bool        realtime    = false;
+    float       tail        = 1.f;
+    float       stats       = 0.f;
+};
+
+struct Stats
+{
+    Histogram latency; //Arrival of a message to the write of its period
+    Histogram render;  //Engine time per period
+    Histogram write;   //Time blocked writing a period
+    uint64_t  periods   = 0;
+    uint64_t  bytes_in  = 0;
+    uint64_t  messages  = 0;
+    uint64_t  overruns  = 0;
+    size_t    out_queue = 0; //Bytes the output pipe can hold, 0 if unknown
+};
+
+static std::vector<uint8_t> preset_bank;
+
+//Same as LoadPreset in main(), controls missing from an older bank keep their current value
+static void LoadPreset(uint8_t program, bool crossfade)
+{
+    uint8_t controls[NUM_CONTROLS];
+    if(preset_bank.empty())
+    {
+        return;
+    }
+    memcpy(controls, ControlPanel, sizeof(controls));
+    if(PresetBankRead(preset_bank.data(), program, controls, NULL))
+    {
+        EngineLoadPreset(controls, crossfade);
+    }
+}
+
+static bool ReadPresetBank(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if(f == NULL)
+    {
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t  n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        preset_bank.insert(preset_bank.end(), buf, buf + n);
+    }
+    fclose(f);
+    if(!PresetBankValid(preset_bank.data(), preset_bank.size()))
+    {
+        preset_bank.clear();
+        return false;
+    }
+    return true;
+}
+
+//The message switch of main(), channels are ignored as on the Seed
+static void HandleMessage(const MidiMessage &msg, uint64_t time_ns)
+{
+    switch(msg.status & 0xF0)
+    {
+        case 0x90:
+            if(msg.data2 != 0)
+            {
+                EngineNoteOn(msg.data1, msg.data2);
+            }
+            else
+            {
+                EngineNoteOff(msg.data1, msg.data2);
+            }
+            break;
+        case 0x80: EngineNoteOff(msg.data1, msg.data2); break;
+        case 0xB0: HandleControls(msg.data2, msg.data1, true); break;
+        case 0xC0: LoadPreset(msg.data1, true); break;
+        case 0xF0:
+            if(msg.status == 0xF8)
+            {
+                EngineClockTick((uint32_t)(time_ns / 1000));
+            }
+            else if(msg.status == 0xFA)
+            {
+                EngineClockStart();
+            }
+            break;
+        default: break;
+    }
+}
+
+/** Reads what is available without blocking and hands complete messages to the engine.
+    Arrival times of the messages go to pending. Returns false once the input is closed.
+*/
+static bool ReadMidi(int fd, MidiParser &parser, std::vector<uint64_t> &pending, Stats &stats)
+{
+    uint8_t buf[256];
+    for(;;)
+    {
+        pollfd p = {fd, POLLIN, 0};
+        if(poll(&p, 1, 0) <= 0 || !(p.revents & (POLLIN | POLLHUP)))
+        {
+            return true;
+        }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n < 0 && (errno == EINTR || errno == EAGAIN))
+        {
+            return true;
+        }
+        if(n <= 0)
+        {
+            return false;
+        }
+        uint64_t now = NowNs();
+        stats.bytes_in += n;
+        for(ssize_t i = 0; i < n; i++)
+        {
+            MidiMessage msg;
+            if(parser.Parse(buf[i], msg))
+            {
+                HandleMessage(msg, now);
+                pending.push_back(now);
+                stats.messages++;
+            }
+        }
+    }
+}
+
+//Waits for input until deadline, returns early when some has arrived
+static void WaitForMidi(int fd, uint64_t deadline)
+{
+    uint64_t now = NowNs();
+    if(now >= deadline)
+    {
+        return;
+    }
+    pollfd   p       = {fd, POLLIN, 0};
+    uint64_t wait_ns = deadline - now;
+    timespec timeout = {(time_t)(wait_ns / 1000000000ull), (long)(wait_ns % 1000000000ull)};
+    ppoll(fd >= 0 ? &p : NULL, fd >= 0 ? 1 : 0, &timeout, NULL);
+}
+
+static bool WriteAll(const uint8_t *data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t n = write(STDOUT_FILENO, data, size);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/** Keeps a pipe on stdout down to the smallest capacity that holds one period, so audio never
+    queues up ahead of the reader by more than that. Returns the capacity in bytes, 0 if stdout
+    is not a pipe.
+*/
+static size_t LimitOutputPipe(size_t period_bytes)
+{
+    struct stat st;
+    if(fstat(STDOUT_FILENO, &st) != 0 || !S_ISFIFO(st.st_mode))
+    {
+        return 0;
+    }
+#ifdef F_SETPIPE_SZ
+    fcntl(STDOUT_FILENO, F_SETPIPE_SZ, (int)period_bytes);
+#endif
+#ifdef F_GETPIPE_SZ
+    int size = fcntl(STDOUT_FILENO, F_GETPIPE_SZ);
+    return size > 0 ? (size_t)size : 0;
+#else
+    return 0;
+#endif
+}
+
+static void PrintStats(const Options &opt, const Stats &stats, const MidiParser &parser, uint64_t elapsed_ns)
+{
+    double frame_us = 1e6 / opt.sample_rate;
+    size_t frame_bytes = opt.channels * (opt.s16 ? sizeof(int16_t) : sizeof(float));
+    ControlStats controls = EngineGetControlStats();
+    fprintf(stderr,
+            "{\"period\": %zu, \"period_us\": %.1f, \"sample_rate\": %d, \"format\": \"%s\", \"channels\": %d, "
+            "\"realtime\": %s, \"seconds\": %.1f, \"periods\": %llu, \"overruns\": %llu, \"bytes_in\": %llu, "
+            "\"messages\": %llu, \"dropped_bytes\": %u, \"output_queue_us\": %.1f, "
+            "\"controls\": {\"received\": %u, \"applied\": %u, \"patches\": %u}, ",
+            opt.period, opt.period * frame_us, (int)opt.sample_rate, opt.s16 ? "s16" : "f32", opt.channels,
+            opt.realtime ? "true" : "false", elapsed_ns / 1e9, (unsigned long long)stats.periods,
+            (unsigned long long)stats.overruns, (unsigned long long)stats.bytes_in,
+            (unsigned long long)stats.messages, parser.GetDropped(),
+            stats.out_queue / frame_bytes * frame_us, controls.received, controls.applied, controls.patches);
+    stats.latency.Print(stderr, "midi_to_output");
+    fprintf(stderr, ", ");
+    stats.render.Print(stderr, "render");
+    fprintf(stderr, ", ");
+    stats.write.Print(stderr, "write");
+    fprintf(stderr, "}\n");
+}
+
+static int Stream(const Options &opt, int fd)
+{
+    const size_t frame_bytes = opt.channels * (opt.s16 ? sizeof(int16_t) : sizeof(float));
+    const uint64_t period_ns = (uint64_t)(opt.period * 1e9 / opt.sample_rate);
+
+    std::vector<float>    mono(opt.period);
+    std::vector<uint8_t>  out(opt.period * frame_bytes);
+    std::vector<uint64_t> pending;
+    pending.reserve(1024);
+    MidiParser parser;
+    Stats      stats;
+    stats.out_queue = LimitOutputPipe(out.size());
+
+    bool     input_open  = fd >= 0;
+    size_t   tail_left   = (size_t)(opt.tail * opt.sample_rate / opt.period) + 1;
+    uint64_t start       = NowNs();
+    uint64_t deadline    = start;
+    uint64_t next_report = opt.stats > 0.f ? start + (uint64_t)(opt.stats * 1e9) : UINT64_MAX;
+
+    while(!stop)
+    {
+        //With --realtime every period is due at its place on the sample clock and MIDI that
+        //arrives before then still makes it. Otherwise the reader paces the output.
+        if(opt.realtime)
+        {
+            WaitForMidi(input_open ? fd : -1, deadline);
+            while(input_open && NowNs() < deadline)
+            {
+                input_open = ReadMidi(fd, parser, pending, stats);
+                WaitForMidi(input_open ? fd : -1, deadline);
+            }
+        }
+        if(input_open)
+        {
+            input_open = ReadMidi(fd, parser, pending, stats);
+        }
+        else if(tail_left-- == 0)
+        {
+            break;
+        }
+
+        //Publish everything changed by this batch of events as one patch
+        EngineUpdate();
+
+        uint64_t render_start = NowNs();
+        for(size_t i = 0; i < opt.period; i += BLOCK_SIZE)
+        {
+            EngineProcessBlock(&mono[i], BLOCK_SIZE);
+        }
+        arm_scale_f32(mono.data(), STREAM_GAIN, mono.data(), opt.period);
+        if(opt.s16)
+        {
+            int16_t *pcm = (int16_t *)out.data();
+            for(size_t i = 0; i < opt.period; i++)
+            {
+                int16_t s = (int16_t)lrintf(std::max(-1.f, std::min(1.f, mono[i])) * 32767.f);
+                for(int c = 0; c < opt.channels; c++)
+                {
+                    *pcm++ = s;
+                }
+            }
+        }
+        else
+        {
+            float *pcm = (float *)out.data();
+            for(size_t i = 0; i < opt.period; i++)
+            {
+                for(int c = 0; c < opt.channels; c++)
+                {
+                    *pcm++ = mono[i];
+                }
+            }
+        }
+        uint64_t render_end = NowNs();
+        if(!WriteAll(out.data(), out.size()))
+        {
+            //Reader went away
+            break;
+        }
+        uint64_t written = NowNs();
+
+        stats.periods++;
+        stats.render.Add(render_end - render_start);
+        stats.write.Add(written - render_end);
+        for(uint64_t arrival : pending)
+        {
+            stats.latency.Add(written - arrival);
+        }
+        pending.clear();
+
+        if(opt.realtime)
+        {
+            deadline += period_ns;
+            //Behind by more than a period, start again from now instead of rushing to catch up
+            if(written > deadline + period_ns)
+            {
+                stats.overruns++;
+                deadline = written;
+            }
+        }
+        if(written >= next_report)
+        {
+            PrintStats(opt, stats, parser, written - start);
+            next_report += (uint64_t)(opt.stats * 1e9);
+        }
+    }
+
+    PrintStats(opt, stats, parser, NowNs() - start);
+    return 0;
+}
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: dualie-stream [--input FILE|FIFO] [--block-size N] [--sample-rate HZ]\n"
+            "                     [--format f32|s16] [--channels 1|2] [--realtime]\n"
+            "                     [--presets BANK] [--tail S] [--stats S]\n");
+}
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--input") && i + 1 < argc)
+            opt.input = argv[++i];
+        else if(!strcmp(argv[i], "--block-size") && i + 1 < argc)
+            opt.period = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--sample-rate") && i + 1 < argc)
+            opt.sample_rate = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--format") && i + 1 < argc)
+        {
+            const char *format = argv[++i];
+            if(strcmp(format, "f32") && strcmp(format, "s16"))
+            {
+                Usage();
+                return 2;
+            }
+            opt.s16 = !strcmp(format, "s16");
+        }
+        else if(!strcmp(argv[i], "--channels") && i + 1 < argc)
+            opt.channels = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--realtime"))
+            opt.realtime = true;
+        else if(!strcmp(argv[i], "--presets") && i + 1 < argc)
+            opt.presets = argv[++i];
+        else if(!strcmp(argv[i], "--tail") && i + 1 < argc)
+            opt.tail = std::max(0.0, atof(argv[++i]));
+        else if(!strcmp(argv[i], "--stats") && i + 1 < argc)
+            opt.stats = atof(argv[++i]);
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+    //The engine runs its control rate every BLOCK_SIZE samples, a period holds whole blocks
+    if(opt.period < BLOCK_SIZE || opt.period > STREAM_MAX_PERIOD || opt.period % BLOCK_SIZE
+       || (opt.channels != 1 && opt.channels != 2) || opt.sample_rate <= 0.f)
+    {
+        fprintf(stderr, "dualie-stream: --block-size must be a multiple of %d up to %d, --channels 1 or 2\n",
+                BLOCK_SIZE, STREAM_MAX_PERIOD);
+        return 2;
+    }
+
+    //A FIFO is opened for writing too, so it stays open while writers come and go
+    int fd = STDIN_FILENO;
+    if(opt.input)
+    {
+        struct stat st;
+        bool        fifo = stat(opt.input, &st) == 0 && S_ISFIFO(st.st_mode);
+        fd               = open(opt.input, (fifo ? O_RDWR : O_RDONLY) | O_NONBLOCK);
+        if(fd < 0)
+        {
+            fprintf(stderr, "dualie-stream: could not open %s\n", opt.input);
+            return 1;
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    EngineInit(opt.sample_rate);
+    if(opt.presets)
+    {
+        if(!ReadPresetBank(opt.presets))
+        {
+            fprintf(stderr, "dualie-stream: %s is not a valid preset bank\n", opt.presets);
+            return 1;
+        }
+        //Start from the first stored preset, as on the Seed
+        LoadPreset(0, false);
+    }
+    EnableFlushToZero();
+
+    int result = Stream(opt, fd);
+    if(opt.input)
+    {
+        close(fd);
+    }
+    return result;
+}
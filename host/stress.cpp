@@ -0,0 +1,508 @@
+//Worst case block times of the engine under adversarial scenes. CpuLoadMeter's average hides
+//the blocks that glitch, this reports the slowest block and the 99.99th percentile against the
+//BLOCK_SIZE deadline for a generated corpus: every combination of the stressors below, through
+//every filter model.
+//
+//  dualie-stress [run] [--seconds S] [--repeat N] [--only SUBSTRING] [--oversample 1|2]
+//                [--baseline REPORT] [--tolerance POINTS]
+//      Renders each scenario with the events handled between blocks, as the main loop does,
+//      and times every block. The scenes are deterministic, so every block keeps its fastest
+//      time over --repeat renders: a slow block that comes back every time is the engine's,
+//      one that does not was the host scheduler. The JSON report on stdout has one scenario per line so it can be
+//      kept and passed back as --baseline: a p99.99 more than --tolerance percentage points of
+//      the deadline above the baseline fails the run.
+//  dualie-stress export DIR
+//      Writes the corpus for the Seed: DIR/stress.csv with one preset per scenario, for
+//      dualie-presetconv, and a MIDI file per scenario that selects its preset and plays the
+//      events. The firmware logs its own "blocks:" report every BLOCK_REPORT_INTERVAL seconds.
+//      Presets only hold MIDI values, so the polyBLEP waveforms become plain squares on the Seed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <arm_math.h>
+
+#include "../include/main.h"
+#include "../include/engine.h"
+#include "../include/voice.h"
+#include "../include/preset.h"
+#include "../include/blockstats.h"
+#include "../include/denormal.h"
+
+#define SAMPLE_RATE 48000.f
+
+//Blocks rendered before the timing starts
+#define WARMUP_BLOCKS 300
+
+enum Stressor
+{
+    STRESS_POLYBLEP_RES = 1, //polyBLEP square on both oscillators at full resonance
+    STRESS_NOTE_BURST   = 2, //all voices retriggered at once while the last chord releases
+    STRESS_ENV_SWEEP    = 4, //every envelope time changes before every block
+    STRESS_SYNC_NOISE   = 8, //hard sync and full pink noise
+    STRESS_ALL          = 15,
+};
+
+static const char *const kStressorNames[] = {"polyblep_res", "note_burst", "env_sweep", "sync_noise"};
+
+static const char *const kFilterNames[FILTER_LAST] = {"ladder", "ladder2", "svf_lowpass", "svf_bandpass",
+                                                      "svf_highpass"};
+
+//Blocks between two bursts, about 10 ms
+#define BURST_BLOCKS 32
+
+static const uint8_t kEnvelopeTimes[] = {CTRL_FILTERATTACK, CTRL_FILTERDECAY, CTRL_FILTERRELEASE,
+                                         CTRL_AMPATTACK,    CTRL_AMPDECAY,    CTRL_AMPRELEASE};
+
+struct Scenario
+{
+    std::string name;
+    unsigned    stressors;
+    uint8_t     filter;
+};
+
+struct MidiEvent
+{
+    uint8_t status, data1, data2;
+};
+
+static std::vector<Scenario> Corpus()
+{
+    std::vector<Scenario> corpus;
+    for(unsigned stressors = 1; stressors <= STRESS_ALL; stressors++)
+    {
+        for(uint8_t filter = 0; filter < FILTER_LAST; filter++)
+        {
+            Scenario s;
+            for(int i = 0; i < 4; i++)
+            {
+                if(stressors & (1 << i))
+                {
+                    s.name += s.name.empty() ? "" : "+";
+                    s.name += kStressorNames[i];
+                }
+            }
+            s.name += "/";
+            s.name += kFilterNames[filter];
+            s.stressors = stressors;
+            s.filter    = filter;
+            corpus.push_back(s);
+        }
+    }
+    return corpus;
+}
+
+static void ScenarioControls(const Scenario &s, uint8_t *controls)
+{
+    memcpy(controls, DefaultControls, NUM_CONTROLS);
+    controls[CTRL_FILTERTYPE] = s.filter * 26;
+    controls[CTRL_AMPRELEASE] = 40;
+    if(s.stressors & STRESS_POLYBLEP_RES)
+    {
+        controls[CTRL_OSC1WAVEFORM]    = custom::Oscillator::WAVE_POLYBLEP_SQUARE * 26;
+        controls[CTRL_OSC2WAVEFORM]    = custom::Oscillator::WAVE_POLYBLEP_SQUARE * 26;
+        controls[CTRL_OSC1PWMOD]       = 127;
+        controls[CTRL_FILTERRESONANCE] = 127;
+    }
+    if(s.stressors & STRESS_SYNC_NOISE)
+    {
+        controls[CTRL_OSC2SYNC]       = 127;
+        controls[CTRL_OSC2TUNECOARSE] = 100;
+        controls[CTRL_NOISE]          = 127;
+        controls[CTRL_NOISETYPE]      = custom::Noise::MODE_PINK * 64;
+    }
+}
+
+static uint8_t ChordNote(size_t chord, int n)
+{
+    return 36 + (chord * 7 + n * 5) % 60;
+}
+
+/** Events handled before the given block, after the scenario's preset is loaded.
+    Block 0 presses the first chord, which is held unless the scenario bursts.
+*/
+static void ScenarioEvents(const Scenario &s, size_t block, std::vector<MidiEvent> &out)
+{
+    out.clear();
+    if(block == 0)
+    {
+        for(int n = 0; n < NUM_VOICES; n++)
+        {
+            out.push_back({0x90, ChordNote(0, n), 100});
+        }
+    }
+    if((s.stressors & STRESS_NOTE_BURST) && block > 0 && block % BURST_BLOCKS == 0)
+    {
+        size_t chord = block / BURST_BLOCKS;
+        for(int n = 0; n < NUM_VOICES; n++)
+        {
+            out.push_back({0x80, ChordNote(chord - 1, n), 0});
+        }
+        for(int n = 0; n < NUM_VOICES; n++)
+        {
+            out.push_back({0x90, ChordNote(chord, n), (uint8_t)(60 + n * 5)});
+        }
+    }
+    if(s.stressors & STRESS_ENV_SWEEP)
+    {
+        //Triangle over 254 blocks, every time control a little apart so none repeats its value
+        for(size_t i = 0; i < sizeof(kEnvelopeTimes); i++)
+        {
+            size_t step = (block + i * 21) % 254;
+            out.push_back({0xB0, kEnvelopeTimes[i], (uint8_t)(step < 127 ? step : 253 - step)});
+        }
+    }
+}
+
+static void HandleEvent(Engine &engine, const MidiEvent &e)
+{
+    switch(e.status & 0xF0)
+    {
+        case 0x90:
+            if(e.data2 != 0)
+            {
+                engine.NoteOn(e.data1, e.data2);
+                break;
+            }
+            //fall through
+        case 0x80: engine.NoteOff(e.data1, e.data2); break;
+        case 0xB0: engine.HandleControls(e.data2, e.data1, true); break;
+        default: break;
+    }
+}
+
+struct Result
+{
+    std::string name;
+    float       max, p9999, p99, mean;
+    double      max_us;
+    uint32_t    blocks, late;
+    uint8_t     voices; //Most voices active after a block
+};
+
+//Renders the scenario once, keeping the faster of each block's time and the one in times
+static void Render(Engine &engine, const Scenario &s, uint8_t oversample, std::vector<uint32_t> &times,
+                   uint8_t &voices)
+{
+    uint8_t controls[NUM_CONTROLS];
+    ScenarioControls(s, controls);
+    memcpy(engine.GetControls(), DefaultControls, NUM_CONTROLS);
+    engine.Init(SAMPLE_RATE, oversample);
+    engine.LoadPreset(controls);
+
+    std::vector<MidiEvent> events;
+    float                  buf[BLOCK_SIZE];
+    for(size_t block = 0; block < WARMUP_BLOCKS + times.size(); block++)
+    {
+        ScenarioEvents(s, block, events);
+        for(const MidiEvent &e : events)
+        {
+            HandleEvent(engine, e);
+        }
+        engine.Update();
+
+        auto start = std::chrono::steady_clock::now();
+        engine.ProcessBlock(buf, BLOCK_SIZE);
+        auto end = std::chrono::steady_clock::now();
+        if(block >= WARMUP_BLOCKS)
+        {
+            uint32_t ns = (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            uint32_t &t = times[block - WARMUP_BLOCKS];
+            t           = ns < t ? ns : t;
+        }
+        voices = std::max(voices, engine.NumActiveVoices());
+    }
+}
+
+static Result Run(Engine &engine, const Scenario &s, size_t blocks, int repeat, uint8_t oversample,
+                  const double deadline_ns)
+{
+    std::vector<uint32_t> times(blocks, UINT32_MAX);
+    uint8_t               voices = 0;
+    for(int i = 0; i < repeat; i++)
+    {
+        Render(engine, s, oversample, times, voices);
+    }
+    BlockStats stats;
+    stats.Init((uint32_t)deadline_ns);
+    for(uint32_t t : times)
+    {
+        stats.Add(t);
+    }
+
+    Result r;
+    r.name   = s.name;
+    r.max    = stats.MaxPercent();
+    r.p9999  = stats.Percentile(0.9999);
+    r.p99    = stats.Percentile(0.99);
+    r.mean   = stats.MeanPercent();
+    r.max_us = stats.MaxTicks() / 1e3;
+    r.blocks = stats.Count();
+    r.late   = stats.Late();
+    r.voices = voices;
+    return r;
+}
+
+//p99.99 per scenario name from a report written by an earlier run
+static bool ReadBaseline(const char *path, std::vector<std::pair<std::string, float>> &baseline)
+{
+    FILE *f = fopen(path, "r");
+    if(f == NULL)
+    {
+        return false;
+    }
+    char line[512];
+    while(fgets(line, sizeof(line), f))
+    {
+        const char *name = strstr(line, "{\"name\": \"");
+        const char *p    = strstr(line, "\"p9999_percent\": ");
+        const char *end  = name ? strchr(name + 10, '"') : NULL;
+        if(name && p && end)
+        {
+            baseline.push_back({std::string(name + 10, end), (float)atof(p + 17)});
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static int RunCorpus(float seconds, int repeat, const char *only, uint8_t oversample, const char *baseline_path,
+                     float tolerance)
+{
+    std::vector<std::pair<std::string, float>> baseline;
+    if(baseline_path && !ReadBaseline(baseline_path, baseline))
+    {
+        fprintf(stderr, "dualie-stress: could not read %s\n", baseline_path);
+        return 1;
+    }
+
+    static Engine engine;
+    const double  deadline_ns = BLOCK_SIZE * 1e9 / SAMPLE_RATE;
+    const size_t  blocks      = (size_t)(seconds * SAMPLE_RATE / BLOCK_SIZE);
+    Result        worst       = {"", 0.f, 0.f, 0.f, 0.f, 0.0, 0, 0, 0};
+    int           regressions = 0;
+    bool          first       = true;
+    printf("{\"sample_rate\": %d, \"block_size\": %d, \"deadline_us\": %.1f, \"oversample\": %d, \"blocks\": %zu, "
+           "\"repeat\": %d, \"scenarios\": [\n",
+           (int)SAMPLE_RATE, BLOCK_SIZE, deadline_ns / 1e3, oversample, blocks, repeat);
+    for(const Scenario &s : Corpus())
+    {
+        if(only && s.name.find(only) == std::string::npos)
+        {
+            continue;
+        }
+        Result r = Run(engine, s, blocks, repeat, oversample, deadline_ns);
+        printf("%s  {\"name\": \"%s\", \"mean_percent\": %.2f, \"p99_percent\": %.2f, \"p9999_percent\": %.2f, "
+               "\"max_percent\": %.2f, \"max_us\": %.1f, \"late\": %u, \"voices\": %u",
+               first ? "" : ",\n", r.name.c_str(), r.mean, r.p99, r.p9999, r.max, r.max_us, r.late, r.voices);
+        for(const auto &b : baseline)
+        {
+            if(b.first == r.name)
+            {
+                bool regressed = r.p9999 > b.second + tolerance;
+                printf(", \"baseline_p9999_percent\": %.2f, \"regressed\": %s", b.second, regressed ? "true" : "false");
+                regressions += regressed;
+            }
+        }
+        printf("}");
+        fflush(stdout);
+        first = false;
+        if(r.p9999 > worst.p9999)
+        {
+            worst = r;
+        }
+    }
+    printf("\n], \"worst\": {\"name\": \"%s\", \"p9999_percent\": %.2f, \"max_percent\": %.2f}, \"regressions\": %d}\n",
+           worst.name.c_str(), worst.p9999, worst.max, regressions);
+    if(regressions)
+    {
+        fprintf(stderr, "dualie-stress: %d scenario(s) regressed by more than %.1f points\n", regressions, tolerance);
+    }
+    return regressions ? 1 : 0;
+}
+
+/* Export for the Seed */
+
+static void PutVarLen(std::vector<uint8_t> &out, uint32_t v)
+{
+    uint8_t bytes[5];
+    int     n = 0;
+    do
+    {
+        bytes[n++] = v & 0x7F;
+        v >>= 7;
+    } while(v);
+    while(n--)
+    {
+        out.push_back(bytes[n] | (n ? 0x80 : 0));
+    }
+}
+
+/** Standard MIDI file with one track. At 60 BPM and 3000 ticks per quarter note a tick is
+    one 16 sample block at 48 kHz, so every event lands before the block it was made for.
+*/
+static bool WriteMidiFile(const char *path, const Scenario &s, uint8_t program, size_t blocks)
+{
+    std::vector<uint8_t>   track = {0x00, 0xFF, 0x51, 0x03, 0x0F, 0x42, 0x40, 0x00, 0xC0, program};
+    std::vector<MidiEvent> events;
+    uint32_t               delta = 0;
+    for(size_t block = 0; block < blocks; block++)
+    {
+        ScenarioEvents(s, block, events);
+        for(const MidiEvent &e : events)
+        {
+            PutVarLen(track, delta);
+            track.push_back(e.status);
+            track.push_back(e.data1);
+            track.push_back(e.data2);
+            delta = 0;
+        }
+        delta++;
+    }
+    //Release whatever still sounds
+    for(int n = 0; n < NUM_VOICES; n++)
+    {
+        size_t chord = (s.stressors & STRESS_NOTE_BURST) ? (blocks - 1) / BURST_BLOCKS : 0;
+        PutVarLen(track, delta);
+        track.push_back(0x80);
+        track.push_back(ChordNote(chord, n));
+        track.push_back(0);
+        delta = 0;
+    }
+    const uint8_t end[] = {0x00, 0xFF, 0x2F, 0x00};
+    track.insert(track.end(), end, end + sizeof(end));
+
+    FILE *f = fopen(path, "wb");
+    if(f == NULL)
+    {
+        return false;
+    }
+    const uint8_t header[] = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 3000 >> 8, 3000 & 0xFF, 'M', 'T', 'r', 'k',
+                              (uint8_t)(track.size() >> 24), (uint8_t)(track.size() >> 16),
+                              (uint8_t)(track.size() >> 8), (uint8_t)track.size()};
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1 && fwrite(track.data(), track.size(), 1, f) == 1;
+    return fclose(f) == 0 && ok;
+}
+
+static int Export(const char *dir, float seconds)
+{
+    std::vector<Scenario> corpus = Corpus();
+    std::string           csv_path = std::string(dir) + "/stress.csv";
+    FILE                 *csv      = fopen(csv_path.c_str(), "w");
+    if(csv == NULL || corpus.size() > PRESET_MAX_COUNT)
+    {
+        fprintf(stderr, "dualie-stress: could not write %s\n", csv_path.c_str());
+        return 1;
+    }
+    fprintf(csv, "NAME");
+    for(int i = 0; i < NUM_CONTROLS; i++)
+    {
+        fprintf(csv, ", %s", PresetControlName(i));
+    }
+    fprintf(csv, "\n");
+
+    const size_t blocks  = (size_t)(seconds * SAMPLE_RATE / BLOCK_SIZE);
+    unsigned     clamped = 0;
+    for(size_t program = 0; program < corpus.size(); program++)
+    {
+        const Scenario &s = corpus[program];
+        uint8_t         controls[NUM_CONTROLS];
+        ScenarioControls(s, controls);
+        fprintf(csv, "%s", s.name.c_str());
+        for(int i = 0; i < NUM_CONTROLS; i++)
+        {
+            clamped += controls[i] > 127;
+            fprintf(csv, ", %u", controls[i] > 127 ? 127 : controls[i]);
+        }
+        fprintf(csv, "\n");
+
+        std::string file = s.name;
+        for(char &c : file)
+        {
+            c = c == '/' || c == '+' ? '_' : c;
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%02zu_%s.mid", dir, program, file.c_str());
+        if(!WriteMidiFile(path, s, (uint8_t)program, blocks))
+        {
+            fprintf(stderr, "dualie-stress: could not write %s\n", path);
+            fclose(csv);
+            return 1;
+        }
+    }
+    fclose(csv);
+    fprintf(stderr, "{\"scenarios\": %zu, \"seconds\": %.1f, \"presets\": \"%s\", \"clamped_controls\": %u}\n",
+            corpus.size(), seconds, csv_path.c_str(), clamped);
+    return 0;
+}
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: dualie-stress [run] [--seconds S] [--repeat N] [--only SUBSTRING] [--oversample 1|2]\n"
+            "                     [--baseline REPORT] [--tolerance POINTS]\n"
+            "       dualie-stress export DIR [--seconds S]\n");
+}
+
+int main(int argc, char **argv)
+{
+    int         i          = 1;
+    const char *export_dir = NULL;
+    if(i < argc && !strcmp(argv[i], "run"))
+    {
+        i++;
+    }
+    else if(i < argc && !strcmp(argv[i], "export"))
+    {
+        if(i + 1 >= argc)
+        {
+            Usage();
+            return 2;
+        }
+        export_dir = argv[i + 1];
+        i += 2;
+    }
+
+    float       seconds    = 5.f;
+    int         repeat     = 3;
+    const char *only       = NULL;
+    int         oversample = 1;
+    const char *baseline   = NULL;
+    float       tolerance  = 1.f;
+    for(; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--seconds") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--repeat") && i + 1 < argc && !export_dir)
+            repeat = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--only") && i + 1 < argc && !export_dir)
+            only = argv[++i];
+        else if(!strcmp(argv[i], "--oversample") && i + 1 < argc && !export_dir)
+            oversample = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--baseline") && i + 1 < argc && !export_dir)
+            baseline = argv[++i];
+        else if(!strcmp(argv[i], "--tolerance") && i + 1 < argc && !export_dir)
+            tolerance = atof(argv[++i]);
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+    if(seconds <= 0.f || repeat < 1 || (oversample != 1 && oversample != 2))
+    {
+        Usage();
+        return 2;
+    }
+
+    if(export_dir)
+    {
+        return Export(export_dir, seconds);
+    }
+    EnableFlushToZero();
+    return RunCorpus(seconds, repeat, only, (uint8_t)oversample, baseline, tolerance);
+}
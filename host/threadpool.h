@@ -0,0 +1,217 @@
+//Work stealing thread pool for the host renderers. Not used by the firmware.
+#pragma once
+#ifndef DUALIE_HOST_THREADPOOL_H
+#define DUALIE_HOST_THREADPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define THREADPOOL_PAUSE() _mm_pause()
+#else
+#define THREADPOOL_PAUSE() std::this_thread::yield()
+#endif
+
+//Spins before an idle worker blocks, long enough to bridge the gap between two audio blocks
+#define THREADPOOL_SPINS 4000
+
+/** Runs batches of independent tasks on a fixed set of threads, the calling thread included.
+
+    Each thread starts a batch with an equal contiguous range of task indices and takes them
+    from the front. A thread that runs dry steals the back half of the largest range left, so
+    uneven tasks still finish together. Which thread runs a task is not deterministic, callers
+    that need reproducible results give every task its own output and combine them in order.
+*/
+class ThreadPool
+{
+  public:
+    /** threads counts the caller, so 1 runs everything inline. thread_init runs once on every
+        worker before its first task, e.g. to set the FPU mode.
+    */
+    explicit ThreadPool(size_t threads, void (*thread_init)() = NULL)
+    : ranges_(threads < 1 ? 1 : threads), generation_(0), task_(NULL), completed_(0), exit_(false)
+    {
+        for(size_t t = 1; t < ranges_.size(); t++)
+        {
+            workers_.emplace_back([this, t, thread_init] {
+                if(thread_init)
+                {
+                    thread_init();
+                }
+                WorkerLoop(t);
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            exit_.store(true, std::memory_order_relaxed);
+            generation_.fetch_add(1, std::memory_order_release);
+        }
+        wake_.notify_all();
+        for(auto &w : workers_)
+        {
+            w.join();
+        }
+    }
+
+    size_t GetNumThreads() const { return ranges_.size(); }
+
+    /** Calls task(i) for every i below num_tasks and returns once all of them are done.
+        Writes made by the tasks are visible to the caller afterwards.
+    */
+    void Run(size_t num_tasks, const std::function<void(size_t)> &task)
+    {
+        size_t threads = ranges_.size();
+        task_          = &task;
+        completed_.store(0, std::memory_order_relaxed);
+        for(size_t t = 0; t < threads; t++)
+        {
+            //Release, so a worker still leaving the previous batch that finds these tasks also sees task_
+            ranges_[t].value.store(Pack(num_tasks * t / threads, num_tasks * (t + 1) / threads),
+                                   std::memory_order_release);
+        }
+        if(threads > 1)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                generation_.fetch_add(1, std::memory_order_release);
+            }
+            wake_.notify_all();
+        }
+
+        Work(0);
+        //Only tasks already taken by other threads are left, yield if they take long
+        for(int spins = 0; completed_.load(std::memory_order_acquire) < num_tasks; spins++)
+        {
+            if(spins < THREADPOOL_SPINS)
+            {
+                THREADPOOL_PAUSE();
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+  private:
+    //Begin in the low half and end in the high half, so a range changes with one compare-and-swap
+    struct alignas(64) Range
+    {
+        std::atomic<uint64_t> value{0};
+    };
+
+    static uint64_t Pack(uint64_t begin, uint64_t end) { return begin | end << 32; }
+    static uint32_t Begin(uint64_t r) { return (uint32_t)r; }
+    static uint32_t End(uint64_t r) { return (uint32_t)(r >> 32); }
+
+    void WorkerLoop(size_t self)
+    {
+        uint64_t seen = 0;
+        for(;;)
+        {
+            //Spin for the next batch first, blocking costs more than a block of audio takes
+            int spins = 0;
+            while(generation_.load(std::memory_order_acquire) == seen && spins++ < THREADPOOL_SPINS)
+            {
+                THREADPOOL_PAUSE();
+            }
+            if(generation_.load(std::memory_order_acquire) == seen)
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return generation_.load(std::memory_order_acquire) != seen; });
+            }
+            seen = generation_.load(std::memory_order_acquire);
+            if(exit_.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+            Work(self);
+        }
+    }
+
+    void Work(size_t self)
+    {
+        size_t done = 0;
+        for(;;)
+        {
+            uint32_t task;
+            if(PopFront(self, task) || Steal(self, task))
+            {
+                (*task_)(task);
+                done++;
+                continue;
+            }
+            break;
+        }
+        completed_.fetch_add(done, std::memory_order_release);
+    }
+
+    bool PopFront(size_t self, uint32_t &task)
+    {
+        std::atomic<uint64_t> &range = ranges_[self].value;
+        uint64_t               r     = range.load(std::memory_order_acquire);
+        while(Begin(r) < End(r))
+        {
+            if(range.compare_exchange_weak(r, Pack(Begin(r) + 1, End(r)), std::memory_order_acq_rel))
+            {
+                task = Begin(r);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //Moves the back half of the largest other range into our own, which is empty at this point,
+    //and hands out its first task. Fails once every range is empty.
+    bool Steal(size_t self, uint32_t &task)
+    {
+        for(;;)
+        {
+            size_t   victim = self;
+            uint64_t best   = 0;
+            for(size_t t = 0; t < ranges_.size(); t++)
+            {
+                uint64_t r = ranges_[t].value.load(std::memory_order_acquire);
+                if(t != self && End(r) - Begin(r) > End(best) - Begin(best) && Begin(r) < End(r))
+                {
+                    victim = t;
+                    best   = r;
+                }
+            }
+            if(victim == self)
+            {
+                return false;
+            }
+            uint32_t take = (End(best) - Begin(best) + 1) / 2;
+            uint32_t from = End(best) - take;
+            if(ranges_[victim].value.compare_exchange_strong(best, Pack(Begin(best), from), std::memory_order_acq_rel))
+            {
+                ranges_[self].value.store(Pack(from + 1, End(best)), std::memory_order_release);
+                task = from;
+                return true;
+            }
+        }
+    }
+
+    std::vector<Range>                     ranges_;
+    std::vector<std::thread>               workers_;
+    std::mutex                             mutex_;
+    std::condition_variable                wake_;
+    std::atomic<uint64_t>                  generation_;
+    const std::function<void(size_t)>     *task_;
+    std::atomic<size_t>                    completed_;
+    std::atomic<bool>                      exit_;
+};
+
+#endif
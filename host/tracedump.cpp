@@ -0,0 +1,292 @@
+//Chrome trace export of the engine's trace recorder (include/trace.h), open the output in
+//chrome://tracing or ui.perfetto.dev.
+//
+//  dualie-trace record [--seconds S] [--out FILE]
+//      Plays a dense scene through the engine built with DUALIE_TRACE=1: overlapping chords
+//      that run out of voices, cutoff sweeps, MIDI clock and crossfaded patch changes. Also
+//      prints the cost of one event as JSON on stderr.
+//  dualie-trace convert LOG [--out FILE]
+//      Converts the dumps a DUALIE_TRACE=1 firmware prints to the serial log after a late block.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <arm_math.h>
+
+#include "../include/main.h"
+#include "../include/engine.h"
+#include "../include/trace.h"
+#include "../include/denormal.h"
+
+#define SAMPLE_RATE 48000.f
+
+#if !DUALIE_TRACE
+#error "dualie-trace needs the engine built with DUALIE_TRACE=1"
+#endif
+
+//Names of the a and b fields in the exported args, NULL when unused
+static const char *const kArgNames[TRACE_NUM_TYPES][2] = {
+    {NULL, NULL},         {"voices", NULL},   {"note", "velocity"}, {"note", "velocity"},
+    {"note", "voice"},    {"note", NULL},     {"control", "value"}, {NULL, "crossfade"},
+    {"program", NULL},    {"bpm", NULL},      {NULL, "load_percent"},
+};
+
+static bool OnAudioThread(uint8_t type)
+{
+    return type == TRACE_BLOCK_BEGIN || type == TRACE_BLOCK_END || type == TRACE_PATCH_APPLY
+           || type == TRACE_TRIGGER;
+}
+
+/** Writes events in seq order as Chrome trace JSON. Blocks become slices on the audio thread,
+    everything else instant events. The 32 bit timestamps are unwrapped on the way.
+*/
+static void WriteChrome(FILE *f, const std::vector<TraceRecordCopy> &events, double ticks_per_second)
+{
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n"
+               "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"audio\"}},\n"
+               "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"main loop\"}}");
+    int64_t  time       = 0;
+    uint32_t last       = events.empty() ? 0 : events[0].time;
+    bool     block_open = false;
+    for(const TraceRecordCopy &e : events)
+    {
+        time += (int32_t)(e.time - last);
+        last = e.time;
+        if(e.type >= TRACE_NUM_TYPES || (e.type == TRACE_BLOCK_END && !block_open))
+        {
+            continue;
+        }
+        double ts = time * 1e6 / ticks_per_second;
+        if(e.type == TRACE_BLOCK_BEGIN || e.type == TRACE_BLOCK_END)
+        {
+            block_open = e.type == TRACE_BLOCK_BEGIN;
+            fprintf(f, ",\n  {\"name\": \"block\", \"ph\": \"%s\", \"ts\": %.3f, \"pid\": 1, \"tid\": 1",
+                    block_open ? "B" : "E", ts);
+        }
+        else
+        {
+            fprintf(f, ",\n  {\"name\": \"%s\", \"ph\": \"i\", \"s\": \"%s\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d",
+                    TraceTypeName(e.type), e.type == TRACE_TRIGGER ? "g" : "t", ts, OnAudioThread(e.type) ? 1 : 2);
+        }
+        const char *const *names = kArgNames[e.type];
+        if(names[0] || names[1])
+        {
+            fprintf(f, ", \"args\": {");
+            if(names[0])
+                fprintf(f, "\"%s\": %u%s", names[0], e.a, names[1] ? ", " : "");
+            if(names[1])
+                fprintf(f, "\"%s\": %u", names[1], e.b);
+            fprintf(f, "}");
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n]}\n");
+}
+
+//Moves the events recorded since the last call into out
+static void Drain(std::vector<TraceRecordCopy> &out, std::vector<TraceRecordCopy> &scratch, uint32_t &next_seq)
+{
+    size_t count = TraceSnapshot(scratch.data(), scratch.size());
+    for(size_t i = 0; i < count; i++)
+    {
+        if((int32_t)(scratch[i].seq - next_seq) >= 0)
+        {
+            out.push_back(scratch[i]);
+        }
+    }
+    if(count)
+    {
+        next_seq = scratch[count - 1].seq + 1;
+    }
+}
+
+//Ticks of TraceTimestamp per second, measured against the steady clock
+static double CalibrateTicks()
+{
+    auto     start       = std::chrono::steady_clock::now();
+    uint32_t start_ticks = TraceTimestamp();
+    while(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100))
+    {
+    }
+    uint32_t ticks = TraceTimestamp() - start_ticks;
+    auto     end   = std::chrono::steady_clock::now();
+    return ticks / std::chrono::duration<double>(end - start).count();
+}
+
+static int Record(float seconds, FILE *out)
+{
+    const int kEvents = 1 << 20;
+    double    ticks_per_second = CalibrateTicks();
+
+    //Cost of one event, the ring is cleared again before the scene
+    TraceInit();
+    uint32_t start = TraceTimestamp();
+    for(int i = 0; i < kEvents; i++)
+    {
+        TRACE(TRACE_CONTROL, i, i);
+    }
+    double ns = (uint32_t)(TraceTimestamp() - start) * 1e9 / ticks_per_second / kEvents;
+    fprintf(stderr, "{\"ticks_per_second\": %.0f, \"ns_per_event\": %.2f}\n", ticks_per_second, ns);
+
+    TraceInit();
+    EngineInit(SAMPLE_RATE);
+    uint8_t controls[NUM_CONTROLS];
+    memcpy(controls, DefaultControls, sizeof(controls));
+    controls[CTRL_OSC1WAVEFORM]     = 6 * 26;
+    controls[CTRL_OSC2WAVEFORM]     = 7 * 26;
+    controls[CTRL_FILTERRESONANCE]  = 80;
+    controls[CTRL_AMPRELEASE]       = 40;
+    EngineLoadPreset(controls, false);
+
+    std::vector<TraceRecordCopy> events, scratch(DUALIE_TRACE_SIZE);
+    uint32_t                     next_seq = 0;
+    float                        buf[BLOCK_SIZE];
+    const size_t                 blocks       = (size_t)(seconds * SAMPLE_RATE / BLOCK_SIZE);
+    const size_t                 chord_blocks = (size_t)(0.25f * SAMPLE_RATE / BLOCK_SIZE);
+    //MIDI clock at 120 BPM, in blocks
+    const float                  clock_blocks = SAMPLE_RATE / BLOCK_SIZE / 48.f;
+    float                        next_clock   = 0.f;
+    for(size_t block = 0; block < blocks; block++)
+    {
+        //A new four note chord every quarter second, each held for a second, so 16 notes overlap
+        if(block % chord_blocks == 0)
+        {
+            uint8_t root = 40 + (block / chord_blocks * 5) % 24;
+            for(int n = 0; n < 4; n++)
+            {
+                EngineNoteOn(root + n * 4, 90);
+            }
+        }
+        if(block % chord_blocks == 0 && block >= 4 * chord_blocks)
+        {
+            uint8_t root = 40 + ((block / chord_blocks - 4) * 5) % 24;
+            for(int n = 0; n < 4; n++)
+            {
+                EngineNoteOff(root + n * 4, 0);
+            }
+        }
+        //Cutoff sweep over the second half of every second, one CC per block
+        size_t in_second = block % (size_t)(SAMPLE_RATE / BLOCK_SIZE);
+        if(in_second * 2 >= SAMPLE_RATE / BLOCK_SIZE)
+        {
+            HandleControls(20 + in_second % 100, CTRL_FILTERCUTOFF, true);
+        }
+        if(block >= next_clock)
+        {
+            EngineClockTick((uint32_t)(block * BLOCK_SIZE * 1e6f / SAMPLE_RATE));
+            next_clock += clock_blocks;
+        }
+        //Crossfaded patch change every two seconds
+        if(block % (size_t)(2 * SAMPLE_RATE / BLOCK_SIZE) == 0 && block > 0)
+        {
+            controls[CTRL_FILTERRESONANCE] ^= 64;
+            EngineLoadPreset(controls, true);
+        }
+        EngineUpdate();
+        EngineProcessBlock(buf, BLOCK_SIZE);
+
+        //Far fewer than DUALIE_TRACE_SIZE events are recorded in 8 blocks
+        if(block % 8 == 7)
+        {
+            Drain(events, scratch, next_seq);
+        }
+    }
+    Drain(events, scratch, next_seq);
+
+    WriteChrome(out, events, ticks_per_second);
+    fprintf(stderr, "{\"blocks\": %zu, \"events\": %zu}\n", blocks, events.size());
+    return 0;
+}
+
+static int Convert(const char *log_path, FILE *out)
+{
+    FILE *in = fopen(log_path, "r");
+    if(in == NULL)
+    {
+        fprintf(stderr, "dualie-trace: could not open %s\n", log_path);
+        return 1;
+    }
+    std::vector<TraceRecordCopy> events;
+    double                       ticks_per_second = 0.0;
+    char                         line[256];
+    while(fgets(line, sizeof(line), in))
+    {
+        //The serial log may prefix lines, so the markers are searched for
+        unsigned long seq, time, hz, count;
+        unsigned      type, a, b;
+        const char   *p;
+        if((p = strstr(line, "TRACE ")) && sscanf(p, "TRACE %lu %lu", &hz, &count) == 2)
+        {
+            ticks_per_second = hz;
+        }
+        else if((p = strstr(line, "TR ")) && sscanf(p, "TR %lu %lu %u %u %u", &seq, &time, &type, &a, &b) == 5)
+        {
+            TraceRecordCopy e = {(uint32_t)seq, (uint32_t)time, (uint8_t)type, (uint8_t)a, (uint16_t)b};
+            events.push_back(e);
+        }
+    }
+    fclose(in);
+    if(ticks_per_second <= 0.0 || events.empty())
+    {
+        fprintf(stderr, "dualie-trace: no trace dump in %s\n", log_path);
+        return 1;
+    }
+    WriteChrome(out, events, ticks_per_second);
+    return 0;
+}
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: dualie-trace record [--seconds S] [--out FILE]\n"
+            "       dualie-trace convert LOG [--out FILE]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        Usage();
+        return 2;
+    }
+    bool        record   = !strcmp(argv[1], "record");
+    const char *log_path = NULL;
+    const char *out_path = NULL;
+    float       seconds  = 4.f;
+    int         i        = 2;
+    if(!record)
+    {
+        if(strcmp(argv[1], "convert") || argc < 3)
+        {
+            Usage();
+            return 2;
+        }
+        log_path = argv[i++];
+    }
+    for(; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--out") && i + 1 < argc)
+            out_path = argv[++i];
+        else if(!strcmp(argv[i], "--seconds") && i + 1 < argc && record)
+            seconds = atof(argv[++i]);
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if(out == NULL)
+    {
+        fprintf(stderr, "dualie-trace: could not write %s\n", out_path);
+        return 1;
+    }
+    EnableFlushToZero();
+    int result = record ? Record(seconds, out) : Convert(log_path, out);
+    if(out_path)
+        fclose(out);
+    return result;
+}
@@ -1,8 +1,12 @@
-//#pragma once
+#pragma once
 //#ifndef DSY_ADSR_H
 #define DSY_ADSR_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include "denormal.h"
+
 #ifdef __cplusplus
 
 namespace custom
@@ -22,6 +26,15 @@ enum
 };
 
 
+/** Coefficients derived from the segment times and sustain level.
+    Computing them is expensive (expf/logf), so they can be derived once and copied into many envelopes.
+*/
+struct AdsrCoeffs
+{
+    float attackD0, attackTarget, decayD0, releaseD0, susLevel;
+    float attackTime, attackShape, decayTime, releaseTime;
+};
+
 /** adsr envelope module
 
 Original author(s) : Paul Batchelor
@@ -67,10 +80,15 @@ class Adsr
     */
     inline void SetSustainLevel(float sus_level)
     {
-        sus_level = (sus_level <= 0.f) ? -0.01f // forces envelope into idle
+        //A sustain level too small to hear goes idle too, decay never settles on a denormal
+        sus_level = (sus_level < DENORMAL_THRESHOLD) ? -0.01f // forces envelope into idle
                                        : (sus_level > 1.f) ? 1.f : sus_level;
         sus_level_ = sus_level;
     }
+    /** Copies out the current coefficients */
+    void GetCoeffs(AdsrCoeffs &coeffs) const;
+    /** Replaces all coefficients at once without touching the envelope state */
+    void SetCoeffs(const AdsrCoeffs &coeffs);
     /** get the current envelope segment
         \return the segment of the envelope that the phase is currently located in.
     */
@@ -80,6 +98,17 @@ class Adsr
     */
     inline bool IsRunning() const { return mode_ != ADSR_SEG_IDLE; }
 
+    /** Tells whether the next block is constant for this gate: idle, or holding the sustain level
+        with the gate unchanged. Processing a steady envelope does not change its state.
+    */
+    inline bool IsSteady(bool gate) const
+    {
+        return gate == gate_ && (mode_ == ADSR_SEG_IDLE || (mode_ == ADSR_SEG_DECAY && x_ == sus_level_));
+    }
+
+    /** Current output value */
+    inline float GetValue() const { return mode_ == ADSR_SEG_IDLE ? 0.0f : x_; }
+
   private:
     float   sus_level_{0.f};
     float   x_{0.f};
@@ -0,0 +1,26 @@
+#pragma once
+#ifndef DUALIE_BLOCKSIGNAL_H
+#define DUALIE_BLOCKSIGNAL_H
+
+#include <stddef.h>
+
+namespace custom
+{
+/** Block rate input to a DSP kernel: either one value for the whole block or a buffer with one
+    value per sample. Kernels check IsConstant once per block and run a scalar inner loop for
+    constant inputs, skipping the buffer reads and any per sample coefficient work.
+*/
+struct BlockSignal
+{
+    const float *buf;   //NULL when constant
+    float        value; //Only valid when constant
+
+    static inline BlockSignal Constant(float v) { return {NULL, v}; }
+    static inline BlockSignal Block(const float *b) { return {b, 0.0f}; }
+
+    inline bool  IsConstant() const { return buf == NULL; }
+    inline float operator[](size_t i) const { return buf ? buf[i] : value; }
+};
+} // namespace custom
+
+#endif
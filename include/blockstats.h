@@ -0,0 +1,59 @@
+#pragma once
+#ifndef DUALIE_BLOCKSTATS_H
+#define DUALIE_BLOCKSTATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/** Distribution of block render times against the audio deadline. CpuLoadMeter averages the
+    load away, what glitches is the one block in ten thousand that runs late, so this keeps a
+    histogram in steps of 1/BLOCK_STATS_STEPS of the deadline and reports its tail.
+
+    Add is called by the audio side for every block, in any tick unit as long as the deadline
+    uses the same one. The report functions may run in another thread or the main loop, they
+    can miss the blocks added while they read.
+*/
+
+#define BLOCK_STATS_STEPS 400    //Buckets per deadline, 0.25 % each
+#define BLOCK_STATS_BUCKETS 1024 //Up to 256 % of the deadline, slower blocks land in the last
+
+class BlockStats
+{
+  public:
+    BlockStats() {}
+    ~BlockStats() {}
+
+    void Init(uint32_t deadline_ticks);
+
+    /** Clears the histogram, on the audio side with the next Add.
+    */
+    void Reset();
+
+    void Add(uint32_t ticks);
+
+    inline uint32_t Count() const { return count_; }
+    inline uint32_t Late() const { return late_; }
+    inline uint32_t MaxTicks() const { return max_; }
+    inline uint32_t Deadline() const { return deadline_; }
+
+    float MaxPercent() const;
+    float MeanPercent() const;
+
+    /** Block time in percent of the deadline that fraction (0-1) of the blocks stayed within,
+        the upper edge of its bucket. 0.9999 gives the 99.99th percentile.
+    */
+    float Percentile(double fraction) const;
+
+  private:
+    void Clear();
+
+    uint32_t          buckets_[BLOCK_STATS_BUCKETS];
+    uint32_t          deadline_;
+    float             scale_; //Buckets per tick
+    uint32_t          count_, late_, max_;
+    uint64_t          sum_;
+    std::atomic<bool> reset_;
+};
+
+#endif
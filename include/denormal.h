@@ -0,0 +1,59 @@
+#pragma once
+#ifndef DUALIE_DENORMAL_H
+#define DUALIE_DENORMAL_H
+
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#include <pmmintrin.h>
+#elif defined(STM32H750xx)
+#include <stm32h7xx.h>
+#endif
+
+/** State below this magnitude is treated as silence. Far above the smallest normal
+    float (1.2e-38), so decaying filter and envelope state is cleared long before it
+    becomes denormal, with or without flush-to-zero.
+*/
+#define DENORMAL_THRESHOLD 1e-15f
+
+static inline float FlushDenormal(float x)
+{
+    return fabsf(x) < DENORMAL_THRESHOLD ? 0.f : x;
+}
+
+/** Makes the FPU flush denormal results and inputs to zero for the calling thread.
+    - x86: FTZ and DAZ in MXCSR
+    - aarch64: FZ in FPCR
+    - Seed: FZ in FPSCR, and in FPDSCR which FPSCR is loaded from on exception entry,
+      so the audio interrupt runs with it as well
+    Host renderers must call this on every thread that renders audio.
+*/
+static inline void EnableFlushToZero(bool enable = true)
+{
+#if defined(__SSE__) || defined(_M_X64)
+    _MM_SET_FLUSH_ZERO_MODE(enable ? _MM_FLUSH_ZERO_ON : _MM_FLUSH_ZERO_OFF);
+    _MM_SET_DENORMALS_ZERO_MODE(enable ? _MM_DENORMALS_ZERO_ON : _MM_DENORMALS_ZERO_OFF);
+#elif defined(__aarch64__)
+    uint64_t fpcr;
+    __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+    fpcr = enable ? (fpcr | (1ull << 24)) : (fpcr & ~(1ull << 24));
+    __asm__ volatile("msr fpcr, %0" : : "r"(fpcr));
+#elif defined(STM32H750xx)
+    if(enable)
+    {
+        FPU->FPDSCR |= FPU_FPDSCR_FZ_Msk;
+        __set_FPSCR(__get_FPSCR() | FPU_FPDSCR_FZ_Msk);
+    }
+    else
+    {
+        FPU->FPDSCR &= ~FPU_FPDSCR_FZ_Msk;
+        __set_FPSCR(__get_FPSCR() & ~FPU_FPDSCR_FZ_Msk);
+    }
+#else
+    (void)enable;
+#endif
+}
+
+#endif
@@ -0,0 +1,91 @@
+/* C interface of the Dualie engine for embedding it in other programs, built as libdualie.so
+   by host/Makefile. Every instance is a complete synth with its own voices, patch and clock,
+   so any number of them can run side by side in one process.
+
+   Only plain C types cross this interface. Structures are only ever extended at the end and
+   DUALIE_API_VERSION changes when an existing declaration does. */
+#pragma once
+#ifndef DUALIE_H
+#define DUALIE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define DUALIE_API __attribute__((visibility("default")))
+#else
+#define DUALIE_API
+#endif
+
+#define DUALIE_API_VERSION 1
+
+/* Control rate of the engine in frames. Events take effect at the start of a block. */
+#define DUALIE_BLOCK_SIZE 16
+
+/* Number of controls, see the CTRL_* values in include/main.h */
+#define DUALIE_NUM_CONTROLS 39
+
+typedef struct DualieInstance DualieInstance;
+
+enum
+{
+    DUALIE_EVENT_NOTE_ON,  /* data1 note, data2 velocity, velocity 0 releases the note */
+    DUALIE_EVENT_NOTE_OFF, /* data1 note, data2 velocity */
+    DUALIE_EVENT_CONTROL,  /* data1 control, data2 value 0-127 */
+    DUALIE_EVENT_CLOCK,    /* MIDI timing clock, 24 per quarter note */
+    DUALIE_EVENT_START,    /* MIDI start, the next clock is the downbeat */
+};
+
+typedef struct
+{
+    uint32_t frame; /* Offset from the first frame of the next dualie_render call */
+    uint8_t  type;  /* DUALIE_EVENT_* */
+    uint8_t  data1;
+    uint8_t  data2;
+    uint8_t  reserved;
+} DualieEvent;
+
+/* DUALIE_API_VERSION of the library, to be compared with the one compiled against. */
+DUALIE_API uint32_t dualie_api_version(void);
+
+/* Creates an instance playing the default patch. event_capacity is the number of events that
+   can wait for their frame at a time. All memory is allocated here, NULL if that fails. */
+DUALIE_API DualieInstance *dualie_create(float sample_rate, uint32_t event_capacity);
+
+DUALIE_API void dualie_destroy(DualieInstance *instance);
+
+/* Queues events for the following renders, they need not be sorted. An event takes effect at
+   the start of the block that contains its frame, or of the next block if that block was
+   already rendered by a call that ended inside it. Events with the same frame keep their order,
+   and notes that start in the same block each get a voice of their own.
+   Returns how many events were queued, the rest did not fit. */
+DUALIE_API uint32_t dualie_push_events(DualieInstance *instance, const DualieEvent *events, uint32_t count);
+
+/* Renders frames of audio, at the level of the Seed's output, into left, and copies it into
+   right unless that is NULL. Blocks are rendered straight into left, only the ends of calls
+   that do not line up with DUALIE_BLOCK_SIZE go through the instance. Denormals are flushed
+   for the duration of the call. */
+DUALIE_API void dualie_render(DualieInstance *instance, float *left, float *right, uint32_t frames);
+
+/* Replaces all DUALIE_NUM_CONTROLS controls at the start of the next block. With crossfade,
+   continuous settings glide there over a few milliseconds. */
+DUALIE_API void dualie_load_controls(DualieInstance *instance, const uint8_t *controls, int crossfade);
+
+/* Current value of a control including queued events that have taken effect, -1 for an
+   unknown control. */
+DUALIE_API int dualie_get_control(const DualieInstance *instance, int control);
+
+/* Name of a control as used in etc/presets.csv, e.g. "CTRL_FILTERCUTOFF", NULL if unknown. */
+DUALIE_API const char *dualie_control_name(int control);
+
+/* Voices currently sounding. */
+DUALIE_API uint32_t dualie_active_voices(DualieInstance *instance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
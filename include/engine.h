@@ -0,0 +1,211 @@
+#pragma once
+#ifndef DUALIE_ENGINE_H
+#define DUALIE_ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include "main.h"
+#include "patch.h"
+#include "lfo.h"
+#include "voicemanager.h"
+
+/** Synth engine shared by the firmware and the host tools.
+    Owns the voices, the LFOs and the control panels, but no hardware.
+*/
+
+//Blocks over which continuous settings glide after a crossfaded patch change
+#define PATCH_CROSSFADE_BLOCKS 32
+
+//Oversampling of the voice audio path, 1 or 2. Pick it with the engine_*_os2 scenarios of host/bench
+#ifndef DUALIE_VOICE_OVERSAMPLE
+#define DUALIE_VOICE_OVERSAMPLE 1
+#endif
+
+//Notes on their way from the main loop to the voices, a power of two
+#ifndef DUALIE_NOTE_QUEUE_SIZE
+#define DUALIE_NOTE_QUEUE_SIZE 64
+#endif
+
+//Midi control values (0-127), one per control
+typedef uint8_t ControlValues[NUM_CONTROLS];
+
+/** Control changes since Init. Changes to one control between two published patches reach
+    the voices as one, received - applied is the number coalesced away.
+*/
+struct ControlStats
+{
+    uint32_t received; //HandleControls calls with a valid control
+    uint32_t applied;  //Controls that changed value in a published patch, summed over patches
+    uint32_t patches;  //Patches published by Update, at most one per block
+};
+
+/** Control values every engine starts from.
+*/
+extern const ControlValues DefaultControls;
+
+/** One complete instance of the synth. The firmware runs a single one through the Engine*
+    functions below, hosts that embed the synth create as many as they need.
+
+    The main loop side (NoteOn, NoteOff, HandleControls, Update, LoadPreset, ClockTick) and the
+    audio side (ProcessBlock) may run on different threads. Only the audio side touches the voices:
+    every note is queued and starts at the beginning of the next block. Notes and controls take
+    effect in the order they were sent, a note sent after controls that are not active yet waits
+    for the block that makes the patch holding them active.
+*/
+class Engine
+{
+  public:
+    Engine();
+    ~Engine() {}
+
+    /** With oversample 2 every voice renders at twice the sample rate and the mix is decimated once.
+        Only ProcessBlock supports oversampling.
+    */
+    void Init(float sample_rate, uint8_t oversample = DUALIE_VOICE_OVERSAMPLE);
+
+    float Process();
+
+    /** Renders size (BLOCK_SIZE) mono samples into buf, overwriting its contents.
+    */
+    void ProcessBlock(float *buf, size_t size);
+
+    /** Call from the main loop side. A full queue drops a note on, like a note without a free
+        voice. A note off is never dropped, it waits until the queue has room again.
+    */
+    void    NoteOn(uint8_t note, uint8_t velocity);
+    void    NoteOff(uint8_t note, uint8_t velocity);
+    uint8_t NumActiveVoices();
+
+    /** Prepares the inactive patch snapshot from the control panel and publishes it, the audio
+        side makes it active at the start of the next block. Call from the main loop.
+        Returns false without blocking if the previous snapshot has not been taken yet,
+        the changes stay queued for the next call. Only the controls changed since the last
+        published patch are converted again.
+    */
+    bool Update();
+
+    /** Replaces every control at once and publishes the result. With crossfade, continuous
+        settings glide over PATCH_CROSSFADE_BLOCKS instead of jumping.
+    */
+    void LoadPreset(const uint8_t *controls, bool crossfade = false);
+
+    /** MIDI clock input, call from the main loop. Tick for every timing clock (0xF8) with its
+        arrival time in microseconds, Start for 0xFA. Tempo synced LFOs lock to the estimated
+        tempo and keep running at the last one when the clock stops.
+    */
+    void ClockTick(uint32_t time_us);
+    void ClockStart();
+
+    /** Estimated clock tempo in BPM, 0 before a clock has been seen.
+    */
+    float Tempo() const;
+
+    /** Changes one control. midiCC sets the absolute value, otherwise ctrlValue is added as
+        an increment. Takes effect with the next Update, so a burst of changes to one control
+        costs no more than the last of them.
+    */
+    void HandleControls(int ctrlValue, int param, bool midiCC);
+
+    inline ControlStats GetControlStats() const { return control_stats_; }
+
+    /** Control values as edited by the main loop. Changes reach the voices through Update,
+        the audio side never reads them directly.
+    */
+    inline ControlValues       &GetControls() { return controls_; }
+    inline const ControlValues &GetControls() const { return controls_; }
+
+  private:
+    struct QueuedNote
+    {
+        uint8_t note, velocity;
+        bool    on;
+    };
+
+    void         QueueNote(uint8_t note, uint8_t velocity, bool on);
+    void         WriteNote(uint8_t note, uint8_t velocity, bool on);
+    bool         FlushReleases();
+    void         PlayNotes(uint32_t released);
+    void         ActivatePatch(const Patch &patch);
+    void         ProcessLfos(const Patch &patch, size_t size, uint32_t sources);
+    const float *SwapPatch();
+
+    VoiceManager<NUM_VOICES> mgr_;
+    float                    sample_rate_;
+    ControlValues            controls_;
+
+    //Control rate LFOs, computed once per block before the voices. The per sample path
+    //reads through the last block one sample at a time.
+    custom::Lfo lfos_[NUM_LFOS];
+    float       lfo_out_[NUM_LFOS][BLOCK_SIZE];
+    size_t      lfo_sample_;
+
+    //MIDI clock. The estimator runs in the main loop, the audio side picks up the tick rate
+    //and the position of the latest tick once per block.
+    custom::TempoEstimator tempo_;
+    std::atomic<float>     clock_tick_rate_;
+    std::atomic<uint32_t>  clock_position_;
+    std::atomic<uint32_t>  clock_count_;
+    uint32_t               clock_count_seen_;
+    uint32_t               clock_position_seen_;
+
+    //Two complete snapshots of the patch. The audio side renders from active_patch_ while the
+    //main loop prepares the other one, which is published through pending_patch_ and becomes
+    //active with a single pointer flip at the start of a block.
+    Patch                patches_[2];
+    std::atomic<Patch *> active_patch_;
+    std::atomic<Patch *> pending_patch_;
+
+    //Main loop state: controls that differ from the active patch and still have to be published
+    uint64_t     controls_changed_;
+    bool         patch_crossfade_;
+    ControlStats control_stats_;
+
+    //Notes in the order they were sent. The main loop writes them and releases them right away,
+    //or with the patch that holds the controls sent before them, the audio side plays the
+    //released ones at the start of a block after making that patch active.
+    QueuedNote            notes_[DUALIE_NOTE_QUEUE_SIZE];
+    uint32_t              notes_written_;
+    uint32_t              release_mask_[4]; //Main loop: note offs that found the queue full
+    std::atomic<uint32_t> notes_released_;
+    std::atomic<uint32_t> notes_played_;
+
+    //Audio side state for the optional crossfade of continuous values after a flip
+    std::atomic<bool> pending_crossfade_;
+    float             fade_from_[NUM_CONTROLS];
+    float             fade_values_[NUM_CONTROLS];
+    int               fade_block_;
+};
+
+/* The firmware's engine, a single instance shared by the audio callback and the main loop. */
+
+//Control values of the firmware's engine as edited by the main loop
+extern ControlValues &ControlPanel;
+
+void EngineInit(float sample_rate, uint8_t oversample = DUALIE_VOICE_OVERSAMPLE);
+
+float EngineProcess();
+
+/** Renders size (BLOCK_SIZE) mono samples into buf, overwriting its contents.
+*/
+void EngineProcessBlock(float *buf, size_t size);
+
+void EngineNoteOn(uint8_t note, uint8_t velocity);
+void EngineNoteOff(uint8_t note, uint8_t velocity);
+uint8_t EngineNumActiveVoices();
+
+bool EngineUpdate();
+
+void EngineLoadPreset(const uint8_t *controls, bool crossfade = false);
+
+void EngineClockTick(uint32_t time_us);
+void EngineClockStart();
+
+float EngineTempo();
+
+void HandleControls(int ctrlValue, int param, bool midiCC);
+
+ControlStats EngineGetControlStats();
+
+#endif
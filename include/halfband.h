@@ -0,0 +1,43 @@
+#pragma once
+#ifndef DUALIE_HALFBAND_H
+#define DUALIE_HALFBAND_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "main.h"
+
+//Nonzero coefficient pairs, the filter has 4 * HALFBAND_PAIRS - 1 taps
+#define HALFBAND_PAIRS 12
+//Input samples needed before the first output, half the filter length
+#define HALFBAND_DELAY (2 * HALFBAND_PAIRS - 1)
+
+namespace custom
+{
+/** Decimates a 2x oversampled signal back to the base rate through a 47 tap half-band FIR
+    (Kaiser windowed, -0.1 dB at 20 kHz, below -80 dB from 30 kHz at 48 kHz out).
+
+    Every other coefficient of a half-band filter is zero apart from the center tap, so the
+    even input phase only meets the center (0.5) and the odd phase the symmetric pairs.
+    Only the output samples that are kept get computed, which costs HALFBAND_PAIRS multiplies
+    per output sample.
+*/
+class HalfbandDecimator
+{
+  public:
+    HalfbandDecimator() {}
+    ~HalfbandDecimator() {}
+
+    void Init();
+
+    /** Reads 2 * size samples from in and writes size samples to out, size is at most BLOCK_SIZE.
+    */
+    void Process(const float *in, float *out, size_t size);
+
+  private:
+    //Previous input followed by the current block
+    float history_[2 * HALFBAND_DELAY + 2 * BLOCK_SIZE];
+};
+} // namespace custom
+
+#endif
@@ -0,0 +1,115 @@
+#pragma once
+#ifndef DUALIE_LFO_H
+#define DUALIE_LFO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace custom
+{
+/** Low frequency oscillator running at control rate. The waveform is evaluated once per block
+    and the output ramps linearly towards it across the block, so a block of modulation costs
+    one waveform evaluation instead of a full oscillator pass.
+*/
+class Lfo
+{
+  public:
+    Lfo() {}
+    ~Lfo() {}
+
+    /** Same shapes and order as the first five custom::Oscillator waveforms.
+    */
+    enum
+    {
+        WAVE_SIN,
+        WAVE_TRI,
+        WAVE_SAW,
+        WAVE_RAMP,
+        WAVE_SQUARE,
+        WAVE_LAST,
+    };
+
+    /** \param block_rate - number of ProcessBlock calls per second (sample rate / block size).
+    */
+    void Init(float block_rate);
+
+    inline void SetWaveform(const uint8_t wf) { waveform_ = wf < WAVE_LAST ? wf : WAVE_SIN; }
+
+    /** Sets the rate in Hz.
+    */
+    inline void SetFreq(const float f) { inc_ = f * block_recip_; }
+
+    /** Jumps to a phase in cycles (0-1), the next block ramps from the current output.
+    */
+    inline void Reset(float phase = 0.0f) { phase_ = phase; }
+
+    /** Moves the phase a fraction (0-1) of the way to target (0-1), going the shorter way around.
+        Used to keep a tempo synced LFO locked to the clock without audible jumps.
+    */
+    void Nudge(float target, float amount);
+
+    inline float GetPhase() const { return phase_; }
+
+    /** Advances one block and writes size samples ending on the new waveform value.
+    */
+    void ProcessBlock(float *buf, size_t size);
+
+    /** Advances one block and returns the new waveform value.
+    */
+    float Process();
+
+    /** Advances one block without evaluating the waveform, for an LFO that nothing is routed
+        from. The phase stays where a processed one would be, the next ProcessBlock ramps from
+        the last value it wrote.
+    */
+    inline void Skip()
+    {
+        phase_ += inc_;
+        phase_ -= phase_ >= 1.0f ? 1.0f : 0.0f;
+    }
+
+  private:
+    float   Evaluate(float phase) const;
+    uint8_t waveform_;
+    float   block_recip_, phase_, inc_, last_;
+};
+
+/** Tempo of an incoming MIDI clock (24 ticks per quarter note). Arrival times are taken in the
+    main loop and jitter by the loop period, so the tick interval goes through a median of three
+    and a one pole smoother. Intervals far from the estimate are dropped as glitches, several in
+    a row are taken as a real tempo change and restart the estimate.
+*/
+class TempoEstimator
+{
+  public:
+    TempoEstimator() {}
+    ~TempoEstimator() {}
+
+    void Init();
+
+    /** Records a clock tick (0xF8) received at time_us, any free running microsecond counter.
+    */
+    void Tick(uint32_t time_us);
+
+    /** Start (0xFA) resets the song position, the next tick is the downbeat.
+    */
+    void Start();
+
+    /** Ticks per second, 0 until enough ticks have arrived.
+    */
+    inline float GetTickRate() const { return period_us_ > 0.0f ? 1e6f / period_us_ : 0.0f; }
+
+    /** Position of the last tick in ticks since Start.
+    */
+    inline uint32_t GetPosition() const { return position_; }
+
+  private:
+    uint32_t last_us_, position_;
+    uint32_t intervals_[3];
+    uint8_t  next_interval_, num_intervals_, outliers_;
+    float    period_us_;
+    bool     started_, has_last_;
+};
+} // namespace custom
+
+#endif
@@ -0,0 +1,143 @@
+#pragma once
+#ifndef DUALIE_LOG_H
+#define DUALIE_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/** Diagnostics that never hold up the caller. LOG() stores the format string and up to
+    LOG_MAX_ARGS raw arguments in a fixed ring, formatting and the blocking serial write happen
+    later in LogFlush, which the main loop calls when there is nothing else to do.
+
+    - The format must be a string literal and %s arguments must outlive the record, only the
+      pointers are kept
+    - Conversions: %d %i %u %x %X %c %s %f %%, with flags '-' and '0', width and precision.
+      %f is formatted here, it does not need printf float support, magnitudes from 1e19 print as inf
+    - A full ring drops the new record, LogFlush writes at most the configured lines per second.
+      Every drop is counted and reported in the log itself
+*/
+
+#ifndef DUALIE_LOG_SIZE
+#define DUALIE_LOG_SIZE 64 //Records, a power of two
+#endif
+
+#define LOG_MAX_ARGS 4
+#define LOG_LINE_LENGTH 96
+
+enum LogArgType : uint8_t
+{
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_FLOAT,
+    LOG_ARG_STRING,
+};
+
+struct LogArg
+{
+    uint8_t type;
+    union
+    {
+        int32_t     i;
+        uint32_t    u;
+        float       f;
+        const char *s;
+    };
+};
+
+struct LogRecord
+{
+    const char           *format;
+    LogArg                args[LOG_MAX_ARGS];
+    uint8_t               num_args;
+    std::atomic<uint32_t> seq; //Written last, UINT32_MAX while the slot is being filled
+};
+
+struct LogStats
+{
+    uint32_t recorded; //Taken into the ring
+    uint32_t written;  //Lines handed to the sink, drop reports included
+    uint32_t full;     //Dropped because the ring was full
+};
+
+/** now_ms is any free running millisecond clock, used for the output rate.
+    lines_per_second 0 writes as fast as LogFlush is called.
+*/
+void LogInit(uint32_t (*now_ms)(), uint32_t lines_per_second);
+
+/** Formats and writes up to max_lines waiting records through sink, oldest first, within the
+    line rate. Writes a line with the drop counts first when they have grown. Returns the
+    number of lines written. Call from one place only, e.g. the idle part of the main loop.
+*/
+size_t LogFlush(void (*sink)(const char *line), size_t max_lines);
+
+/** True when records are waiting for LogFlush.
+*/
+bool LogPending();
+
+LogStats LogGetStats();
+
+/** Formats one record, as LogFlush does. Returns the length without the terminator,
+    the line is cut at size - 1 characters.
+*/
+size_t LogFormat(const LogRecord &record, char *buf, size_t size);
+
+//Used by the macro below
+bool LogWrite(const char *format, const LogArg *args, uint8_t num_args);
+
+inline LogArg LogMakeArg(int v)
+{
+    LogArg a;
+    a.type = LOG_ARG_INT;
+    a.i    = v;
+    return a;
+}
+inline LogArg LogMakeArg(long v)
+{
+    return LogMakeArg((int)v);
+}
+inline LogArg LogMakeArg(unsigned v)
+{
+    LogArg a;
+    a.type = LOG_ARG_UINT;
+    a.u    = v;
+    return a;
+}
+inline LogArg LogMakeArg(unsigned long v)
+{
+    return LogMakeArg((unsigned)v);
+}
+inline LogArg LogMakeArg(uint8_t v)
+{
+    return LogMakeArg((unsigned)v);
+}
+inline LogArg LogMakeArg(uint16_t v)
+{
+    return LogMakeArg((unsigned)v);
+}
+inline LogArg LogMakeArg(double v)
+{
+    LogArg a;
+    a.type = LOG_ARG_FLOAT;
+    a.f    = (float)v;
+    return a;
+}
+inline LogArg LogMakeArg(const char *v)
+{
+    LogArg a;
+    a.type = LOG_ARG_STRING;
+    a.s    = v;
+    return a;
+}
+
+template <typename... Args>
+inline bool LogRecordArgs(const char *format, Args... args)
+{
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+    LogArg packed[sizeof...(Args) + 1] = {LogMakeArg(args)...};
+    return LogWrite(format, packed, sizeof...(Args));
+}
+
+#define LOG(...) LogRecordArgs(__VA_ARGS__)
+
+#endif
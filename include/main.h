@@ -1,3 +1,14 @@
+#pragma once
+
+#define BLOCK_SIZE 16
+#define NUM_VOICES 12
+#define NUM_LFOS 2
+#define NUM_CONTROLS 39
+
+//Largest oversampling factor of the voice audio path and the block it renders
+#define VOICE_MAX_OVERSAMPLE 2
+#define VOICE_MAX_BLOCK (BLOCK_SIZE * VOICE_MAX_OVERSAMPLE)
+
 #define CTRL_OSC1WAVEFORM 0
 #define CTRL_OSC1PULSEWIDTH 1
 #define CTRL_OSC1FREQUENCYMOD 2
@@ -32,4 +43,8 @@
 #define CTRL_FXTYPE 31
 #define CTRL_FXPARAM1 32
 #define CTRL_FXPARAM2 33
-#define CTRL_FXMIX 34
\ No newline at end of file
+#define CTRL_FXMIX 34
+#define CTRL_NOISETYPE 35
+#define CTRL_OSC2PHASEMOD 36
+#define CTRL_RINGMOD 37
+#define CTRL_FILTERTYPE 38
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef DUALIE_MODMATRIX_H
+#define DUALIE_MODMATRIX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "main.h"
+#include "blocksignal.h"
+
+//One source per engine LFO
+enum
+{
+    MOD_SRC_LFO1,
+    MOD_SRC_LFO2,
+    MOD_SRC_LAST,
+};
+static_assert(MOD_SRC_LAST == NUM_LFOS, "every LFO is a modulation source");
+
+enum
+{
+    MOD_DST_OSC1_PW,
+    MOD_DST_OSC2_PW,
+    MOD_DST_OSC1_FM,
+    MOD_DST_OSC2_FM,
+    MOD_DST_FILTER, //Multiplies the cutoff
+    MOD_DST_AMP,    //Multiplies the amplifier
+    MOD_DST_LAST,
+};
+
+/** Block rate modulation: every destination is its base value plus the sum of depth * source
+    over all routes. Routes are compiled into a flat list of block operations whenever a base or
+    depth changes. Zero depth routes are dropped and destinations without routes are handed out
+    as constants, so a patch without modulation costs nothing per block.
+*/
+class ModMatrix
+{
+  public:
+    ModMatrix() {}
+    ~ModMatrix() {}
+
+    void Init();
+
+    inline void SetBase(uint8_t dst, float base)
+    {
+        dirty_ |= base_[dst] != base;
+        base_[dst] = base;
+    }
+
+    inline void SetDepth(uint8_t src, uint8_t dst, float depth)
+    {
+        dirty_ |= depth_[src][dst] != depth;
+        depth_[src][dst] = depth;
+    }
+
+    /** Sets the bases and depths of the routes the patch controls, see src/modmatrix.cpp.
+    */
+    void RoutePatch(const float *values);
+
+    /** Rebuilds the operation list if anything changed since the last call.
+    */
+    void Compile();
+
+    /** Runs the compiled operations, sources holds one BLOCK_SIZE block per MOD_SRC.
+    */
+    void Process(const float *const *sources);
+
+    inline custom::BlockSignal Get(uint8_t dst) const
+    {
+        return IsConstant(dst) ? custom::BlockSignal::Constant(base_[dst]) : custom::BlockSignal::Block(out_[dst]);
+    }
+
+    /** True if the destination has no active route and is just its base value.
+    */
+    inline bool IsConstant(uint8_t dst) const { return !(active_ & (1u << dst)); }
+
+    inline float GetBase(uint8_t dst) const { return base_[dst]; }
+
+    /** Bit per source that at least one compiled route reads, sources without one need not run.
+    */
+    inline uint32_t GetSources() const { return sources_; }
+
+  private:
+    struct Op
+    {
+        uint8_t src, dst;
+        bool    first; //Writes base + depth * source, otherwise accumulates
+        float   depth;
+    };
+
+    float    base_[MOD_DST_LAST];
+    float    depth_[MOD_SRC_LAST][MOD_DST_LAST];
+    float    out_[MOD_DST_LAST][BLOCK_SIZE];
+    Op       ops_[MOD_SRC_LAST * MOD_DST_LAST];
+    uint8_t  num_ops_;
+    uint32_t active_;
+    uint32_t sources_;
+    bool     dirty_;
+};
+
+#endif
@@ -41,6 +41,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include "blocksignal.h"
 #ifdef __cplusplus
 
 namespace custom
@@ -49,6 +50,17 @@ namespace custom
 class MoogLadder
 {
     public:
+        /** Nonlinearity in the feedback path. PADE and LUT run at 2x oversampling,
+            ADAA is antialiased by itself and runs at 1x, which caps the cutoff at 0.2125 * sample_rate.
+        */
+        enum Saturator
+        {
+            SATURATOR_PADE,
+            SATURATOR_LUT,
+            SATURATOR_ADAA,
+            SATURATOR_LAST,
+        };
+
         MoogLadder() {}
         ~MoogLadder() {}
 
@@ -61,8 +73,8 @@ class MoogLadder
         /** Process and return one input sample. **/
         float Process(const float input);
     
-        /** Process mono buffer in place */
-        void ProcessBlock(float *buf, float *freq, size_t size);
+        /** Process mono buffer in place, a constant freq skips the per sample coefficient update */
+        void ProcessBlock(float *buf, BlockSignal freq, size_t size);
 
         /** 
             Sets the cutoff frequency or half-way point of the filter.
@@ -77,6 +89,24 @@ class MoogLadder
         */
         void SetRes(float res);
 
+        /** Selects the saturator, see Saturator. Not real time safe against a running ProcessBlock. */
+        void SetSaturator(uint8_t saturator);
+
+        inline uint8_t GetSaturator() const { return saturator_; }
+
+        /** Turns the internal 2x oversampling of the Padé and LUT saturators on (the default) or off,
+            for callers that already run the filter at a raised sample rate. */
+        void SetOversampling(bool enable);
+
+        /** With no resonance and the cutoff near its limit the ladder is a fixed low pass, which
+            two one-pole stages then stand in for at a fraction of the cost (on by default).
+            Switching between the two crossfades over a block and hands the state over. */
+        void SetOpenApproximation(bool enable);
+
+        /** Whether the open stand-in can take over at a resonance as given to SetRes, which then
+            still depends on the cutoff and the saturator. */
+        static bool MayOpen(float res);
+
     private:
         static const uint8_t kInterpolation = 2;
         static constexpr float kInterpolationRecip = 1.0f / kInterpolation;
@@ -92,9 +122,29 @@ class MoogLadder
         float Qadjust_;
         float pbg_;
         float oldinput_;
+        uint8_t saturator_;
+        bool oversampling_;
+        uint8_t oversample_;
+        float adaa_x1_;
+        float adaa_F1_;
+        bool open_enabled_;
+        bool open_;
+        float open_fc_;
+        float open_g_;
+        float open_s_[2];
+        float open_last_;
 
+        template <uint8_t saturator, bool oversampled>
+        inline float Tick(float input);
+        template <uint8_t saturator, bool oversampled>
+        void ProcessBlockSaturator(float *buf, const BlockSignal &freq, size_t size);
+        void ProcessBlockLadder(float *buf, const BlockSignal &freq, size_t size);
+        void ProcessBlockOpen(float *buf, float fc, size_t size);
+        bool IsOpen(const BlockSignal &freq, size_t size, float &fc) const;
+        void HandOver(bool to_open);
         inline float LPF(float s, int i);
         void compute_coeffs(float fc);
+        void FlushState();
 };
 
 
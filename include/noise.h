@@ -0,0 +1,65 @@
+#pragma once
+#ifndef DUALIE_NOISE_H
+#define DUALIE_NOISE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+//Independent generators advanced side by side, block sizes must be a multiple of this
+#define NOISE_LANES 4
+//Voss-McCartney rows, the lowest one changes every 2^NOISE_PINK_ROWS samples
+#define NOISE_PINK_ROWS 12
+
+namespace custom
+{
+/** White or pink noise with a per instance seed, so voices stay decorrelated.
+
+    White noise comes from NOISE_LANES xorshift32 generators with their own state. They have no
+    dependency on each other, so the block kernel vectorizes where the target has SIMD.
+    Pink noise is Voss-McCartney on top of the white block and has about the same RMS level.
+*/
+class Noise
+{
+  public:
+    Noise() {}
+    ~Noise() {}
+
+    enum
+    {
+        MODE_WHITE,
+        MODE_PINK,
+        MODE_LAST,
+    };
+
+    /** Every lane is derived from seed, give each instance a different one.
+    */
+    void Init(uint32_t seed);
+
+    inline void SetMode(uint8_t mode) { mode_ = mode < MODE_LAST ? mode : MODE_WHITE; }
+
+    /** sets the amplitude of the noise output
+    */
+    inline void SetAmp(float a) { amp_ = a; }
+
+    /** Writes size samples in the range -amp to amp, size must be a multiple of NOISE_LANES.
+    */
+    void ProcessBlock(float *buf, size_t size);
+
+    /** returns a new sample of noise in the range of -amp_ to amp_
+    */
+    float Process();
+
+  private:
+    void  WhiteBlock(float *buf, size_t size);
+    float PinkStep(float white);
+
+    uint32_t state_[NOISE_LANES];
+    float    rows_[NOISE_PINK_ROWS];
+    float    pink_sum_, pink_last_;
+    uint32_t pink_counter_;
+    float    amp_;
+    uint8_t  mode_;
+};
+} // namespace custom
+
+#endif
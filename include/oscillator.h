@@ -1,8 +1,9 @@
-//#pragma once
+#pragma once
 //#ifndef DSY_OSCILLATOR_H
 #define DSY_OSCILLATOR_H
 #include <stdint.h>
 #include "Utility/dsp.h"
+#include "blocksignal.h"
 #ifdef __cplusplus
 
 namespace custom
@@ -29,6 +30,16 @@ class Oscillator
         WAVE_LAST,
     };
 
+    /** Hard sync roles. A master writes 1 into the sync buffer on every sample its phase wraps,
+        a slave restarts its phase on those samples. SYNC_NONE leaves the buffer alone.
+    */
+    enum
+    {
+        SYNC_NONE,
+        SYNC_MASTER,
+        SYNC_SLAVE,
+        SYNC_LAST,
+    };
 
     /** Initializes the Oscillator
 
@@ -49,9 +60,12 @@ class Oscillator
         pw_rad_    = pw_ * TWOPI_F;
         phase_     = 0.0f;
         phase_inc_ = CalcPhaseInc(freq_);
+        last_out_  = 0.0f;
         waveform_  = WAVE_SIN;
+        sync_      = SYNC_NONE;
         eoc_       = true;
         eor_       = true;
+        SelectKernels();
     }
 
 
@@ -67,11 +81,19 @@ class Oscillator
     /** Sets the amplitude of the waveform.
     */
     inline void SetAmp(const float a) { amp_ = a; }
-    /** Sets the waveform to be synthesized by the Process() function.
+    /** Sets the waveform to be synthesized and picks the matching block kernels.
     */
     inline void SetWaveform(const uint8_t wf)
     {
         waveform_ = wf < WAVE_LAST ? wf : WAVE_SIN;
+        SelectKernels();
+    }
+    /** Sets the hard sync role used by ProcessBlock, see SYNC_NONE.
+    */
+    inline void SetSync(const uint8_t sync)
+    {
+        sync_ = sync < SYNC_LAST ? sync : SYNC_NONE;
+        SelectKernels();
     }
     /** Sets the pulse width for WAVE_SQUARE and WAVE_POLYBLEP_SQUARE (range 0 - 1)
      */
@@ -98,9 +120,19 @@ class Oscillator
     inline bool IsFalling() { return phase_ >= PI_F; }
 
     /** Processes the waveform to be generated, returning size number of samples. This should be called once per block.
-     * Doesn't process the amplifier provided.
+     * Doesn't process the amplifier provided. sync is written by a master and read by a slave, see SetSync.
+     * pm is added to the phase in cycles, for audio rate phase modulation.
+     * Runs the kernel built for the waveform, sync role and which of pw and fm are constant.
     */
-    void ProcessBlock(float *buf, float *pw_buf, float *fm_buf, float *reset_vector, bool reset, size_t size);
+    void ProcessBlock(float *buf, BlockSignal pw, BlockSignal fm, BlockSignal pm, float *sync, size_t size)
+    {
+        if(!pm.IsConstant() || pm.value != 0.0f)
+        {
+            (this->*pm_kernel_)(buf, pw, fm, pm, sync, size);
+            return;
+        }
+        (this->*kernels_[(!pw.IsConstant()) | (!fm.IsConstant() << 1)])(buf, pw, fm, sync, size);
+    }
 
     /** Processes the waveform to be generated, returning one sample. This should be called once per sample period.
     */
@@ -114,8 +146,28 @@ class Oscillator
     void Reset(float _phase = 0.0f) { phase_ = _phase; }
 
   private:
+    typedef void (Oscillator::*Kernel)(float *buf, const BlockSignal &pw, const BlockSignal &fm, float *sync, size_t size);
+    typedef void (Oscillator::*PmKernelFn)(float *buf, const BlockSignal &pw, const BlockSignal &fm, const BlockSignal &pm, float *sync, size_t size);
+
+    template <uint8_t waveform>
+    float Shape(float phase, float t, float p, float &last) const;
+    template <uint8_t sync>
+    float Advance(float phase, float inc, float *sync_vector, size_t i) const;
+    template <uint8_t waveform, uint8_t sync, bool constant_pw, bool constant_fm>
+    void BlockKernel(float *buf, const BlockSignal &pw, const BlockSignal &fm, float *sync_vector, size_t size);
+    template <uint8_t waveform, uint8_t sync>
+    void PmKernel(float *buf, const BlockSignal &pw, const BlockSignal &fm, const BlockSignal &pm, float *sync_vector, size_t size);
+    template <uint8_t waveform, uint8_t sync>
+    void ResolveKernels();
+    template <uint8_t sync>
+    void ResolveWaveform();
+    void SelectKernels();
+
     float   CalcPhaseInc(float f);
-    uint8_t waveform_;
+    //Indexed by (pw modulated) | (fm modulated) << 1
+    Kernel     kernels_[4];
+    PmKernelFn pm_kernel_;
+    uint8_t waveform_, sync_;
     float   amp_, freq_, pw_, pw_rad_;
     float   sr_, sr_recip_, phase_, phase_inc_;
     float   last_out_, last_freq_;
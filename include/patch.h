@@ -0,0 +1,47 @@
+#pragma once
+#ifndef DUALIE_PATCH_H
+#define DUALIE_PATCH_H
+
+#include <stdint.h>
+
+#include "main.h"
+#include "adsr.h"
+
+/** One control rate LFO. sync_ticks is the cycle length in MIDI clock ticks
+    (24 per quarter note) when tempo synced, 0 when running free at freq Hz.
+*/
+struct LfoSettings
+{
+    uint8_t  waveform;
+    float    freq;
+    uint16_t sync_ticks;
+};
+
+/** A complete sound: the raw control values, the values in their respective units
+    and every coefficient that is expensive to derive. Computed outside of the audio
+    callback so it can be handed to the voices in one go.
+*/
+struct Patch
+{
+    uint8_t            controls[NUM_CONTROLS];
+    float              values[NUM_CONTROLS];
+    custom::AdsrCoeffs filt_env;
+    custom::AdsrCoeffs amp_env;
+    //The first LFO follows the LFO controls, the others keep their defaults
+    LfoSettings        lfo[NUM_LFOS];
+};
+
+/** Converts a 0-127 control value into the units used by the engine.
+*/
+float ControlToValue(int param, uint8_t control);
+
+//Bit for each control in a mask of changed controls
+#define PATCH_CONTROL_BIT(param) ((uint64_t)1 << (param))
+#define PATCH_ALL_CONTROLS (PATCH_CONTROL_BIT(NUM_CONTROLS) - 1)
+
+/** Derives patch.values and the envelope coefficients from patch.controls. Only the controls
+    in changed are converted again, the rest of patch must already match its controls.
+*/
+void PatchCompute(Patch &patch, float sample_rate, uint64_t changed = PATCH_ALL_CONTROLS);
+
+#endif
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef DUALIE_PRESET_H
+#define DUALIE_PRESET_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "main.h"
+
+/** Binary preset bank. On the Seed it lives in QSPI flash and is read in place through
+    the memory mapped window, on the host it is produced from etc/presets.csv.
+
+    Layout, little endian:
+    - PresetBankHeader
+    - count records of header.record_size bytes, each starting with a PresetRecord
+
+    Records are read using num_controls and record_size from the header, so a bank written
+    with fewer controls still loads and the missing controls keep the caller's defaults.
+*/
+
+#define PRESET_MAGIC 0x4C415544 //"DUAL"
+#define PRESET_VERSION 1
+#define PRESET_NAME_LENGTH 16
+#define PRESET_RECORD_SIZE 64
+#define PRESET_MAX_COUNT 128 //One per MIDI program
+#define PRESET_MAX_RECORD_SIZE 1024 //Room for later versions, bounds what a bad header can claim
+
+struct PresetBankHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint16_t num_controls;
+    uint16_t record_size;
+    uint32_t checksum; //FNV-1a over all records
+};
+
+struct PresetRecord
+{
+    char    name[PRESET_NAME_LENGTH];
+    uint8_t controls[NUM_CONTROLS];
+    uint8_t reserved[PRESET_RECORD_SIZE - PRESET_NAME_LENGTH - NUM_CONTROLS];
+};
+
+static_assert(sizeof(PresetBankHeader) == 16, "PresetBankHeader layout changed");
+static_assert(sizeof(PresetRecord) == PRESET_RECORD_SIZE, "PresetRecord layout changed");
+
+/** Bytes needed for a bank of count presets in the current version.
+*/
+size_t PresetBankSize(uint16_t count);
+
+/** Checks magic, version, sizes and checksum of the size bytes at bank. The records the header
+    claims have to fit in size. Erased flash fails the magic check.
+*/
+bool PresetBankValid(const uint8_t *bank, size_t size);
+
+uint16_t PresetBankCount(const uint8_t *bank);
+
+/** Copies preset index into controls (NUM_CONTROLS entries) and optionally its
+    zero terminated name (PRESET_NAME_LENGTH + 1 bytes). Assumes PresetBankValid.
+*/
+bool PresetBankRead(const uint8_t *bank, uint16_t index, uint8_t *controls, char *name);
+
+/** Name of a control as used for the columns of etc/presets.csv, e.g. "CTRL_FILTERCUTOFF".
+    NULL for an unknown control.
+*/
+const char *PresetControlName(int param);
+
+/** Writes the header for count records already placed after it, in the current version.
+*/
+void PresetBankFinalize(uint8_t *bank, uint16_t count);
+
+#endif
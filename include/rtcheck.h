@@ -0,0 +1,78 @@
+#pragma once
+#ifndef DUALIE_RTCHECK_H
+#define DUALIE_RTCHECK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Real time safety checks for host builds. Code that runs on the audio side is marked with
+    RT_SCOPE, and while a thread is inside such a scope host/rtintercept.cpp reports every heap
+    allocation, mutex, blocking syscall and stdio call it makes, with a stack trace. A scope with
+    a budget also reports when it takes more CPU time than that, which catches loops that run away.
+
+    Everything compiles to nothing unless DUALIE_RTCHECK is 1, which only host builds that link
+    host/rtintercept.cpp set. New code on the audio path should open a scope of its own, so a
+    violation names it even when it is called from somewhere else.
+*/
+#ifndef DUALIE_RTCHECK
+#define DUALIE_RTCHECK 0
+#endif
+
+#if DUALIE_RTCHECK && defined(STM32H750xx)
+#error "DUALIE_RTCHECK needs the host's symbol interposition, it is for host builds only"
+#endif
+
+//Largest stack array sized at run time that RT_CHECK_VLA accepts
+#define RT_MAX_VLA_BYTES 1024
+
+#if DUALIE_RTCHECK
+
+/** Marks the calling thread as real time until the scope ends. Scopes nest, the innermost name
+    is reported. budget_ns 0 leaves the time unchecked.
+*/
+class RealtimeScope
+{
+  public:
+    explicit RealtimeScope(const char *name, uint32_t budget_ns = 0);
+    ~RealtimeScope();
+
+  private:
+    const char *outer_;
+    uint32_t    budget_ns_;
+    uint64_t    start_ns_;
+};
+
+/** Lets the calling thread do what is otherwise reported, e.g. setup that runs inside a scope
+    on purpose. Also nests.
+*/
+class RealtimeAllow
+{
+  public:
+    RealtimeAllow();
+    ~RealtimeAllow();
+};
+
+//Reports a violation of kind in the current scope, if the thread is in one
+void RtViolation(const char *kind, const char *detail);
+
+bool     RtInRealtime();
+uint32_t RtViolations();
+
+#define RT_CONCAT_(a, b) a##b
+#define RT_CONCAT(a, b) RT_CONCAT_(a, b)
+#define RT_SCOPE(...) RealtimeScope RT_CONCAT(rt_scope_, __LINE__)(__VA_ARGS__)
+#define RT_ALLOW() RealtimeAllow RT_CONCAT(rt_allow_, __LINE__)
+#define RT_CHECK(cond, detail) ((cond) ? (void)0 : RtViolation("check failed", (detail)))
+
+#else
+
+#define RT_SCOPE(...) ((void)0)
+#define RT_ALLOW() ((void)0)
+#define RT_CHECK(cond, detail) ((void)0)
+
+#endif
+
+//Stack arrays sized at run time have to stay small, the stack of the audio interrupt is shared
+#define RT_CHECK_VLA(count, type) RT_CHECK((count) * sizeof(type) <= RT_MAX_VLA_BYTES, "stack array too large")
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+#ifndef DUALIE_SCRATCH_H
+#define DUALIE_SCRATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include "main.h"
+#include "rtcheck.h"
+
+/** Scratch buffers for the render path. Every voice used to keep its dozen intermediate blocks
+    as arrays on the stack, which on the Seed is the interrupt stack and grows with BLOCK_SIZE.
+    They are taken from a preallocated arena instead: a function opens a ScratchFrame, takes what
+    it needs and everything goes back when the frame closes, so the next voice reuses the same
+    memory and the working set of a block is one voice deep.
+
+    The firmware has one arena in DTCM, zero wait state and outside the data cache. Host builds
+    give every thread its own, since the threaded renderers run voices side by side.
+*/
+
+#define SCRATCH_ALIGN 8 //Floats, 32 bytes is a cache line of the Cortex-M7
+
+//VoiceManager's mix plus one voice with every stage active takes 14 * VOICE_MAX_BLOCK, the rest
+//leaves room for new stages. dualie-rtcheck reports the peak
+#define SCRATCH_FLOATS (24 * VOICE_MAX_BLOCK)
+
+class ScratchArena
+{
+  public:
+    /** Returns count floats aligned to SCRATCH_ALIGN, count is at most VOICE_MAX_BLOCK. Every
+        caller of a full arena shares one spill block and overwrites the others' buffers. Host
+        builds assert, the firmware counts it and the audio glitches instead of writing past the end.
+    */
+    inline float *Alloc(size_t count)
+    {
+        size_t start = used_;
+        size_t end   = start + ((count + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1));
+        RT_CHECK(count <= VOICE_MAX_BLOCK, "scratch block too large");
+        if(end > SCRATCH_FLOATS)
+        {
+#if !defined(STM32H750xx)
+            assert(!"scratch arena full");
+#endif
+            overflows_++;
+            RT_CHECK(false, "scratch arena full");
+            return spill_;
+        }
+        used_ = end;
+        peak_ = end > peak_ ? end : peak_;
+        return buf_ + start;
+    }
+
+    inline size_t Mark() const { return used_; }
+    inline void   Release(size_t mark) { used_ = mark; }
+
+    /** Clears the counters. The firmware's arena lives in a section the startup code does not
+        zero, so it calls this once before audio starts.
+    */
+    void Init();
+
+    inline size_t   PeakBytes() const { return peak_ * sizeof(float); }
+    inline size_t   CapacityBytes() const { return SCRATCH_FLOATS * sizeof(float); }
+    inline uint32_t Overflows() const { return overflows_; }
+
+  private:
+    alignas(SCRATCH_ALIGN * sizeof(float)) float buf_[SCRATCH_FLOATS];
+    alignas(SCRATCH_ALIGN * sizeof(float)) float spill_[VOICE_MAX_BLOCK];
+    size_t   used_, peak_;
+    uint32_t overflows_;
+};
+
+//The calling thread's arena
+ScratchArena &Scratch();
+
+/** Scratch taken through a frame goes back to the arena when the frame goes out of scope.
+*/
+class ScratchFrame
+{
+  public:
+    ScratchFrame() : arena_(Scratch()), mark_(arena_.Mark()) {}
+    ~ScratchFrame() { arena_.Release(mark_); }
+
+    inline float *Floats(size_t count) { return arena_.Alloc(count); }
+
+  private:
+    ScratchArena &arena_;
+    size_t        mark_;
+};
+
+#endif
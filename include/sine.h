@@ -0,0 +1,110 @@
+#pragma once
+#ifndef DUALIE_SINE_H
+#define DUALIE_SINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <arm_math.h>
+#include <arm_common_tables.h>
+
+//Points per quarter wave in the SINE_CUBIC table
+#define SINE_QUARTER_SIZE 64
+
+namespace custom
+{
+/** Sine accuracies, the max errors are measured over a full cycle in float32.
+    Run the sine_* bench scenarios for the cost of each on the target.
+*/
+enum
+{
+    SINE_TABLE, //512 point sinTable_f32 with linear interpolation, 1.9e-5
+    SINE_CUBIC, //SINE_QUARTER_SIZE point quarter wave with cubic interpolation, 2.6e-7
+    SINE_POLY,  //Degree 9 minimax polynomial, no table reads, 1.9e-7
+    SINE_LAST,
+};
+
+//Quarter wave with one guard point before and two after, see sine.cpp
+extern const float kSineQuarter[SINE_QUARTER_SIZE + 4];
+
+//Fractional part in 0 - 1 excluding 1, also for negative x. floor without a libm call, and a
+//negative x too close below an integer to leave anything after the subtraction wraps to 0
+inline float SineWrap(float x)
+{
+    float i = (float)(int32_t)x;
+    i -= i > x ? 1.0f : 0.0f;
+    float f = x - i;
+    return f < 1.0f ? f : 0.0f;
+}
+
+/** sin(2 pi x), x is in cycles and may be outside 0 - 1.
+*/
+template <uint8_t accuracy>
+inline float Sine(float x)
+{
+    if(accuracy == SINE_TABLE)
+    {
+        float    findex = (float)FAST_MATH_TABLE_SIZE * SineWrap(x);
+        uint32_t whole  = (uint32_t)findex;
+        float    fract  = findex - (float)whole;
+        uint16_t index  = whole & 0x1ff;
+        return (1.0f - fract) * sinTable_f32[index] + fract * sinTable_f32[index + 1];
+    }
+    else if(accuracy == SINE_CUBIC)
+    {
+        //Fold onto the first quarter, odd quarters run backwards and the second half is negated
+        float    y     = SineWrap(x) * 4.0f;
+        uint32_t q     = (uint32_t)y;
+        float    f     = y - (float)q;
+        f              = q & 1 ? 1.0f - f : f;
+        float        pos = f * SINE_QUARTER_SIZE;
+        uint32_t     i   = (uint32_t)pos;
+        float        t   = pos - (float)i;
+        const float *p   = kSineQuarter + i;
+        //Catmull-Rom through p[0] .. p[3], between p[1] and p[2]
+        float c1  = 0.5f * (p[2] - p[0]);
+        float c2  = p[0] - 2.5f * p[1] + 2.0f * p[2] - 0.5f * p[3];
+        float c3  = 0.5f * (p[3] - p[0]) + 1.5f * (p[1] - p[2]);
+        float out = ((c3 * t + c2) * t + c1) * t + p[1];
+        return q & 2 ? -out : out;
+    }
+    else
+    {
+        //Wrap to -0.5 - 0.5 and fold onto -0.25 - 0.25, where sin is odd and the polynomial is fitted
+        float u = SineWrap(x + 0.5f) - 0.5f;
+        u       = u > 0.25f ? 0.5f - u : u;
+        u       = u < -0.25f ? -0.5f - u : u;
+        float u2 = u * u;
+        return u * (6.283185005e+00f
+                    + u2 * (-4.134165573e+01f
+                            + u2 * (8.160100555e+01f + u2 * (-7.654978180e+01f + u2 * 3.953670502e+01f))));
+    }
+}
+
+/** cos(2 pi x), x is in cycles.
+*/
+template <uint8_t accuracy>
+inline float Cosine(float x)
+{
+    return Sine<accuracy>(x + 0.25f);
+}
+
+template <uint8_t accuracy>
+inline void SineBlock(float *out, const float *x, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        out[i] = Sine<accuracy>(x[i]);
+    }
+}
+
+template <uint8_t accuracy>
+inline void CosineBlock(float *out, const float *x, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        out[i] = Cosine<accuracy>(x[i]);
+    }
+}
+} // namespace custom
+
+#endif
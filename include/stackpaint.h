@@ -0,0 +1,31 @@
+#pragma once
+#ifndef DUALIE_STACKPAINT_H
+#define DUALIE_STACKPAINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Stack high water mark by painting. StackPaint fills the stack below the caller with a
+    pattern, and StackHighWater later finds the deepest word that no longer holds it. On the
+    Seed the audio interrupt runs on the same stack as the main loop, so painting from main
+    measures the loop, the audio callback and every other interrupt together.
+
+    The painted bytes must be free stack: on the Seed it stays clear of the DTCM sections below
+    the stack, on the host the thread's stack has to be larger than the painted depth.
+*/
+
+#define STACK_PAINT_WORD 0xA5A5A5A5u
+
+/** Paints bytes of stack below the caller's frame and starts measuring from there.
+*/
+void StackPaint(size_t bytes);
+
+/** Deepest stack use below the caller of StackPaint so far, in bytes. Reaching the painted
+    depth means the stack went at least that deep, or past it.
+*/
+size_t StackHighWater();
+
+//Bytes painted by the last StackPaint
+size_t StackPainted();
+
+#endif
@@ -0,0 +1,154 @@
+#pragma once
+#ifndef DUALIE_TRACE_H
+#define DUALIE_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#if defined(STM32H750xx)
+#include <stm32h7xx.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+/** Trace of what the engine did in the last few hundred milliseconds, to find out what
+    happened in a block that glitched. Events go into a fixed ring from the audio interrupt and
+    the main loop alike, the oldest are overwritten. TRACE() compiles to nothing unless
+    DUALIE_TRACE is 1, and costs a timestamp read, an atomic increment and three stores when it is.
+
+    On the Seed a late block freezes the ring with TraceTrigger and the main loop prints it to
+    the serial log. On the host the events are taken with TraceSnapshot. host/dualie-trace turns
+    either into Chrome trace JSON.
+*/
+#ifndef DUALIE_TRACE
+#define DUALIE_TRACE 0
+#endif
+
+//Events kept, a power of two. 1024 hold 170 ms of blocks at 48 kHz, less with dense MIDI
+#ifndef DUALIE_TRACE_SIZE
+#define DUALIE_TRACE_SIZE 1024
+#endif
+
+enum TraceType
+{
+    TRACE_BLOCK_BEGIN,  //a: voices active
+    TRACE_BLOCK_END,    //a: voices active
+    TRACE_NOTE_ON,      //a: note, b: velocity
+    TRACE_NOTE_OFF,     //a: note, b: velocity
+    TRACE_VOICE_ALLOC,  //a: note, b: voice
+    TRACE_VOICE_DROP,   //a: note, no voice was free
+    TRACE_CONTROL,      //a: control, b: value
+    TRACE_PATCH_APPLY,  //b: 1 if crossfaded
+    TRACE_PRESET,       //a: program
+    TRACE_CLOCK,        //a: tempo in BPM
+    TRACE_TRIGGER,      //b: block time in percent of the deadline
+    TRACE_NUM_TYPES
+};
+
+/** seq is the event's position in the whole trace, written last so a reader can tell a
+    finished slot from one that is being overwritten.
+*/
+struct TraceEvent
+{
+    uint32_t time; //TraceTimestamp at the event
+    uint8_t  type;
+    uint8_t  a;
+    uint16_t b;
+    std::atomic<uint32_t> seq;
+};
+
+//One core on the Seed, so ordering against the interrupt only needs a compiler barrier
+#if defined(STM32H750xx)
+#define TRACE_FENCE(order) std::atomic_signal_fence(order)
+#else
+#define TRACE_FENCE(order) std::atomic_thread_fence(order)
+#endif
+
+extern TraceEvent             trace_ring[DUALIE_TRACE_SIZE];
+extern std::atomic<uint32_t>  trace_next;
+extern std::atomic<bool>      trace_frozen;
+
+/** Free running 32 bit tick counter, the CPU cycle counter where there is one.
+*/
+static inline uint32_t TraceTimestamp()
+{
+#if defined(STM32H750xx)
+    return DWT->CYCCNT;
+#elif defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+static inline void TraceRecord(uint8_t type, uint8_t a, uint16_t b)
+{
+    if(trace_frozen.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    uint32_t    seq = trace_next.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent &e   = trace_ring[seq & (DUALIE_TRACE_SIZE - 1)];
+    //Invalidates the slot while it is rewritten
+    e.seq.store(UINT32_MAX, std::memory_order_relaxed);
+    TRACE_FENCE(std::memory_order_release);
+    e.time = TraceTimestamp();
+    e.type = type;
+    e.a    = a;
+    e.b    = b;
+    e.seq.store(seq, std::memory_order_release);
+}
+
+#if DUALIE_TRACE
+#define TRACE(type, a, b) TraceRecord((type), (uint8_t)(a), (uint16_t)(b))
+#else
+#define TRACE(type, a, b) ((void)0)
+#endif
+
+/** Starts the timestamp counter where it has to be enabled. Also usable without DUALIE_TRACE.
+*/
+void TraceTimerInit();
+
+/** Starts the timestamp counter and clears the ring.
+*/
+void TraceInit();
+
+/** Stops recording so the events before a glitch are kept, until TraceResume.
+    Records a TRACE_TRIGGER event first. Safe from the audio interrupt.
+*/
+void TraceTrigger(uint16_t load_percent);
+void TraceResume();
+inline bool TraceFrozen()
+{
+    return trace_frozen.load(std::memory_order_acquire);
+}
+
+/** A copy of one event, as returned by TraceSnapshot.
+*/
+struct TraceRecordCopy
+{
+    uint32_t seq, time;
+    uint8_t  type, a;
+    uint16_t b;
+};
+
+/** Copies the recorded events, oldest first, into out and returns how many. Slots being
+    written while they are copied are left out.
+*/
+size_t TraceSnapshot(TraceRecordCopy *out, size_t max);
+
+/** Name of an event type as used in the exported trace.
+*/
+const char *TraceTypeName(uint8_t type);
+
+/** Formats one event as a line for the serial log, "TR <seq> <time> <type> <a> <b>".
+    Returns the length without the terminator.
+*/
+int TraceFormat(const TraceRecordCopy &e, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+#ifndef DUALIE_VOICE_H
+#define DUALIE_VOICE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "main.h"
+#include "oscillator.h"
+#include "adsr.h"
+#include "moogladder.h"
+#include "zdffilter.h"
+#include "noise.h"
+#include "patch.h"
+#include "modmatrix.h"
+
+//Filter models selected by CTRL_FILTERTYPE, all but FILTER_LADDER are modes of custom::ZdfFilter
+enum
+{
+    FILTER_LADDER,
+    FILTER_LADDER2,
+    FILTER_SVF_LOWPASS,
+    FILTER_SVF_BANDPASS,
+    FILTER_SVF_HIGHPASS,
+    FILTER_LAST,
+};
+
+/** One note of polyphony: two oscillators and noise into a filter and amplifier,
+    each with its own envelope. Continuous settings are read from the values of the
+    active patch every block, everything else is pushed in with ApplyPatch.
+*/
+class Voice
+{
+  public:
+    Voice() {}
+    ~Voice() {}
+
+    /** seed decorrelates the noise of this voice from the others. With oversample 2 the
+        oscillators, noise and filter run at twice sample_rate, see VoiceManager.
+    */
+    void Init(float sample_rate, uint32_t seed, uint8_t oversample = 1);
+
+    /** Renders size * oversample samples into buf using the patch values and the modulation computed by the VoiceManager.
+        The envelopes and modulation run at the base rate and are held over the oversampled block.
+    */
+    void ProcessBlock(float *buf, const float *values, const ModMatrix &mod, size_t size);
+
+    float Process(const float *values, float lfo_out);
+
+    void OnNoteOn(uint8_t note, uint8_t velocity);
+
+    void OnNoteOff() { env_gate_ = false; }
+
+    /** Applies every setting of a patch at once, using its precomputed coefficients.
+    */
+    void ApplyPatch(const Patch &patch);
+
+    /** Taken from the note on, before the envelope has run, until the release has died out.
+        Notes sent together before one block each get a voice of their own.
+    */
+    inline bool  IsActive() const { return env_gate_ || amp_env_.IsRunning(); }
+    inline bool  IsHeld() const { return env_gate_; }
+    inline float GetNote() const { return note_; }
+
+  private:
+    //Runs the filter model of the patch
+    void Filter(float *buf, custom::BlockSignal freq, size_t size);
+
+    custom::Oscillator osc1_;
+    custom::Oscillator osc2_;
+    custom::Noise      noise_;
+    custom::MoogLadder filt_;
+    custom::ZdfFilter  zdf_;
+    custom::Adsr       filt_env_;
+    custom::Adsr       amp_env_;
+    uint8_t            note_, oversample_, filter_type_;
+    float              velocity_, freq_;
+    bool               env_gate_;
+};
+
+#endif
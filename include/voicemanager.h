@@ -0,0 +1,222 @@
+#pragma once
+#ifndef DUALIE_VOICEMANAGER_H
+#define DUALIE_VOICEMANAGER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <arm_math.h>
+
+#include "main.h"
+#include "voice.h"
+#include "modmatrix.h"
+#include "halfband.h"
+#include "scratch.h"
+#include "trace.h"
+
+template <size_t max_voices>
+class VoiceManager
+{
+  public:
+    VoiceManager() {}
+    ~VoiceManager() {}
+
+    /** oversample 2 runs the voices at twice sample_rate, their sum is decimated once per block.
+    */
+    void Init(float sample_rate, uint8_t oversample = 1)
+    {
+        oversample_ = oversample == VOICE_MAX_OVERSAMPLE ? VOICE_MAX_OVERSAMPLE : 1;
+        for(size_t i = 0; i < max_voices; i++)
+        {
+            voices[i].Init(sample_rate, i, oversample_);
+        }
+        decimator_.Init();
+        mod_.Init();
+    }
+
+    float Process(const float *values, float lfo_out)
+    {
+        float sum;
+        sum = 0.f;
+        for(size_t i = 0; i < max_voices; i++)
+        {
+            sum += voices[i].Process(values, lfo_out);
+        }
+        return sum;
+    }
+
+    /** lfo_out holds one block per LFO, computed at control rate by the engine.
+    */
+    void ProcessBlock(float *buf, const float *values, const float (*lfo_out)[BLOCK_SIZE], size_t size)
+    {
+        PrepareBlock(values, lfo_out);
+
+        if(oversample_ == 1)
+        {
+            ScratchFrame scratch;
+            float       *temp = scratch.Floats(BLOCK_SIZE);
+            for(size_t i = 0; i < max_voices; i++)
+            {
+                //if(voices[i].IsActive())
+                //{
+                    voices[i].ProcessBlock(temp, values, mod_, BLOCK_SIZE);
+                    arm_add_f32(buf, temp, buf, BLOCK_SIZE);
+                //}
+            }
+            return;
+        }
+
+        //Voices are summed at the oversampled rate, so the mix is filtered once instead of per voice
+        ScratchFrame scratch;
+        float       *mix = scratch.Floats(VOICE_MAX_BLOCK), *temp = scratch.Floats(VOICE_MAX_BLOCK);
+        arm_fill_f32(0, mix, VOICE_MAX_BLOCK);
+        for(size_t i = 0; i < max_voices; i++)
+        {
+            voices[i].ProcessBlock(temp, values, mod_, BLOCK_SIZE);
+            arm_add_f32(mix, temp, mix, VOICE_MAX_BLOCK);
+        }
+        decimator_.Process(mix, temp, BLOCK_SIZE);
+        arm_add_f32(buf, temp, buf, BLOCK_SIZE);
+    }
+
+    /* ProcessBlock in three steps for renderers that spread the voices over several threads.
+       PrepareBlock once, then RenderVoice for every voice in any order and on any thread, as
+       voices only share what PrepareBlock wrote, then MixVoices. The result is bit-identical
+       to ProcessBlock. */
+
+    void PrepareBlock(const float *values, const float (*lfo_out)[BLOCK_SIZE])
+    {
+        const float *sources[MOD_SRC_LAST];
+
+        UpdateRoutes(values);
+
+        for(int i = 0; i < MOD_SRC_LAST; i++)
+        {
+            sources[i] = lfo_out[i];
+        }
+        mod_.Process(sources);
+    }
+
+    /** Brings the modulation matrix up to date with values, as PrepareBlock does, so the caller
+        can see which LFOs are routed before it runs them.
+    */
+    const ModMatrix &UpdateRoutes(const float *values)
+    {
+        //The matrix only recompiles when one of the routes changed
+        mod_.RoutePatch(values);
+        mod_.Compile();
+        return mod_;
+    }
+
+    /** Writes BLOCK_SIZE * GetOversample() samples of voice i to out.
+    */
+    void RenderVoice(size_t i, float *out, const float *values)
+    {
+        voices[i].ProcessBlock(out, values, mod_, BLOCK_SIZE);
+    }
+
+    /** Adds the blocks from RenderVoice to buf in voice order, the one of voice i starts at
+        voice_out + i * stride.
+    */
+    void MixVoices(float *buf, const float *voice_out, size_t stride)
+    {
+        if(oversample_ == 1)
+        {
+            for(size_t i = 0; i < max_voices; i++)
+            {
+                arm_add_f32(buf, voice_out + i * stride, buf, BLOCK_SIZE);
+            }
+            return;
+        }
+
+        ScratchFrame scratch;
+        float       *mix = scratch.Floats(VOICE_MAX_BLOCK), *temp = scratch.Floats(BLOCK_SIZE);
+        arm_fill_f32(0, mix, VOICE_MAX_BLOCK);
+        for(size_t i = 0; i < max_voices; i++)
+        {
+            arm_add_f32(mix, voice_out + i * stride, mix, VOICE_MAX_BLOCK);
+        }
+        decimator_.Process(mix, temp, BLOCK_SIZE);
+        arm_add_f32(buf, temp, buf, BLOCK_SIZE);
+    }
+
+    inline uint8_t GetOversample() const { return oversample_; }
+
+    void OnNoteOn(uint8_t notenumber, uint8_t velocity)
+    {
+        Voice *v = FindFreeVoice();
+        if(v == NULL)
+        {
+            TRACE(TRACE_VOICE_DROP, notenumber, 0);
+            return;
+        }
+        TRACE(TRACE_VOICE_ALLOC, notenumber, v - voices);
+        v->OnNoteOn(notenumber, velocity);
+    }
+
+    void OnNoteOff(uint8_t notenumber, uint8_t velocity)
+    {
+        for(size_t i = 0; i < max_voices; i++)
+        {
+            Voice *v = &voices[i];
+            if(v->IsActive() && v->GetNote() == notenumber)
+            {
+                v->OnNoteOff();
+            }
+        }
+    }
+
+    void FreeAllVoices()
+    {
+        for(size_t i = 0; i < max_voices; i++)
+        {
+            voices[i].OnNoteOff();
+        }
+    }
+
+    void ApplyPatch(const Patch &patch)
+    {
+        for(size_t i = 0; i < max_voices; i++)
+        {
+            voices[i].ApplyPatch(patch);
+        }
+    }
+
+    uint8_t GetNumActiveVoices()
+    {
+        uint8_t count = 0;
+        for(size_t i = 0; i < max_voices; i++)
+        {
+            if(voices[i].IsActive())
+            {
+                count++;
+            }
+        }
+        return count;
+    }
+
+
+  private:
+    Voice                     voices[max_voices];
+    ModMatrix                 mod_;
+    custom::HalfbandDecimator decimator_;
+    uint8_t                   oversample_;
+    //An idle voice, else the first one in its release, which starts over from where it is
+    Voice *FindFreeVoice()
+    {
+        Voice *released = NULL;
+        for(size_t i = 0; i < max_voices; i++)
+        {
+            if(!voices[i].IsActive())
+            {
+                return &voices[i];
+            }
+            if(released == NULL && !voices[i].IsHeld())
+            {
+                released = &voices[i];
+            }
+        }
+        return released;
+    }
+};
+
+#endif
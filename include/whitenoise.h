@@ -1,4 +1,4 @@
-//#pragma once
+#pragma once
 //#ifndef DSY_WHITENOISE_H
 #define DSY_WHITENOISE_H
 #include <stdint.h>
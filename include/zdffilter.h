@@ -0,0 +1,77 @@
+#pragma once
+#ifndef DUALIE_ZDFFILTER_H
+#define DUALIE_ZDFFILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "blocksignal.h"
+
+namespace custom
+{
+/** Zero delay feedback (topology preserving transform) filters, lighter alternatives to MoogLadder
+    with the same block API.
+
+    - MODE_LADDER2: two one-pole stages with tanh-like input saturation, 12 dB/oct. It peaks
+      at resonance 1 but does not self-oscillate.
+    - MODE_LOWPASS, MODE_BANDPASS, MODE_HIGHPASS: the outputs of a linear state-variable filter.
+      The band pass has a constant skirt, its peak rises with the resonance like the other outputs.
+
+    The prewarp tan() is a rational approximation whose division is shared with the coefficient
+    solve, so a cutoff modulated at audio rate costs one division per sample for the state-variable
+    filter and two for the ladder. The cutoff is limited to 0.45 * sample_rate.
+*/
+class ZdfFilter
+{
+  public:
+    ZdfFilter() {}
+    ~ZdfFilter() {}
+
+    enum
+    {
+        MODE_LADDER2,
+        MODE_LOWPASS,
+        MODE_BANDPASS,
+        MODE_HIGHPASS,
+        MODE_LAST,
+    };
+
+    void Init(float sample_rate);
+
+    /** Keeps the state, so switching between the state-variable outputs is seamless. */
+    void SetMode(uint8_t mode);
+
+    inline uint8_t GetMode() const { return mode_; }
+
+    /** Cutoff in Hz. */
+    void SetFreq(float freq);
+
+    /** Resonance from 0 to 1. */
+    void SetRes(float res);
+
+    float Process(float input);
+
+    /** Process mono buffer in place, a constant freq skips the per sample coefficient update */
+    void ProcessBlock(float *buf, BlockSignal freq, size_t size);
+
+  private:
+    template <uint8_t mode>
+    void ProcessBlockMode(float *buf, const BlockSignal &freq, size_t size);
+    template <uint8_t mode>
+    inline float Tick(float input);
+    template <uint8_t mode>
+    inline void Coeffs(float freq);
+    void FlushState();
+
+    float   sample_rate_, pi_over_sr_, max_freq_;
+    float   freq_, res_;
+    //State-variable: damping k (2 - 2 * res) and the solved gains a1 - a3
+    float   k_, a1_, a2_, a3_;
+    //Ladder: feedback, one-pole gain G and 1 / (1 + feedback * G^2)
+    float   fb_, g_, fb_norm_;
+    float   s1_, s2_;
+    uint8_t mode_;
+};
+} // namespace custom
+
+#endif
@@ -5,6 +5,9 @@
 
 using namespace custom;
 
+//The decay only approaches the sustain level, it is snapped onto it once the distance is
+//inaudible (-100dB) so a held envelope becomes exactly constant
+#define ADSR_SETTLE_DISTANCE 1e-5f
 
 void Adsr::Init(float sample_rate, int blockSize)
 {
@@ -93,6 +96,32 @@ void Adsr::SetTimeConstant(float timeInS, float& time, float& coeff)
     }
 }
 
+void Adsr::GetCoeffs(AdsrCoeffs &coeffs) const
+{
+    coeffs.attackD0     = attackD0_;
+    coeffs.attackTarget = attackTarget_;
+    coeffs.decayD0      = decayD0_;
+    coeffs.releaseD0    = releaseD0_;
+    coeffs.susLevel     = sus_level_;
+    coeffs.attackTime   = attackTime_;
+    coeffs.attackShape  = attackShape_;
+    coeffs.decayTime    = decayTime_;
+    coeffs.releaseTime  = releaseTime_;
+}
+
+void Adsr::SetCoeffs(const AdsrCoeffs &coeffs)
+{
+    attackD0_     = coeffs.attackD0;
+    attackTarget_ = coeffs.attackTarget;
+    decayD0_      = coeffs.decayD0;
+    releaseD0_    = coeffs.releaseD0;
+    sus_level_    = coeffs.susLevel;
+    attackTime_   = coeffs.attackTime;
+    attackShape_  = coeffs.attackShape;
+    decayTime_    = coeffs.decayTime;
+    releaseTime_  = coeffs.releaseTime;
+}
+
 void Adsr::ProcessBlock(float *buf, size_t size, bool gate)
 {
     for (size_t i = 0; i < size; i++)
@@ -111,6 +140,8 @@ void Adsr::ProcessBlock(float *buf, size_t size, bool gate)
         else if(mode_ == ADSR_SEG_RELEASE)
             D0 = releaseD0_;
 
+        //Denormal guards: release and a decay to sustain 0 aim below zero, so they cross it and
+        //go idle in finite time. Any other decay is snapped onto its sustain level
         float target = mode_ == ADSR_SEG_DECAY ? sus_level_ : -0.01f;
         switch(mode_)
         {
@@ -127,6 +158,8 @@ void Adsr::ProcessBlock(float *buf, size_t size, bool gate)
             case ADSR_SEG_DECAY:
             case ADSR_SEG_RELEASE:
                 x_ += D0 * (target - x_);
+                if(mode_ == ADSR_SEG_DECAY && fabsf(x_ - sus_level_) < ADSR_SETTLE_DISTANCE)
+                    x_ = sus_level_;
                 out = x_;
                 if(out < 0.0f)
                 {
@@ -155,6 +188,7 @@ float Adsr::Process(bool gate)
     else if(mode_ == ADSR_SEG_RELEASE)
         D0 = releaseD0_;
 
+    //Same denormal guards as ProcessBlock
     float target = mode_ == ADSR_SEG_DECAY ? sus_level_ : -0.01f;
     switch(mode_)
     {
@@ -171,6 +205,8 @@ float Adsr::Process(bool gate)
         case ADSR_SEG_DECAY:
         case ADSR_SEG_RELEASE:
             x_ += D0 * (target - x_);
+            if(mode_ == ADSR_SEG_DECAY && fabsf(x_ - sus_level_) < ADSR_SETTLE_DISTANCE)
+                x_ = sus_level_;
             out = x_;
             if(out < 0.0f)
             {
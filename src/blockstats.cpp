@@ -0,0 +1,74 @@
+#include <string.h>
+
+#include "../include/blockstats.h"
+
+void BlockStats::Init(uint32_t deadline_ticks)
+{
+    deadline_ = deadline_ticks > 0 ? deadline_ticks : 1;
+    scale_    = (float)BLOCK_STATS_STEPS / deadline_;
+    Clear();
+    reset_.store(false, std::memory_order_relaxed);
+}
+
+void BlockStats::Clear()
+{
+    memset(buckets_, 0, sizeof(buckets_));
+    count_ = 0;
+    late_  = 0;
+    max_   = 0;
+    sum_   = 0;
+}
+
+void BlockStats::Reset()
+{
+    reset_.store(true, std::memory_order_release);
+}
+
+void BlockStats::Add(uint32_t ticks)
+{
+    if(reset_.load(std::memory_order_acquire))
+    {
+        Clear();
+        reset_.store(false, std::memory_order_relaxed);
+    }
+    //A float multiply, the Seed has no fast 64 bit division
+    uint32_t bucket = (uint32_t)(ticks * scale_);
+    buckets_[bucket < BLOCK_STATS_BUCKETS ? bucket : BLOCK_STATS_BUCKETS - 1]++;
+    count_++;
+    sum_ += ticks;
+    late_ += ticks > deadline_;
+    max_ = ticks > max_ ? ticks : max_;
+}
+
+float BlockStats::MaxPercent() const
+{
+    return 100.f * max_ / deadline_;
+}
+
+float BlockStats::MeanPercent() const
+{
+    return count_ ? (float)(100.0 * sum_ / count_ / deadline_) : 0.f;
+}
+
+float BlockStats::Percentile(double fraction) const
+{
+    uint32_t count = count_;
+    if(count == 0)
+    {
+        return 0.f;
+    }
+    //Blocks allowed above the percentile, rounded down so p99.99 of fewer than 10000 blocks is the max
+    uint32_t above = (uint32_t)(count * (1.0 - fraction));
+    uint32_t seen  = 0;
+    for(int i = BLOCK_STATS_BUCKETS - 1; i >= 0; i--)
+    {
+        seen += buckets_[i];
+        if(seen > above)
+        {
+            //Never past the slowest block, which is known exactly
+            float edge = 100.f * (i + 1) / BLOCK_STATS_STEPS;
+            return i == BLOCK_STATS_BUCKETS - 1 || edge > MaxPercent() ? MaxPercent() : edge;
+        }
+    }
+    return 0.f;
+}
@@ -0,0 +1,240 @@
+#include <string.h>
+#include <new>
+#include <algorithm>
+#include <arm_math.h>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+#include "../include/dualie.h"
+#include "../include/engine.h"
+#include "../include/preset.h"
+#include "../include/denormal.h"
+#include "../include/rtcheck.h"
+
+static_assert(DUALIE_BLOCK_SIZE == BLOCK_SIZE, "DUALIE_BLOCK_SIZE must match BLOCK_SIZE");
+static_assert(DUALIE_NUM_CONTROLS == NUM_CONTROLS, "DUALIE_NUM_CONTROLS must match NUM_CONTROLS");
+
+//Output gain of AudioCallbackBlock
+#define DUALIE_OUTPUT_GAIN 0.5f
+
+//An event waiting for its block, with its frame counted from the creation of the instance
+struct QueuedEvent
+{
+    uint64_t    time;
+    DualieEvent event;
+};
+
+struct DualieInstance
+{
+    Engine       engine;
+    float        sample_rate;
+    uint64_t     time;  //Frames rendered so far
+    uint64_t     block; //Frame the next block starts at
+    QueuedEvent *queue; //Sorted by time
+    uint32_t     queue_size, queue_capacity;
+
+    //Block rendered by a call that ended inside it, consumed by the next call
+    float  partial[BLOCK_SIZE];
+    size_t partial_pos;
+};
+
+/** Sets flush to zero for the calling thread and restores the caller's mode when it goes out
+    of scope, the library must not change the FPU mode of the host's threads.
+*/
+class ScopedFlushToZero
+{
+  public:
+    ScopedFlushToZero()
+    {
+#if defined(__SSE__) || defined(_M_X64)
+        csr_ = _mm_getcsr();
+#elif defined(__aarch64__)
+        __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr_));
+#endif
+        EnableFlushToZero();
+    }
+
+    ~ScopedFlushToZero()
+    {
+#if defined(__SSE__) || defined(_M_X64)
+        _mm_setcsr(csr_);
+#elif defined(__aarch64__)
+        __asm__ volatile("msr fpcr, %0" : : "r"(fpcr_));
+#endif
+    }
+
+  private:
+#if defined(__SSE__) || defined(_M_X64)
+    unsigned int csr_;
+#elif defined(__aarch64__)
+    uint64_t fpcr_;
+#endif
+};
+
+//Same handling as the MIDI loop of main()
+static void ApplyEvent(DualieInstance *inst, const QueuedEvent &queued)
+{
+    const DualieEvent &e = queued.event;
+    switch(e.type)
+    {
+        case DUALIE_EVENT_NOTE_ON:
+            if(e.data2 != 0)
+            {
+                inst->engine.NoteOn(e.data1, e.data2);
+            }
+            else
+            {
+                inst->engine.NoteOff(e.data1, e.data2);
+            }
+            break;
+        case DUALIE_EVENT_NOTE_OFF: inst->engine.NoteOff(e.data1, e.data2); break;
+        case DUALIE_EVENT_CONTROL: inst->engine.HandleControls(e.data2, e.data1, true); break;
+        case DUALIE_EVENT_CLOCK:
+            inst->engine.ClockTick((uint32_t)(queued.time * 1e6 / inst->sample_rate));
+            break;
+        case DUALIE_EVENT_START: inst->engine.ClockStart(); break;
+        default: break;
+    }
+}
+
+//Applies the events up to the end of the next block and renders it into buf
+static void RenderBlock(DualieInstance *inst, float *buf)
+{
+    uint64_t end     = inst->block + BLOCK_SIZE;
+    uint32_t applied = 0;
+    while(applied < inst->queue_size && inst->queue[applied].time < end)
+    {
+        ApplyEvent(inst, inst->queue[applied++]);
+    }
+    if(applied)
+    {
+        memmove(inst->queue, inst->queue + applied, (inst->queue_size - applied) * sizeof(QueuedEvent));
+        inst->queue_size -= applied;
+    }
+    //Both sides of the engine run on this thread, so the snapshot is always free here
+    inst->engine.Update();
+
+    inst->engine.ProcessBlock(buf, BLOCK_SIZE);
+    arm_scale_f32(buf, DUALIE_OUTPUT_GAIN, buf, BLOCK_SIZE);
+    inst->block = end;
+}
+
+uint32_t dualie_api_version(void)
+{
+    return DUALIE_API_VERSION;
+}
+
+DualieInstance *dualie_create(float sample_rate, uint32_t event_capacity)
+{
+    if(!(sample_rate > 0.f))
+    {
+        return NULL;
+    }
+    DualieInstance *inst = new(std::nothrow) DualieInstance;
+    if(inst == NULL)
+    {
+        return NULL;
+    }
+    inst->queue = new(std::nothrow) QueuedEvent[event_capacity ? event_capacity : 1];
+    if(inst->queue == NULL)
+    {
+        delete inst;
+        return NULL;
+    }
+    inst->queue_capacity = event_capacity;
+    inst->queue_size     = 0;
+    inst->sample_rate    = sample_rate;
+    inst->time           = 0;
+    inst->block          = 0;
+    inst->partial_pos    = BLOCK_SIZE;
+
+    ScopedFlushToZero ftz;
+    inst->engine.Init(sample_rate);
+    return inst;
+}
+
+void dualie_destroy(DualieInstance *instance)
+{
+    if(instance)
+    {
+        delete[] instance->queue;
+        delete instance;
+    }
+}
+
+uint32_t dualie_push_events(DualieInstance *instance, const DualieEvent *events, uint32_t count)
+{
+    RT_SCOPE("dualie_push_events");
+    uint32_t pushed = 0;
+    for(; pushed < count && instance->queue_size < instance->queue_capacity; pushed++)
+    {
+        QueuedEvent queued = {instance->time + events[pushed].frame, events[pushed]};
+        //Behind every event at the same frame, so events keep the order they were pushed in
+        uint32_t pos = instance->queue_size;
+        while(pos > 0 && instance->queue[pos - 1].time > queued.time)
+        {
+            instance->queue[pos] = instance->queue[pos - 1];
+            pos--;
+        }
+        instance->queue[pos] = queued;
+        instance->queue_size++;
+    }
+    return pushed;
+}
+
+void dualie_render(DualieInstance *instance, float *left, float *right, uint32_t frames)
+{
+    RT_SCOPE("dualie_render");
+    ScopedFlushToZero ftz;
+    size_t            pos = 0;
+    while(pos < frames)
+    {
+        if(instance->partial_pos < BLOCK_SIZE)
+        {
+            size_t n = std::min<size_t>(BLOCK_SIZE - instance->partial_pos, frames - pos);
+            arm_copy_f32(instance->partial + instance->partial_pos, left + pos, n);
+            instance->partial_pos += n;
+            pos += n;
+        }
+        else if(frames - pos >= BLOCK_SIZE)
+        {
+            RenderBlock(instance, left + pos);
+            pos += BLOCK_SIZE;
+        }
+        else
+        {
+            RenderBlock(instance, instance->partial);
+            instance->partial_pos = 0;
+        }
+    }
+    if(right)
+    {
+        arm_copy_f32(left, right, frames);
+    }
+    instance->time += frames;
+}
+
+void dualie_load_controls(DualieInstance *instance, const uint8_t *controls, int crossfade)
+{
+    instance->engine.LoadPreset(controls, crossfade != 0);
+}
+
+int dualie_get_control(const DualieInstance *instance, int control)
+{
+    if(control < 0 || control >= NUM_CONTROLS)
+    {
+        return -1;
+    }
+    return instance->engine.GetControls()[control];
+}
+
+const char *dualie_control_name(int control)
+{
+    return PresetControlName(control);
+}
+
+uint32_t dualie_active_voices(DualieInstance *instance)
+{
+    return instance->engine.NumActiveVoices();
+}
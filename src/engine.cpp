@@ -0,0 +1,456 @@
+#include <string.h>
+#include <atomic>
+#include <Utility/dsp.h>
+#include <arm_math.h>
+
+#include "../include/engine.h"
+#include "../include/trace.h"
+#include "../include/rtcheck.h"
+
+using namespace daisysp;
+
+const ControlValues DefaultControls = {
+    0, // Osc1Waveform
+    127, // Osc1PulseWidth
+    0, // Osc1FrequencyMod
+    0, // Osc1PWMod
+    0, // Osc2Waveform
+    127, // Osc2PulseWidth
+    0, // Osc2FrequencyMod
+    0, // Osc2PWMod
+    64, // Osc2TuneCents
+    64, // Osc2TuneOctave
+    0, // Osc2Sync
+    0, // Noise
+    64, // OscMix
+    0, // OscSplit
+    127, // FilterCutoff
+    0, // FilterResonance
+    0, // FilterLFOMod
+    0, // FilterVelocityMod
+    0, // FilterKeybedTrack
+    0, // FilterAttack
+    0, // FilterDecay
+    127, // FilterSustain
+    0, // FilterRelease
+    2, // AmpAttack
+    2, // AmpDecay
+    127, // AmpSustain
+    2, // AmpRelease
+    0, // AmpLFOMod
+    0, // LFOWaveform
+    0, // LFOFrequency
+    0, // LFOTempoSync
+    0, // FXType
+    0, // FXParam1
+    0, // FXParam2
+    0, // FXMix
+    0, // NoiseType
+    0, // Osc2PhaseMod
+    0, // RingMod
+    0 // FilterType
+};
+
+Engine::Engine()
+: clock_tick_rate_(0.f), clock_position_(0), clock_count_(0), active_patch_(&patches_[0]), pending_patch_(nullptr),
+  notes_released_(0), notes_played_(0), pending_crossfade_(false)
+{
+    memcpy(controls_, DefaultControls, sizeof(controls_));
+}
+
+void Engine::ActivatePatch(const Patch &patch)
+{
+    mgr_.ApplyPatch(patch);
+    for(int i = 0; i < NUM_LFOS; i++)
+    {
+        lfos_[i].SetWaveform(patch.lfo[i].waveform);
+        //Synced LFOs also run free at this rate until a clock arrives
+        lfos_[i].SetFreq(patch.lfo[i].freq);
+    }
+}
+
+//LFOs without a bit in sources are only advanced, nothing reads their output
+void Engine::ProcessLfos(const Patch &patch, size_t size, uint32_t sources)
+{
+    //Fraction of the phase error removed on every clock tick
+    const float kLockAmount = 0.1f;
+
+    float    tick_rate = clock_tick_rate_.load(std::memory_order_relaxed);
+    uint32_t count     = clock_count_.load(std::memory_order_acquire);
+    uint32_t position  = clock_position_.load(std::memory_order_relaxed);
+    bool     ticked    = count != clock_count_seen_;
+    //The position only goes backwards on a Start, which snaps the LFOs to the downbeat
+    bool     restarted = ticked && position < clock_position_seen_;
+    clock_count_seen_    = count;
+    clock_position_seen_ = position;
+
+    for(int i = 0; i < NUM_LFOS; i++)
+    {
+        uint16_t sync_ticks = patch.lfo[i].sync_ticks;
+        if(sync_ticks && tick_rate > 0.f)
+        {
+            lfos_[i].SetFreq(tick_rate / sync_ticks);
+            if(ticked)
+            {
+                lfos_[i].Nudge((float)(position % sync_ticks) / sync_ticks, restarted ? 1.f : kLockAmount);
+            }
+        }
+        if(sources & (1u << (MOD_SRC_LFO1 + i)))
+        {
+            lfos_[i].ProcessBlock(lfo_out_[i], size);
+        }
+        else
+        {
+            lfos_[i].Skip();
+        }
+    }
+}
+
+void Engine::Init(float sample_rate, uint8_t oversample)
+{
+    sample_rate_ = sample_rate;
+    mgr_.Init(sample_rate, oversample);
+    for(int i = 0; i < NUM_LFOS; i++)
+    {
+        lfos_[i].Init(sample_rate / BLOCK_SIZE);
+    }
+    lfo_sample_ = BLOCK_SIZE;
+
+    tempo_.Init();
+    clock_tick_rate_.store(0.f);
+    clock_position_.store(0);
+    clock_count_.store(0);
+    clock_count_seen_    = 0;
+    clock_position_seen_ = 0;
+
+    //Audio is not running yet, so the first patch is made active directly
+    memcpy(patches_[0].controls, controls_, sizeof(controls_));
+    PatchCompute(patches_[0], sample_rate);
+    ActivatePatch(patches_[0]);
+    active_patch_.store(&patches_[0]);
+    pending_patch_.store(nullptr);
+    controls_changed_ = 0;
+    patch_crossfade_  = false;
+    control_stats_    = ControlStats();
+    notes_written_    = 0;
+    memset(release_mask_, 0, sizeof(release_mask_));
+    notes_released_.store(0);
+    notes_played_.store(0);
+    fade_block_       = PATCH_CROSSFADE_BLOCKS;
+}
+
+float Engine::Process()
+{
+    RT_SCOPE("Engine::Process");
+    if(lfo_sample_ >= BLOCK_SIZE)
+    {
+        //Takes the pending patch and its notes like ProcessBlock, but renders without the glide
+        SwapPatch();
+        //The per sample path reads LFO1 directly
+        ProcessLfos(*active_patch_.load(std::memory_order_relaxed), BLOCK_SIZE, 1u << MOD_SRC_LFO1);
+        lfo_sample_ = 0;
+    }
+    const Patch *patch = active_patch_.load(std::memory_order_relaxed);
+    return mgr_.Process(patch->values, lfo_out_[0][lfo_sample_++]);
+}
+
+//Called at the start of every block, the only place voices are reconfigured
+const float *Engine::SwapPatch()
+{
+    //Read before the patch, so a note released with a patch never plays ahead of it
+    uint32_t released = notes_released_.load(std::memory_order_acquire);
+    Patch   *next     = pending_patch_.load(std::memory_order_acquire);
+    Patch   *prev     = active_patch_.load(std::memory_order_relaxed);
+    if(next != nullptr)
+    {
+        //Continue from wherever a running fade currently is. A patch without crossfade that
+        //arrives mid fade glides from there as well instead of snapping every value to its target
+        bool fading = fade_block_ < PATCH_CROSSFADE_BLOCKS;
+        if(pending_crossfade_.load(std::memory_order_relaxed) || fading)
+        {
+            memcpy(fade_from_, fading ? fade_values_ : prev->values, sizeof(fade_from_));
+            fade_block_ = 0;
+        }
+        ActivatePatch(*next);
+        TRACE(TRACE_PATCH_APPLY, 0, fade_block_ == 0);
+        active_patch_.store(next, std::memory_order_relaxed);
+        //Hands prev back to the main loop
+        pending_patch_.store(nullptr, std::memory_order_release);
+        prev = next;
+    }
+    PlayNotes(released);
+
+    if(fade_block_ >= PATCH_CROSSFADE_BLOCKS)
+    {
+        return prev->values;
+    }
+
+    //Discrete settings (waveforms) switched with the flip, continuous ones glide over the fade
+    fade_block_++;
+    float t = (float)fade_block_ / PATCH_CROSSFADE_BLOCKS;
+    for(int i = 0; i < NUM_CONTROLS; i++)
+    {
+        fade_values_[i] = fade_from_[i] + t * (prev->values[i] - fade_from_[i]);
+    }
+    return fade_values_;
+}
+
+void Engine::ProcessBlock(float *buf, size_t size)
+{
+    RT_SCOPE("Engine::ProcessBlock");
+    TRACE(TRACE_BLOCK_BEGIN, 0, 0);
+    const float *values = SwapPatch();
+    ProcessLfos(*active_patch_.load(std::memory_order_relaxed), size, mgr_.UpdateRoutes(values).GetSources());
+
+    //Voices are summed into buf
+    arm_fill_f32(0, buf, size);
+    mgr_.ProcessBlock(buf, values, lfo_out_, size);
+    TRACE(TRACE_BLOCK_END, mgr_.GetNumActiveVoices(), 0);
+}
+
+bool Engine::Update()
+{
+    FlushReleases();
+    if(!controls_changed_)
+    {
+        return true;
+    }
+    //The audio callback still owns both snapshots until it has taken the pending one
+    if(pending_patch_.load(std::memory_order_acquire) != nullptr)
+    {
+        return false;
+    }
+
+    //The other snapshot is two patches old, so it starts from the active one
+    Patch *active = active_patch_.load(std::memory_order_relaxed);
+    Patch *next   = active == &patches_[0] ? &patches_[1] : &patches_[0];
+    *next         = *active;
+    memcpy(next->controls, controls_, sizeof(controls_));
+    PatchCompute(*next, sample_rate_, controls_changed_);
+
+    pending_crossfade_.store(patch_crossfade_, std::memory_order_relaxed);
+    pending_patch_.store(next, std::memory_order_release);
+    //After the patch, see SwapPatch. The notes queued behind these controls go out with them
+    notes_released_.store(notes_written_, std::memory_order_release);
+    control_stats_.applied += __builtin_popcountll(controls_changed_);
+    control_stats_.patches++;
+    controls_changed_ = 0;
+    patch_crossfade_  = false;
+    return true;
+}
+
+void Engine::LoadPreset(const uint8_t *controls, bool crossfade)
+{
+    memcpy(controls_, controls, sizeof(controls_));
+    controls_changed_ = PATCH_ALL_CONTROLS;
+    patch_crossfade_  = patch_crossfade_ || crossfade;
+    Update();
+}
+
+void Engine::WriteNote(uint8_t note, uint8_t velocity, bool on)
+{
+    notes_[notes_written_ & (DUALIE_NOTE_QUEUE_SIZE - 1)] = {note, velocity, on};
+    notes_written_++;
+    //With every control published the note only waits for the pending patch, if there is one
+    if(!controls_changed_)
+    {
+        notes_released_.store(notes_written_, std::memory_order_release);
+    }
+}
+
+//Queues the note offs that found the queue full, returns false if some still do not fit
+bool Engine::FlushReleases()
+{
+    uint32_t played = notes_played_.load(std::memory_order_acquire);
+    for(int i = 0; i < 4; i++)
+    {
+        while(release_mask_[i])
+        {
+            if(notes_written_ - played >= DUALIE_NOTE_QUEUE_SIZE)
+            {
+                return false;
+            }
+            int bit = __builtin_ctz(release_mask_[i]);
+            WriteNote(i * 32 + bit, 0, false);
+            release_mask_[i] &= release_mask_[i] - 1;
+        }
+    }
+    return true;
+}
+
+void Engine::QueueNote(uint8_t note, uint8_t velocity, bool on)
+{
+    //Waiting note offs go first, anything sent after them waits behind them as well
+    if(FlushReleases() && notes_written_ - notes_played_.load(std::memory_order_acquire) < DUALIE_NOTE_QUEUE_SIZE)
+    {
+        WriteNote(note, velocity, on);
+    }
+    else if(on)
+    {
+        TRACE(TRACE_VOICE_DROP, note, 0);
+    }
+    else
+    {
+        //Releasing the same note twice is the same as once, so one bit per note is enough
+        release_mask_[(note & 127) >> 5] |= 1u << (note & 31);
+    }
+}
+
+//Plays the queued notes up to released, audio side
+void Engine::PlayNotes(uint32_t released)
+{
+    for(uint32_t i = notes_played_.load(std::memory_order_relaxed); i != released; i++)
+    {
+        const QueuedNote &n = notes_[i & (DUALIE_NOTE_QUEUE_SIZE - 1)];
+        if(n.on)
+        {
+            mgr_.OnNoteOn(n.note, n.velocity);
+        }
+        else
+        {
+            mgr_.OnNoteOff(n.note, n.velocity);
+        }
+    }
+    notes_played_.store(released, std::memory_order_release);
+}
+
+void Engine::NoteOn(uint8_t note, uint8_t velocity)
+{
+    RT_SCOPE("Engine::NoteOn");
+    TRACE(TRACE_NOTE_ON, note, velocity);
+    QueueNote(note, velocity, true);
+}
+
+void Engine::NoteOff(uint8_t note, uint8_t velocity)
+{
+    RT_SCOPE("Engine::NoteOff");
+    TRACE(TRACE_NOTE_OFF, note, velocity);
+    QueueNote(note, velocity, false);
+}
+
+uint8_t Engine::NumActiveVoices()
+{
+    return mgr_.GetNumActiveVoices();
+}
+
+void Engine::ClockTick(uint32_t time_us)
+{
+    tempo_.Tick(time_us);
+    float tick_rate = tempo_.GetTickRate();
+    //Keep the last tempo while the estimator restarts after a jump
+    if(tick_rate > 0.f)
+    {
+        clock_tick_rate_.store(tick_rate, std::memory_order_relaxed);
+    }
+    clock_position_.store(tempo_.GetPosition(), std::memory_order_relaxed);
+    clock_count_.fetch_add(1, std::memory_order_release);
+    TRACE(TRACE_CLOCK, Tempo() < 255.f ? Tempo() : 255.f, 0);
+}
+
+void Engine::ClockStart()
+{
+    tempo_.Start();
+}
+
+float Engine::Tempo() const
+{
+    return clock_tick_rate_.load(std::memory_order_relaxed) * (60.f / 24.f);
+}
+
+void Engine::HandleControls(int ctrlValue, int param, bool midiCC)
+{
+    if (param < 0 || param >= NUM_CONTROLS)
+    {
+        return;
+    }
+
+    //Process paramater value changed
+    uint8_t previous = controls_[param];
+    if (midiCC)
+    {
+        controls_[param] = ctrlValue;
+    }
+        else
+    {
+        controls_[param] += ctrlValue;
+    }
+
+    //Applied to the voices as part of the next published patch, a control that is back at its
+    //published value stays marked, it is cheaper to convert it again than to compare
+    control_stats_.received++;
+    if(controls_[param] != previous)
+    {
+        controls_changed_ |= PATCH_CONTROL_BIT(param);
+    }
+    TRACE(TRACE_CONTROL, param, controls_[param]);
+}
+
+/* The firmware's engine */
+
+static Engine  engine;
+ControlValues &ControlPanel = engine.GetControls();
+
+void EngineInit(float sample_rate, uint8_t oversample)
+{
+    engine.Init(sample_rate, oversample);
+}
+
+float EngineProcess()
+{
+    return engine.Process();
+}
+
+void EngineProcessBlock(float *buf, size_t size)
+{
+    engine.ProcessBlock(buf, size);
+}
+
+void EngineNoteOn(uint8_t note, uint8_t velocity)
+{
+    engine.NoteOn(note, velocity);
+}
+
+void EngineNoteOff(uint8_t note, uint8_t velocity)
+{
+    engine.NoteOff(note, velocity);
+}
+
+uint8_t EngineNumActiveVoices()
+{
+    return engine.NumActiveVoices();
+}
+
+bool EngineUpdate()
+{
+    return engine.Update();
+}
+
+void EngineLoadPreset(const uint8_t *controls, bool crossfade)
+{
+    engine.LoadPreset(controls, crossfade);
+}
+
+void EngineClockTick(uint32_t time_us)
+{
+    engine.ClockTick(time_us);
+}
+
+void EngineClockStart()
+{
+    engine.ClockStart();
+}
+
+float EngineTempo()
+{
+    return engine.Tempo();
+}
+
+void HandleControls(int ctrlValue, int param, bool midiCC)
+{
+    engine.HandleControls(ctrlValue, param, midiCC);
+}
+
+ControlStats EngineGetControlStats()
+{
+    return engine.GetControlStats();
+}
@@ -0,0 +1,38 @@
+#include <string.h>
+
+#include "../include/halfband.h"
+
+using namespace custom;
+
+//Coefficients at offsets 1, 3, 5 .. from the center tap, normalized to unity gain at DC
+static const float kCenter               = 4.999953968e-01f;
+static const float kPairs[HALFBAND_PAIRS] = {
+    3.160629272e-01f,  -9.953458607e-02f, 5.323959887e-02f,  -3.190621361e-02f,
+    1.951168291e-02f,  -1.168538444e-02f, 6.670847535e-03f,  -3.539467929e-03f,
+    1.690651057e-03f,  -6.900036242e-04f, 2.146042534e-04f,  -3.236808698e-05f,
+};
+
+void HalfbandDecimator::Init()
+{
+    memset(history_, 0, sizeof(history_));
+}
+
+void HalfbandDecimator::Process(const float *in, float *out, size_t size)
+{
+    const size_t keep = 2 * HALFBAND_DELAY;
+    memcpy(history_ + keep, in, 2 * size * sizeof(float));
+
+    for(size_t n = 0; n < size; n++)
+    {
+        //Center of the filter for output n, the odd offsets around it are the other phase
+        const float *x   = history_ + 2 * n + HALFBAND_DELAY;
+        float        acc = kCenter * x[0];
+        for(int j = 0; j < HALFBAND_PAIRS; j++)
+        {
+            acc += kPairs[j] * (x[-(2 * j + 1)] + x[2 * j + 1]);
+        }
+        out[n] = acc;
+    }
+
+    memmove(history_, history_ + 2 * size, keep * sizeof(float));
+}
@@ -0,0 +1,126 @@
+#include <math.h>
+
+#include "../include/lfo.h"
+#include "../include/sine.h"
+
+using namespace custom;
+
+//An LFO is evaluated once per block and needs far less precision than an audio oscillator
+#ifndef DUALIE_LFO_SINE
+#define DUALIE_LFO_SINE SINE_TABLE
+#endif
+
+void Lfo::Init(float block_rate)
+{
+    block_recip_ = 1.0f / block_rate;
+    waveform_    = WAVE_SIN;
+    phase_       = 0.0f;
+    inc_         = 0.0f;
+    last_        = Evaluate(phase_);
+}
+
+float Lfo::Evaluate(float phase) const
+{
+    switch(waveform_)
+    {
+        case WAVE_SIN: return Sine<DUALIE_LFO_SINE>(phase);
+        case WAVE_TRI: return 2.0f * (fabsf(2.0f * phase - 1.0f) - 0.5f);
+        case WAVE_SAW: return 1.0f - 2.0f * phase;
+        case WAVE_RAMP: return 2.0f * phase - 1.0f;
+        case WAVE_SQUARE: return phase < 0.5f ? 1.0f : -1.0f;
+        default: return 0.0f;
+    }
+}
+
+void Lfo::Nudge(float target, float amount)
+{
+    float error = target - phase_;
+    error -= error > 0.5f ? 1.0f : 0.0f;
+    error += error < -0.5f ? 1.0f : 0.0f;
+    phase_ += error * amount;
+    phase_ += phase_ < 0.0f ? 1.0f : 0.0f;
+    phase_ -= phase_ >= 1.0f ? 1.0f : 0.0f;
+}
+
+float Lfo::Process()
+{
+    phase_ += inc_;
+    phase_ -= phase_ >= 1.0f ? 1.0f : 0.0f;
+    last_ = Evaluate(phase_);
+    return last_;
+}
+
+void Lfo::ProcessBlock(float *buf, size_t size)
+{
+    float start = last_;
+    float step  = (Process() - start) / size;
+    for(size_t i = 0; i < size; i++)
+    {
+        buf[i] = start + step * (i + 1);
+    }
+}
+
+void TempoEstimator::Init()
+{
+    last_us_       = 0;
+    position_      = 0;
+    next_interval_ = 0;
+    num_intervals_ = 0;
+    outliers_      = 0;
+    period_us_     = 0.0f;
+    started_       = false;
+    has_last_      = false;
+}
+
+void TempoEstimator::Start()
+{
+    started_ = true;
+}
+
+static inline uint32_t Median3(uint32_t a, uint32_t b, uint32_t c)
+{
+    uint32_t lo = a < b ? a : b;
+    uint32_t hi = a < b ? b : a;
+    return c < lo ? lo : (c > hi ? hi : c);
+}
+
+void TempoEstimator::Tick(uint32_t time_us)
+{
+    //Smoothing factor per tick, settles within a couple of beats after a tempo change
+    const float kSmoothing = 0.05f;
+
+    position_ = started_ ? 0 : position_ + 1;
+    started_  = false;
+
+    //Unsigned difference stays correct across counter wrap around
+    uint32_t interval = time_us - last_us_;
+    bool     first    = !has_last_;
+    last_us_          = time_us;
+    has_last_         = true;
+    if(first)
+    {
+        return;
+    }
+
+    //Glitches are a dropped tick or two ticks handled in the same loop pass
+    if(period_us_ > 0.0f && (interval > 2.0f * period_us_ || interval < 0.5f * period_us_))
+    {
+        if(++outliers_ < 3)
+        {
+            return;
+        }
+        num_intervals_ = 0;
+        period_us_     = 0.0f;
+    }
+    outliers_ = 0;
+
+    intervals_[next_interval_] = interval;
+    next_interval_             = (next_interval_ + 1) % 3;
+    if(num_intervals_ < 3 && ++num_intervals_ < 3)
+    {
+        return;
+    }
+
+    float median = Median3(intervals_[0], intervals_[1], intervals_[2]);
+    period_us_   = period_us_ > 0.0f ? period_us_ + kSmoothing * (median - period_us_) : median;
+}
@@ -0,0 +1,336 @@
+#include <string.h>
+
+#include "../include/log.h"
+
+static_assert((DUALIE_LOG_SIZE & (DUALIE_LOG_SIZE - 1)) == 0, "DUALIE_LOG_SIZE must be a power of two");
+
+static LogRecord             ring[DUALIE_LOG_SIZE];
+static std::atomic<uint32_t> next_write{0};
+static std::atomic<uint32_t> next_read{0};
+static std::atomic<uint32_t> recorded{0}, full{0};
+
+//Flush side only
+static uint32_t (*clock_ms)();
+static uint32_t lines_per_second;
+static uint32_t written;
+static uint32_t tokens, last_refill;
+static uint32_t reported_full;
+
+static uint32_t NoClock()
+{
+    return 0;
+}
+
+void LogInit(uint32_t (*now_ms)(), uint32_t rate)
+{
+    clock_ms         = now_ms ? now_ms : NoClock;
+    lines_per_second = rate;
+    for(size_t i = 0; i < DUALIE_LOG_SIZE; i++)
+    {
+        ring[i].seq.store(UINT32_MAX, std::memory_order_relaxed);
+    }
+    next_write.store(0, std::memory_order_relaxed);
+    next_read.store(0, std::memory_order_relaxed);
+    recorded.store(0, std::memory_order_relaxed);
+    full.store(0, std::memory_order_relaxed);
+    written       = 0;
+    tokens        = rate;
+    last_refill   = clock_ms();
+    reported_full = 0;
+}
+
+bool LogWrite(const char *format, const LogArg *args, uint8_t num_args)
+{
+    //Claims a slot only while the reader is less than a full ring behind
+    uint32_t seq = next_write.load(std::memory_order_relaxed);
+    do
+    {
+        if(seq - next_read.load(std::memory_order_acquire) >= DUALIE_LOG_SIZE)
+        {
+            full.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    } while(!next_write.compare_exchange_weak(seq, seq + 1, std::memory_order_relaxed));
+
+    LogRecord &r = ring[seq & (DUALIE_LOG_SIZE - 1)];
+    r.format     = format;
+    r.num_args   = num_args;
+    memcpy(r.args, args, num_args * sizeof(LogArg));
+    r.seq.store(seq, std::memory_order_release);
+    recorded.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+static bool ReportDue()
+{
+    return reported_full != full.load(std::memory_order_relaxed);
+}
+
+bool LogPending()
+{
+    return next_read.load(std::memory_order_relaxed) != next_write.load(std::memory_order_acquire) || ReportDue();
+}
+
+LogStats LogGetStats()
+{
+    LogStats stats;
+    stats.recorded = recorded.load(std::memory_order_relaxed);
+    stats.written  = written;
+    stats.full     = full.load(std::memory_order_relaxed);
+    return stats;
+}
+
+//Takes a token for one line, refilled at lines_per_second up to one second's worth
+static bool TakeToken()
+{
+    if(lines_per_second == 0)
+    {
+        return true;
+    }
+    uint32_t now     = clock_ms();
+    uint32_t elapsed = now - last_refill;
+    uint32_t refill  = (uint32_t)((uint64_t)elapsed * lines_per_second / 1000);
+    if(refill > 0)
+    {
+        tokens = tokens + refill < lines_per_second ? tokens + refill : lines_per_second;
+        //Keep the remainder of the interval that did not make a whole token
+        last_refill += (uint32_t)((uint64_t)refill * 1000 / lines_per_second);
+    }
+    if(tokens == 0)
+    {
+        return false;
+    }
+    tokens--;
+    return true;
+}
+
+size_t LogFlush(void (*sink)(const char *line), size_t max_lines)
+{
+    char   line[LOG_LINE_LENGTH];
+    size_t lines = 0;
+
+    if(lines < max_lines && ReportDue() && TakeToken())
+    {
+        uint32_t  now_full = full.load(std::memory_order_relaxed);
+        LogRecord report;
+        report.format   = "log: dropped %u full";
+        report.args[0]  = LogMakeArg(now_full - reported_full);
+        report.num_args = 1;
+        LogFormat(report, line, sizeof(line));
+        sink(line);
+        reported_full = now_full;
+        written++;
+        lines++;
+    }
+
+    uint32_t read = next_read.load(std::memory_order_relaxed);
+    while(lines < max_lines && read != next_write.load(std::memory_order_acquire))
+    {
+        LogRecord &r = ring[read & (DUALIE_LOG_SIZE - 1)];
+        //Claimed but not filled in yet
+        if(r.seq.load(std::memory_order_acquire) != read || !TakeToken())
+        {
+            break;
+        }
+        LogFormat(r, line, sizeof(line));
+        r.seq.store(UINT32_MAX, std::memory_order_relaxed);
+        //Frees the slot for writers
+        next_read.store(++read, std::memory_order_release);
+        sink(line);
+        written++;
+        lines++;
+    }
+    return lines;
+}
+
+/* Formatting */
+
+struct Output
+{
+    char  *buf;
+    size_t size, len;
+
+    void Put(char c)
+    {
+        if(len + 1 < size)
+        {
+            buf[len] = c;
+        }
+        len++;
+    }
+};
+
+//Writes digits with padding, sign and prefix already decided
+static void PutField(Output &out, const char *sign, const char *digits, size_t num_digits, int width, bool left, bool zero)
+{
+    int pad = width - (int)(strlen(sign) + num_digits);
+    if(!left && !zero)
+    {
+        for(; pad > 0; pad--)
+            out.Put(' ');
+    }
+    for(; *sign; sign++)
+        out.Put(*sign);
+    if(!left && zero)
+    {
+        for(; pad > 0; pad--)
+            out.Put('0');
+    }
+    for(size_t i = 0; i < num_digits; i++)
+        out.Put(digits[i]);
+    for(; left && pad > 0; pad--)
+        out.Put(' ');
+}
+
+//Digits of value in base, most significant first, into tmp (at least 20 chars). Returns the count
+static size_t Digits(uint64_t value, unsigned base, bool upper, char *tmp)
+{
+    const char *set = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char        rev[20];
+    size_t      n = 0;
+    do
+    {
+        rev[n++] = set[value % base];
+        value /= base;
+    } while(value);
+    for(size_t i = 0; i < n; i++)
+        tmp[i] = rev[n - 1 - i];
+    return n;
+}
+
+static void PutFloat(Output &out, float v, int precision, int width, bool left, bool zero)
+{
+    char tmp[40];
+    if(v != v)
+    {
+        PutField(out, "", "nan", 3, width, left, false);
+        return;
+    }
+    const char *sign = v < 0.f ? "-" : "";
+    float       mag  = v < 0.f ? -v : v;
+    precision = precision < 0 ? 6 : (precision > 9 ? 9 : precision);
+    uint64_t scale = 1;
+    for(int i = 0; i < precision; i++)
+        scale *= 10;
+    //Digits have to fit 64 bits, large values lose decimals first
+    for(; precision > 0 && (double)mag * scale >= 1e19; precision--)
+        scale /= 10;
+    if((double)mag * scale >= 1e19)
+    {
+        PutField(out, sign, "inf", 3, width, left, false);
+        return;
+    }
+    //Rounds once at the last printed digit
+    double   scaled = (double)mag * scale + 0.5;
+    uint64_t whole  = (uint64_t)(scaled / scale);
+    uint64_t frac   = (uint64_t)scaled - whole * scale;
+    size_t   n      = Digits(whole, 10, false, tmp);
+    if(precision > 0)
+    {
+        tmp[n++] = '.';
+        char   fdig[20];
+        size_t fn = Digits(frac, 10, false, fdig);
+        for(size_t i = fn; i < (size_t)precision; i++)
+            tmp[n++] = '0';
+        memcpy(tmp + n, fdig, fn);
+        n += fn;
+    }
+    PutField(out, sign, tmp, n, width, left, zero);
+}
+
+size_t LogFormat(const LogRecord &record, char *buf, size_t size)
+{
+    Output      out = {buf, size, 0};
+    const char *p   = record.format;
+    uint8_t     arg = 0;
+    while(*p)
+    {
+        if(*p != '%')
+        {
+            out.Put(*p++);
+            continue;
+        }
+        p++;
+        bool left = false, zero = false;
+        for(; *p == '-' || *p == '0'; p++)
+        {
+            left |= *p == '-';
+            zero |= *p == '0';
+        }
+        int width = 0, precision = -1;
+        for(; *p >= '0' && *p <= '9'; p++)
+            width = width * 10 + (*p - '0');
+        if(*p == '.')
+        {
+            precision = 0;
+            for(p++; *p >= '0' && *p <= '9'; p++)
+                precision = precision * 10 + (*p - '0');
+        }
+        while(*p == 'l' || *p == 'h' || *p == 'z')
+            p++;
+        char conv = *p;
+        if(conv == '\0')
+            break;
+        p++;
+        if(conv == '%')
+        {
+            out.Put('%');
+            continue;
+        }
+
+        //Missing arguments print as '?', conversions follow the stored type where they disagree
+        if(arg >= record.num_args)
+        {
+            out.Put('?');
+            continue;
+        }
+        const LogArg &a = record.args[arg++];
+        char          tmp[24];
+        switch(conv)
+        {
+            case 'f':
+            {
+                float f = a.type == LOG_ARG_FLOAT ? a.f : (a.type == LOG_ARG_INT ? (float)a.i : (float)a.u);
+                PutFloat(out, f, precision, width, left, zero);
+                break;
+            }
+            case 's':
+            {
+                const char *s = a.type == LOG_ARG_STRING && a.s ? a.s : "?";
+                size_t      n = strlen(s);
+                if(precision >= 0 && (size_t)precision < n)
+                    n = precision;
+                PutField(out, "", s, n, width, left, false);
+                break;
+            }
+            case 'c':
+                tmp[0] = (char)a.i;
+                PutField(out, "", tmp, 1, width, left, false);
+                break;
+            case 'x':
+            case 'X':
+            {
+                uint32_t u = a.type == LOG_ARG_FLOAT ? (uint32_t)a.f : a.u;
+                PutField(out, "", tmp, Digits(u, 16, conv == 'X', tmp), width, left, zero);
+                break;
+            }
+            case 'u':
+            {
+                uint32_t u = a.type == LOG_ARG_FLOAT ? (uint32_t)a.f : a.u;
+                PutField(out, "", tmp, Digits(u, 10, false, tmp), width, left, zero);
+                break;
+            }
+            default: //d, i
+            {
+                int64_t v = a.type == LOG_ARG_FLOAT ? (int64_t)a.f : (a.type == LOG_ARG_UINT ? (int64_t)a.u : a.i);
+                PutField(out, v < 0 ? "-" : "", tmp, Digits(v < 0 ? -v : v, 10, false, tmp), width, left, zero);
+                break;
+            }
+        }
+    }
+    if(size > 0)
+    {
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    }
+    return out.len < size ? out.len : (size > 0 ? size - 1 : 0);
+}
@@ -3,583 +3,170 @@
 #include <arm_math.h>
 
 #include "../include/main.h"
-#include "../include/oscillator.h"
-#include "../include/adsr.h"
-#include "../include/moogladder.h"
-#include "../include/whitenoise.h"
-
+#include "../include/engine.h"
+#include "../include/preset.h"
+#include "../include/denormal.h"
+#include "../include/trace.h"
+#include "../include/log.h"
+#include "../include/blockstats.h"
+#include "../include/rtcheck.h"
+#include "../include/scratch.h"
+#include "../include/stackpaint.h"
+
+//Preset bank in QSPI flash, read through the memory mapped window.
+//Must match PRESET_BANK_ADDRESS in the Makefile
+#define PRESET_BANK_ADDRESS 0x90700000
+//From there to the end of the 8 MB flash
+#define PRESET_BANK_SIZE 0x100000
+
+//Seconds covered by each block time report
+#define BLOCK_REPORT_INTERVAL 10
+
+//Milliseconds between CPU load reports
+#define LOAD_REPORT_INTERVAL 250
+
+//Stack painted below main before audio starts, the audio interrupt and the loop share it.
+//Must stay clear of the scratch arena at the bottom of DTCM
+#define STACK_PAINT_BYTES (16 * 1024)
+
+//Serial log lines per second, PrintLine blocks for the whole line so the loop is never held longer
+#define LOG_LINES_PER_SECOND 20
 
 using namespace std;
 using namespace daisy;
 using namespace daisysp;
 using namespace daisy::seed;
 
-#define BLOCK_SIZE 16
-
-static custom::Oscillator       lfo;
-
-//Midi control values (0-127) which are stored in EEPROM as a preset
-uint8_t ControlPanel[35] = {
-    0, // Osc1Waveform
-    127, // Osc1PulseWidth
-    0, // Osc1FrequencyMod
-    0, // Osc1PWMod
-    0, // Osc2Waveform
-    127, // Osc2PulseWidth
-    0, // Osc2FrequencyMod
-    0, // Osc2PWMod
-    64, // Osc2TuneCents
-    64, // Osc2TuneOctave
-    0, // Osc2Sync
-    0, // Noise
-    64, // OscMix
-    0, // OscSplit
-    127, // FilterCutoff
-    0, // FilterResonance
-    0, // FilterLFOMod
-    0, // FilterVelocityMod
-    0, // FilterKeybedTrack
-    0, // FilterAttack
-    0, // FilterDecay
-    127, // FilterSustain
-    0, // FilterRelease
-    2, // AmpAttack
-    2, // AmpDecay
-    127, // AmpSustain
-    2, // AmpRelease
-    0, // AmpLFOMod
-    0, // LFOWaveform
-    0, // LFOFrequency
-    0, // LFOTempoSync
-    0, // FXType
-    0, // FXParam1
-    0, // FXParam2
-    0 // FXMix
-};
-
-//Computed values of controls in respective units
-//These are computed outside of the Audio Callback for efficiency
-float ValuePanel[35] = {
-    0, // Osc1Waveform
-    0.5, // Osc1PulseWidth
-    0, // Osc1FrequencyMod
-    0, // Osc1PWMod
-    0, // Osc2Waveform
-    0.5, // Osc2PulseWidth
-    0, // Osc2FrequencyMod
-    0, // Osc2PWMod
-    0, // Osc2TuneCents
-    0, // Osc2TuneOctave
-    0, // Osc2Sync
-    0, // Noise
-    0.5, // OscMix
-    0, // OscSplit
-    40000, // FilterCutoff
-    0, // FilterResonance
-    0, // FilterLFOMod
-    0, // FilterVelocityMod
-    0, // FilterKeybedTrack
-    0, // FilterAttack
-    0, // FilterDecay
-    1, // FilterSustain
-    0, // FilterRelease
-    0.0625, // AmpAttack
-    0.0625, // AmpDecay
-    1, // AmpSustain
-    0.0625, // AmpRelease
-    0, // AmpLFOMod
-    0, // LFOWaveform
-    0, // LFOFrequency
-    0, // LFOTempoSync
-    0, // FXType
-    0, // FXParam1
-    0, // FXParam2
-    0 // FXMix
-};
-class Voice
-{
-  public:
-    Voice() {}
-    ~Voice() {}
-    void Init(float sample_rate)
-    {
-        osc1_.Init(sample_rate);
-        osc2_.Init(sample_rate);
-        noise_.Init();
-        amp_env_.Init(sample_rate);
-        filt_env_.Init(sample_rate);
-        filt_.Init(sample_rate);
-    }
-
-    void ProcessBlock(float *buf, float *pw1_out, float *pw2_out, 
-                        float *fm1_out, float *fm2_out, 
-                        float *filt_lfo, float *amp_lfo, size_t size)
-    {
-        float osc1_out[BLOCK_SIZE], osc2_out[BLOCK_SIZE], noise_out[BLOCK_SIZE], 
-            filt_freq[BLOCK_SIZE], filt_env_out[BLOCK_SIZE], filt_mod[BLOCK_SIZE], 
-            amp_out[BLOCK_SIZE], amp_env_out[BLOCK_SIZE], reset_vector[BLOCK_SIZE];
-        float velocity_freq, kbd_freq;
-
-        //Process osc1, resets disabled
-        osc1_.ProcessBlock(osc1_out, pw1_out, fm1_out, reset_vector, false, BLOCK_SIZE);
-
-        //Adjust tuning
-        osc2_.SetFreq(mtof(note_ + ValuePanel[CTRL_OSC2TUNECOARSE] + ValuePanel[CTRL_OSC2TUNEFINE]));
-
-        //Process osc2 with reset value set to ValuePanel[CTRL_OSC2SYNC]
-        osc2_.ProcessBlock(osc2_out, pw2_out, fm2_out, reset_vector, ValuePanel[CTRL_OSC2SYNC], BLOCK_SIZE);
-
-        //If CTRL_OSCSPLIT enabled, silence each oscillator on oposite sides
-        arm_scale_f32(osc1_out, split_high_, osc1_out, BLOCK_SIZE);
-        arm_scale_f32(osc2_out, split_low_, osc2_out, BLOCK_SIZE);
-
-        //Noise
-        noise_.ProcessBlock(noise_out, BLOCK_SIZE);
-
-        //Mixer
-        arm_scale_f32(osc1_out, (1-ValuePanel[CTRL_OSCMIX]), osc1_out, BLOCK_SIZE);
-        arm_scale_f32(osc2_out, ValuePanel[CTRL_OSCMIX], osc2_out, BLOCK_SIZE);
-        arm_add_f32(osc1_out, osc2_out, buf, BLOCK_SIZE);
-        arm_scale_f32(noise_out, ValuePanel[CTRL_NOISE], noise_out, BLOCK_SIZE);
-        arm_add_f32(buf, noise_out, buf, BLOCK_SIZE);
-
-        //Filter
-        arm_fill_f32(ValuePanel[CTRL_FILTERCUTOFF], filt_freq, BLOCK_SIZE);
-        //Note filter modulated by Envelope, Velocity and Keybed
-        //Velocity and keybed can add to the cutoff frequency
-        //Velocity - add 20khz * (velocity mod * velocity)
-        velocity_freq = 20000.f * ValuePanel[CTRL_FILTERVELOCITYMOD] * velocity_;
-        //Keybed - leaving this simple for now will refine later
-        kbd_freq = freq_ * ValuePanel[CTRL_FILTERKEYBEDTRACK];
-        //Add them to existing cutoff
-        arm_offset_f32(filt_freq, velocity_freq+kbd_freq, filt_freq, BLOCK_SIZE);
-        //Calculate filter envelope
-        filt_env_.ProcessBlock(filt_env_out, BLOCK_SIZE, env_gate_);
-        arm_mult_f32(filt_lfo, filt_env_out, filt_mod, BLOCK_SIZE);
-        arm_mult_f32(filt_mod, filt_freq, filt_freq, BLOCK_SIZE);
-        filt_.ProcessBlock(buf, filt_freq, BLOCK_SIZE);
-
-        //Amplifier
-        amp_env_.ProcessBlock(amp_env_out, BLOCK_SIZE, env_gate_);
-        arm_mult_f32(amp_env_out, amp_lfo, amp_out, BLOCK_SIZE);
-        arm_scale_f32(amp_out, velocity_, amp_out, BLOCK_SIZE);
-        arm_mult_f32(buf, amp_out, buf, BLOCK_SIZE);
-    }
-
-    float Process()
-    {
-        float sig, amp, lfo_out;
-        amp = amp_env_.Process(env_gate_); //change to account for both envelopes
-        if(!amp_env_.IsRunning())
-        {
-            return 0;
-        }
-
-        lfo_out = lfo.Process();
-
-        osc1_.SetAmp(0);
-        osc2_.SetAmp(0);
-
-        if (!ValuePanel[CTRL_OSCSPLIT] || note_ < 64 )
-        {
-            osc1_.SetAmp(velocity_ * (1-ValuePanel[CTRL_OSCMIX]));
-            osc1_.SetPw(ValuePanel[CTRL_OSC1PULSEWIDTH] 
-                            + (lfo_out * ValuePanel[CTRL_OSC1PWMOD] 
-                            * (0.5-ValuePanel[CTRL_OSC1PULSEWIDTH])));
-            osc1_.PhaseAdd(lfo_out * ValuePanel[CTRL_OSC1FREQUENCYMOD]);  //Not sure if PhaseAdd is the best way to do frequency modulation
-        }
-
-        if (!ValuePanel[CTRL_OSCSPLIT] || note_ > 63 )
-        {
-            osc2_.SetAmp(velocity_ * ValuePanel[CTRL_OSCMIX]);
-            osc2_.SetPw(ValuePanel[CTRL_OSC2PULSEWIDTH] 
-                            + (lfo_out * ValuePanel[CTRL_OSC2PWMOD] 
-                            * (0.5-ValuePanel[CTRL_OSC2PULSEWIDTH])));
-            osc2_.SetFreq(mtof(note_ + ValuePanel[CTRL_OSC2TUNECOARSE] + ValuePanel[CTRL_OSC2TUNEFINE]));
-            osc2_.PhaseAdd(lfo_out * ValuePanel[CTRL_OSC2FREQUENCYMOD]);
-            if(ValuePanel[CTRL_OSC2SYNC] && osc1_.IsEOC())
-            {
-                osc2_.Reset();
-            }
-        }
-
-        noise_.SetAmp(velocity_ * ValuePanel[CTRL_NOISE]);
-
-        sig = osc1_.Process() + osc2_.Process() + noise_.Process();
-
-        //doesn't sound very good
-        //filt_.SetFreq(ValuePanel[CTRL_FILTERCUTOFF] - (ValuePanel[CTRL_FILTERLFOMOD] * lfo_out * ValuePanel[CTRL_FILTERCUTOFF]));
-
-        return filt_.Process(sig * amp);
-    }
-
-    void OnNoteOn(uint8_t note, uint8_t velocity)
-    {
-        note_     = note;
-        velocity_ = velocity / 127.f;
-        freq_ = mtof(note_);
-        osc1_.SetFreq(freq_);
-        osc2_.SetFreq(freq_);
-        env_gate_ = true;
-        split_high_ = !ValuePanel[CTRL_OSCSPLIT] || note_ > 63;
-        split_low_ = !ValuePanel[CTRL_OSCSPLIT] || note_ < 64;
-        //Get envelope started so we can check if its active right away
-        //amp_env_.Process(env_gate_);
-        //filt_env_.Process(env_gate_);
-    }
+static const uint8_t   *preset_bank = (const uint8_t *)PRESET_BANK_ADDRESS;
+static bool             preset_bank_valid;
+static DaisySeed        hw;
+static Encoder          enc;
+MidiUartHandler         midi;
+CpuLoadMeter            loadMeter;
 
-    void OnNoteOff() { env_gate_ = false; }
+//Cycles in one block and the render times measured against it
+static uint32_t   block_deadline;
+static BlockStats block_stats;
 
-    void SetParam(int param) 
-    {
-        //Process paramater value changed
-        //TODO: investigate ways to calculate without using expensive divisions
-        //TODO: remove unecessary controls from the voice class and move to voice mgr
-        switch(param)
-        {
-            case CTRL_OSC1WAVEFORM: 
-                //Disabling polybleps until I optimize them
-                ValuePanel[CTRL_OSC1WAVEFORM] = ControlPanel[CTRL_OSC1WAVEFORM] / 26;
-                osc1_.SetWaveform(ValuePanel[CTRL_OSC1WAVEFORM]); 
-                break;
-            case CTRL_OSC1PULSEWIDTH:
-                ValuePanel[CTRL_OSC1PULSEWIDTH] = ControlPanel[CTRL_OSC1PULSEWIDTH] / 254.f;
-                break;
-            case CTRL_OSC1FREQUENCYMOD:
-                //change the scaling on this
-                ValuePanel[CTRL_OSC1FREQUENCYMOD] = ControlPanel[CTRL_OSC1FREQUENCYMOD] / 127.f;
-                break;
-            case CTRL_OSC1PWMOD:
-                ValuePanel[CTRL_OSC1PWMOD] = ControlPanel[CTRL_OSC1PWMOD] / 127.f;
-                break;
-            case CTRL_OSC2WAVEFORM:
-                ValuePanel[CTRL_OSC2WAVEFORM] = ControlPanel[CTRL_OSC2WAVEFORM] / 26;
-                osc2_.SetWaveform(ValuePanel[CTRL_OSC2WAVEFORM]); 
-                break;
-            case CTRL_OSC2PULSEWIDTH:
-                ValuePanel[CTRL_OSC2PULSEWIDTH] = ControlPanel[CTRL_OSC2PULSEWIDTH] / 254.f;
-                break;
-            case CTRL_OSC2FREQUENCYMOD:
-                ValuePanel[CTRL_OSC2FREQUENCYMOD] = ControlPanel[CTRL_OSC2FREQUENCYMOD] / 127.f;
-                break;
-            case CTRL_OSC2PWMOD:
-                ValuePanel[CTRL_OSC2PWMOD] = ControlPanel[CTRL_OSC2PWMOD] / 127.f;
-                break;
-            case CTRL_OSC2TUNEFINE:
-                ValuePanel[CTRL_OSC2TUNEFINE] = ((ControlPanel[CTRL_OSC2TUNEFINE] / 64.f) - 1); //cents
-                break;
-            case CTRL_OSC2TUNECOARSE:
-                ValuePanel[CTRL_OSC2TUNECOARSE] = ((int) (ControlPanel[CTRL_OSC2TUNECOARSE] / 2.646)) - 24.18; //semitones
-                break;
-            case CTRL_OSC2SYNC:
-                ValuePanel[CTRL_OSC2SYNC] = ControlPanel[CTRL_OSC2SYNC] ? 1 : 0;
-                break;
-            case CTRL_NOISE:
-                ValuePanel[CTRL_NOISE] = ControlPanel[CTRL_NOISE] / 127.f;
-                break;
-            case CTRL_OSCMIX:
-                ValuePanel[CTRL_OSCMIX] = ControlPanel[CTRL_OSCMIX] / 127.f;
-            case CTRL_OSCSPLIT:
-                ValuePanel[CTRL_OSCSPLIT] = ControlPanel[CTRL_OSCSPLIT] ? 1 : 0;
-                break;
-            case CTRL_FILTERCUTOFF:
-                //Use a Michaelis-Menten equation to scale frequency y = (-606.0853*x)/(-130.4988 + x)
-                ValuePanel[CTRL_FILTERCUTOFF] = (ControlPanel[CTRL_FILTERCUTOFF] * -606.0853) / (ControlPanel[CTRL_FILTERCUTOFF] - 130.4988);
-                filt_.SetFreq(ValuePanel[CTRL_FILTERCUTOFF]); 
-                break;
-            case CTRL_FILTERRESONANCE:
-                ValuePanel[CTRL_FILTERRESONANCE] = ControlPanel[CTRL_FILTERRESONANCE] / 134.0f;
-                filt_.SetRes(ValuePanel[CTRL_FILTERRESONANCE]); 
-                break;
-            case CTRL_FILTERLFOMOD:
-                ValuePanel[CTRL_FILTERLFOMOD] = ControlPanel[CTRL_FILTERLFOMOD] / 127.f;
-                break;
-            case CTRL_FILTERVELOCITYMOD:
-                ValuePanel[CTRL_FILTERVELOCITYMOD] = ControlPanel[CTRL_FILTERVELOCITYMOD] / 127.f;
-                break;
-            case CTRL_FILTERKEYBEDTRACK:
-                ValuePanel[CTRL_FILTERKEYBEDTRACK] = ControlPanel[CTRL_FILTERKEYBEDTRACK] / 127.f;
-                break;
-            case CTRL_FILTERATTACK:
-                ValuePanel[CTRL_FILTERATTACK] = ControlPanel[CTRL_FILTERATTACK] / 32.f;
-                filt_env_.SetTime(ADENV_SEG_ATTACK, (ValuePanel[CTRL_FILTERATTACK])); 
-                break;
-            case CTRL_FILTERDECAY:
-                ValuePanel[CTRL_FILTERDECAY] = ControlPanel[CTRL_FILTERDECAY] / 32.f;
-                filt_env_.SetTime(ADENV_SEG_DECAY, (ValuePanel[CTRL_FILTERDECAY])); 
-                break;
-            case CTRL_FILTERSUSTAIN:
-                ValuePanel[CTRL_FILTERSUSTAIN] = ControlPanel[CTRL_FILTERSUSTAIN] / 127.f;
-                filt_env_.SetSustainLevel(ValuePanel[CTRL_FILTERSUSTAIN]); 
-                break;
-            case CTRL_FILTERRELEASE: 
-                ValuePanel[CTRL_FILTERRELEASE] = ControlPanel[CTRL_FILTERRELEASE] / 64.f;
-                filt_env_.SetTime(ADSR_SEG_RELEASE, ValuePanel[CTRL_FILTERRELEASE]); 
-                break;
-            case CTRL_AMPATTACK:
-                ValuePanel[CTRL_AMPATTACK] = ControlPanel[CTRL_AMPATTACK] / 32.f;
-                amp_env_.SetTime(ADENV_SEG_ATTACK, (ValuePanel[CTRL_AMPATTACK])); 
-                break;
-            case CTRL_AMPDECAY:
-                ValuePanel[CTRL_AMPDECAY] = ControlPanel[CTRL_AMPDECAY] / 32.f;
-                amp_env_.SetTime(ADENV_SEG_DECAY, (ValuePanel[CTRL_AMPDECAY])); 
-                break;
-            case CTRL_AMPSUSTAIN:
-                ValuePanel[CTRL_AMPSUSTAIN] = ControlPanel[CTRL_AMPSUSTAIN] / 127.f;
-                amp_env_.SetSustainLevel(ValuePanel[CTRL_AMPSUSTAIN]); 
-                break;
-            case CTRL_AMPRELEASE: 
-                ValuePanel[CTRL_AMPRELEASE] = ControlPanel[CTRL_AMPRELEASE] / 64.f;
-                amp_env_.SetTime(ADSR_SEG_RELEASE, ValuePanel[CTRL_AMPRELEASE]); 
-                break;
-            case CTRL_AMPLFOMOD:
-                ValuePanel[CTRL_AMPLFOMOD] = ControlPanel[CTRL_AMPLFOMOD] / 127.f;
-                break;
-            default: break;
-        }
-    }
-
-    inline bool  IsActive() const { return amp_env_.IsRunning(); }
-    inline float GetNote() const { return note_; }
-
-  private:
-    custom::Oscillator osc1_;
-    custom::Oscillator osc2_;
-    custom::WhiteNoise noise_;
-    custom::MoogLadder filt_;
-    custom::Adsr       filt_env_;
-    custom::Adsr       amp_env_;
-    uint8_t            note_;
-    float              velocity_, freq_;
-    bool               env_gate_, split_high_, split_low_;
-};
-
-template <size_t max_voices>
-class VoiceManager
+static uint32_t LogClock()
 {
-  public:
-    VoiceManager() {}
-    ~VoiceManager() {}
-
-    void Init(float sample_rate)
-    {
-        for(size_t i = 0; i < max_voices; i++)
-        {
-            voices[i].Init(sample_rate);
-        }
-    }
-
-    float Process()
-    {
-        float sum;
-        sum = 0.f;
-        for(size_t i = 0; i < max_voices; i++)
-        {
-            sum += voices[i].Process();
-        }
-        return sum;
-    }
-
-    void ProcessBlock(float *buf, size_t size)
-    {
-        float lfo_out[BLOCK_SIZE], pw1_out[BLOCK_SIZE], pw2_out[BLOCK_SIZE], pwlfo_out[BLOCK_SIZE],
-                fm1_out[BLOCK_SIZE], fm2_out[BLOCK_SIZE], fmlfo_out[BLOCK_SIZE], reset_vector[BLOCK_SIZE],
-                filt_lfo[BLOCK_SIZE], amp_lfo[BLOCK_SIZE], one_array[BLOCK_SIZE];
-        float pw1_diff, pw2_diff;
-
-        float fm_rad1 = ValuePanel[CTRL_OSC1FREQUENCYMOD] * TWOPI_F;
-        float fm_rad2 = ValuePanel[CTRL_OSC2FREQUENCYMOD] * TWOPI_F;
-
-        //Set fixed values for LFO modulation buffers
-        arm_fill_f32(0.5, pwlfo_out, BLOCK_SIZE);
-        arm_fill_f32(0, fmlfo_out, BLOCK_SIZE);
-
-        //Array filled with 1s
-        arm_fill_f32(1, one_array, BLOCK_SIZE);
-
-        //Process LFO - Might be a good idea to give LFO its own process function
-        lfo.ProcessBlock(lfo_out, pwlfo_out, fmlfo_out, reset_vector, false, BLOCK_SIZE);
-
-        //Set modulated values for osc1
-        pw1_diff = 0.5-ValuePanel[CTRL_OSC1PULSEWIDTH];
-        arm_scale_f32(lfo_out, ValuePanel[CTRL_OSC1PWMOD], pw1_out, BLOCK_SIZE);
-        arm_scale_f32(pw1_out, pw1_diff, pw1_out, BLOCK_SIZE);
-        arm_offset_f32(pw1_out, ValuePanel[CTRL_OSC1PULSEWIDTH], pw1_out, BLOCK_SIZE);
-        arm_scale_f32(lfo_out, fm_rad1, fm1_out, BLOCK_SIZE);
-
-        //Set modulated values for osc2
-        pw2_diff = 0.5-ValuePanel[CTRL_OSC2PULSEWIDTH];
-        arm_scale_f32(lfo_out, ValuePanel[CTRL_OSC2PWMOD], pw2_out, BLOCK_SIZE);
-        arm_scale_f32(pw2_out, pw2_diff, pw2_out, BLOCK_SIZE);
-        arm_offset_f32(pw2_out, ValuePanel[CTRL_OSC2PULSEWIDTH], pw2_out, BLOCK_SIZE);
-        arm_scale_f32(lfo_out, fm_rad2, fm2_out, BLOCK_SIZE);
-
-        //Set modulated values for filter
-        //System wide filter is modulated from LFO
-        arm_scale_f32(lfo_out, ValuePanel[CTRL_FILTERLFOMOD], filt_lfo, BLOCK_SIZE);
-        //LFO mod becomes subtrahend with 1 as minuend, difference is multiplied to cutoff frequency
-        arm_sub_f32(one_array, filt_lfo, filt_lfo, BLOCK_SIZE);
-
-        arm_scale_f32(lfo_out, ValuePanel[CTRL_AMPLFOMOD], amp_lfo, BLOCK_SIZE);
-        arm_sub_f32(one_array, amp_lfo, amp_lfo, BLOCK_SIZE);
-
-        for(size_t i = 0; i < max_voices; i++)
-        {
-            //if(voices[i].IsActive())
-            //{
-                float temp[BLOCK_SIZE];
-                voices[i].ProcessBlock(temp, pw1_out, pw2_out, 
-                                        fm1_out, fm2_out, 
-                                        filt_lfo, amp_lfo, BLOCK_SIZE);
-                arm_add_f32(buf, temp, buf, BLOCK_SIZE);
-            //}
-        }
-    }
-
-    void OnNoteOn(uint8_t notenumber, uint8_t velocity)
-    {
-        Voice *v = FindFreeVoice();
-        if(v == NULL)
-            return;
-        v->OnNoteOn(notenumber, velocity);
-    }
+    return System::GetNow();
+}
 
-    void OnNoteOff(uint8_t notenumber, uint8_t velocity)
-    {
-        for(size_t i = 0; i < max_voices; i++)
-        {
-            Voice *v = &voices[i];
-            if(v->IsActive() && v->GetNote() == notenumber)
-            {
-                v->OnNoteOff();
-            }
-        }
-    }
+static void PrintLogLine(const char *line)
+{
+    hw.PrintLine("%s", line);
+}
 
-    void FreeAllVoices()
+//Logs how many control changes were coalesced, once a second while they arrive
+static void LogControlStats()
+{
+    static uint32_t last_time, last_received;
+    ControlStats    stats = EngineGetControlStats();
+    uint32_t        now   = System::GetNow();
+    if(stats.received == last_received || now - last_time < 1000)
     {
-        for(size_t i = 0; i < max_voices; i++)
-        {
-            voices[i].OnNoteOff();
-        }
+        return;
     }
+    LOG("cc: %u received, %u applied in %u patches", stats.received, stats.applied, stats.patches);
+    last_time     = now;
+    last_received = stats.received;
+}
 
-    void SetParam(int param)
+//Logs the average CPU load, whether MIDI arrives or not
+static void LogLoad()
+{
+    static uint32_t last_time;
+    uint32_t        now = System::GetNow();
+    if(now - last_time < LOAD_REPORT_INTERVAL)
     {
-        for(size_t i = 0; i < max_voices; i++)
-        {
-            voices[i].SetParam(param);
-        }
+        return;
     }
+    LOG("Avg: %.3f", loadMeter.GetAvgCpuLoad() * 100.0f);
+    last_time = now;
+}
 
-    uint8_t GetNumActiveVoices()
+//Logs the worst blocks of the last BLOCK_REPORT_INTERVAL seconds, see host/dualie-stress
+static void LogBlockStats()
+{
+    static uint32_t last_time;
+    uint32_t        now = System::GetNow();
+    if(now - last_time < BLOCK_REPORT_INTERVAL * 1000)
     {
-        uint8_t count = 0;
-        for(size_t i = 0; i < max_voices; i++)
-        {
-            if(voices[i].IsActive())
-            {
-                count++;
-            }
-        }
-        return count;
+        return;
     }
+    LOG("blocks: %u, max %.1f%%, p99.99 %.1f%%, %u late", block_stats.Count(), block_stats.MaxPercent(),
+        block_stats.Percentile(0.9999), block_stats.Late());
+    LOG("stack: %u of %u painted bytes used", StackHighWater(), StackPainted());
+    LOG("scratch: %u of %u bytes, %u full", Scratch().PeakBytes(), Scratch().CapacityBytes(), Scratch().Overflows());
+    block_stats.Reset();
+    last_time = now;
+}
 
+#if DUALIE_TRACE
+//A block that takes longer than block_deadline freezes the trace
+static TraceRecordCopy trace_dump[DUALIE_TRACE_SIZE];
 
-  private:
-    Voice  voices[max_voices];
-    Voice *FindFreeVoice()
+//Prints the frozen trace to the serial log for host/dualie-trace, then records again
+static void DumpTrace()
+{
+    char   line[48];
+    size_t count = TraceSnapshot(trace_dump, DUALIE_TRACE_SIZE);
+    hw.PrintLine("TRACE %lu %u", (unsigned long)SystemCoreClock, (unsigned)count);
+    for(size_t i = 0; i < count; i++)
     {
-        Voice *v = NULL;
-        for(size_t i = 0; i < max_voices; i++)
-        {
-            if(!voices[i].IsActive())
-            {
-                v = &voices[i];
-                break;
-            }
-        }
-        return v;
+        TraceFormat(trace_dump[i], line, sizeof(line));
+        hw.PrintLine("%s", line);
     }
-};
-
-static VoiceManager<12> mgr;
-static DaisySeed        hw;
-static Encoder          enc;
-MidiUartHandler         midi;
-CpuLoadMeter            loadMeter;
+    TraceResume();
+}
+#endif
 
 void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, size_t size)
 {
     loadMeter.OnBlockStart();
     for(size_t i = 0; i < BLOCK_SIZE; i++)
     {
-        out[0][i] = out[1][i] = mgr.Process() * 0.1;
+        out[0][i] = out[1][i] = EngineProcess() * 0.1;
     }
     loadMeter.OnBlockEnd();
 }
 
 void AudioCallbackBlock(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, size_t size)
 {
+    RT_SCOPE("AudioCallbackBlock");
     loadMeter.OnBlockStart();
+    uint32_t start = TraceTimestamp();
     float buf[BLOCK_SIZE];
-    mgr.ProcessBlock(buf, BLOCK_SIZE);
-
-    arm_scale_f32(buf, 0.5, buf, BLOCK_SIZE);
+    EngineProcessBlock(buf, BLOCK_SIZE);
 
-    out[0] = out[1] = buf;
+    arm_scale_f32(buf, 0.5, out[0], BLOCK_SIZE);
+    arm_copy_f32(out[0], out[1], BLOCK_SIZE);
 
+    uint32_t cycles = TraceTimestamp() - start;
+    block_stats.Add(cycles);
+#if DUALIE_TRACE
+    if(cycles > block_deadline && !TraceFrozen())
+    {
+        TraceTrigger((uint16_t)(cycles / (block_deadline / 100)));
+    }
+#endif
     loadMeter.OnBlockEnd();
 }
 
-void HandleControls(int ctrlValue, int param, bool midiCC)
+//Controls missing from an older bank keep their current value
+static void LoadPreset(uint8_t program, bool crossfade)
 {
-    //Process paramater value changed
-    if (midiCC)
-    {
-        ControlPanel[param] = ctrlValue;
-    }
-        else
-    {
-        ControlPanel[param] += ctrlValue;
-    }
-
-    if (param < 28)
+    uint8_t controls[NUM_CONTROLS];
+    if(!preset_bank_valid)
     {
-        mgr.SetParam(param);
+        return;
     }
-    else
+    memcpy(controls, ControlPanel, sizeof(controls));
+    if(PresetBankRead(preset_bank, program, controls, NULL))
     {
-        switch(param)
-        {
-            case CTRL_LFOWAVEFORM:
-                //No polybleps but have ramp
-                ValuePanel[CTRL_LFOWAVEFORM] = ControlPanel[CTRL_LFOWAVEFORM] / 26;
-                lfo.SetWaveform(ValuePanel[CTRL_LFOWAVEFORM]); 
-                break;
-            case CTRL_LFOFREQUENCY:
-                //TODO implement tempo sync
-                ValuePanel[CTRL_LFOFREQUENCY] = ControlPanel[CTRL_LFOFREQUENCY] / 6.4f;
-                lfo.SetFreq(ValuePanel[CTRL_LFOFREQUENCY]);
-                break;
-            case CTRL_LFOTEMPOSYNC:
-                ValuePanel[CTRL_LFOTEMPOSYNC] = ControlPanel[CTRL_LFOTEMPOSYNC] ? 1 : 0;
-                break;
-            case CTRL_FXTYPE:
-                ValuePanel[CTRL_FXTYPE] = ControlPanel[CTRL_FXTYPE];
-                break;
-            case CTRL_FXPARAM1:
-                ValuePanel[CTRL_FXPARAM1] = ControlPanel[CTRL_FXPARAM1];
-                break;
-            case CTRL_FXPARAM2:
-                ValuePanel[CTRL_FXPARAM2] = ControlPanel[CTRL_FXPARAM2];
-                break;
-            case CTRL_FXMIX:
-                ValuePanel[CTRL_FXMIX] = ControlPanel[CTRL_FXMIX];
-                break;
-
-            default: break;
-        }
+        TRACE(TRACE_PRESET, program, 0);
+        EngineLoadPreset(controls, crossfade);
     }
 }
 
@@ -588,6 +175,7 @@ int main(void)
     hw.Init(true);
     hw.SetAudioBlockSize(BLOCK_SIZE);
     hw.StartLog();
+    LogInit(LogClock, LOG_LINES_PER_SECOND);
 
     float sample_rate = hw.AudioSampleRate();
 
@@ -596,15 +184,27 @@ int main(void)
 
     midi.Init(midi_cfg);
     enc.Init(hw.GetPin(0), hw.GetPin(2), hw.GetPin(1));
-    mgr.Init(sample_rate);
-    lfo.Init(sample_rate);
+    Scratch().Init();
+    EngineInit(sample_rate);
     loadMeter.Init(sample_rate, BLOCK_SIZE);
+    TraceTimerInit();
+    block_deadline = (uint32_t)(SystemCoreClock / sample_rate * BLOCK_SIZE);
+    block_stats.Init(block_deadline);
+#if DUALIE_TRACE
+    TraceInit();
+#endif
 
     //uint8_t param = 0;
 
-    lfo.SetAmp(1);
-    lfo.SetWaveform(ValuePanel[CTRL_LFOWAVEFORM]);
-    lfo.SetFreq(ValuePanel[CTRL_LFOFREQUENCY]); 
+    //Start from the first stored preset, the compiled in defaults are kept if the bank is missing
+    preset_bank_valid = PresetBankValid(preset_bank, PRESET_BANK_SIZE);
+    LoadPreset(0, false);
+
+    //Also applies to the audio interrupt through FPDSCR
+    EnableFlushToZero();
+
+    //Everything below this frame is free until audio starts
+    StackPaint(STACK_PAINT_BYTES);
 
     // start the audio callback
     hw.StartAudio(AudioCallbackBlock);
@@ -631,13 +231,10 @@ int main(void)
         // Listen to MIDI
         midi.Listen();
 
-        // When message waiting
+        // When message waiting. Control changes only update the control panel and reach the
+        // voices together with EngineUpdate, notes sent after them wait for that patch
         while(midi.HasEvents())
         {
-            //Calculate CPU average load
-            const float avgLoad = loadMeter.GetAvgCpuLoad();
-            hw.PrintLine("Avg: " FLT_FMT3, FLT_VAR3(avgLoad * 100.0f));
-
             // Take oldest one
             auto msg = midi.PopEvent();
             switch(msg.type)
@@ -648,11 +245,11 @@ int main(void)
                     auto note_msg = msg.AsNoteOn();
                     if(note_msg.velocity != 0)
                     {
-                        mgr.OnNoteOn(note_msg.note, note_msg.velocity);
+                        EngineNoteOn(note_msg.note, note_msg.velocity);
                     }
                     else
                     {
-                        mgr.OnNoteOff(note_msg.note, note_msg.velocity);
+                        EngineNoteOff(note_msg.note, note_msg.velocity);
                     }
                 }
                 break;
@@ -660,7 +257,7 @@ int main(void)
                 case NoteOff:
                 {
                     auto note_msg = msg.AsNoteOn();
-                    mgr.OnNoteOff(note_msg.note, note_msg.velocity);
+                    EngineNoteOff(note_msg.note, note_msg.velocity);
                 }
                 break;
 
@@ -670,10 +267,51 @@ int main(void)
                     HandleControls(ctrl_msg.value, ctrl_msg.control_number, true);
                 }
                 break;
+
+                case ProgramChange:
+                {
+                    auto program_msg = msg.AsProgramChange();
+                    LoadPreset(program_msg.program, true);
+                }
+                break;
+
+                case SystemRealTime:
+                {
+                    //Clock jitters by the loop period, the engine filters it
+                    if(msg.srt_type == TimingClock)
+                    {
+                        EngineClockTick(System::GetUs());
+                    }
+                    else if(msg.srt_type == Start)
+                    {
+                        EngineClockStart();
+                    }
+                }
+                break;
                 
                 default: break;
             }
         }
 
+        //Publish everything changed by this batch of events as one patch. While the audio side
+        //has not taken the last one the changes keep accumulating, so at most one goes out per block
+        EngineUpdate();
+        LogLoad();
+        LogControlStats();
+        LogBlockStats();
+
+#if DUALIE_TRACE
+        if(TraceFrozen())
+        {
+            DumpTrace();
+        }
+#endif
+
+        //One line per pass so a burst of messages is not kept waiting behind the log
+        if(!midi.HasEvents())
+        {
+            LogFlush(PrintLogLine, 1);
+        }
+
     }
 }
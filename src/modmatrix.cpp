@@ -0,0 +1,91 @@
+#include <Utility/dsp.h>
+
+#include "../include/modmatrix.h"
+
+void ModMatrix::Init()
+{
+    for(int d = 0; d < MOD_DST_LAST; d++)
+    {
+        base_[d] = 0.f;
+        for(int s = 0; s < MOD_SRC_LAST; s++)
+        {
+            depth_[s][d] = 0.f;
+        }
+    }
+    dirty_ = true;
+    Compile();
+}
+
+void ModMatrix::RoutePatch(const float *values)
+{
+    float pw1 = values[CTRL_OSC1PULSEWIDTH];
+    float pw2 = values[CTRL_OSC2PULSEWIDTH];
+
+    //Pulse width modulation is scaled by the distance to a square wave
+    SetBase(MOD_DST_OSC1_PW, pw1);
+    SetBase(MOD_DST_OSC2_PW, pw2);
+    SetDepth(MOD_SRC_LFO1, MOD_DST_OSC1_PW, values[CTRL_OSC1PWMOD] * (0.5f - pw1));
+    SetDepth(MOD_SRC_LFO1, MOD_DST_OSC2_PW, values[CTRL_OSC2PWMOD] * (0.5f - pw2));
+    SetDepth(MOD_SRC_LFO1, MOD_DST_OSC1_FM, values[CTRL_OSC1FREQUENCYMOD] * TWOPI_F);
+    SetDepth(MOD_SRC_LFO1, MOD_DST_OSC2_FM, values[CTRL_OSC2FREQUENCYMOD] * TWOPI_F);
+    //Cutoff and amplifier are multiplied by 1 - depth * lfo
+    SetBase(MOD_DST_FILTER, 1.f);
+    SetBase(MOD_DST_AMP, 1.f);
+    SetDepth(MOD_SRC_LFO1, MOD_DST_FILTER, -values[CTRL_FILTERLFOMOD]);
+    SetDepth(MOD_SRC_LFO1, MOD_DST_AMP, -values[CTRL_AMPLFOMOD]);
+}
+
+void ModMatrix::Compile()
+{
+    if(!dirty_)
+    {
+        return;
+    }
+
+    num_ops_ = 0;
+    active_  = 0;
+    sources_ = 0;
+    for(int d = 0; d < MOD_DST_LAST; d++)
+    {
+        for(int s = 0; s < MOD_SRC_LAST; s++)
+        {
+            if(depth_[s][d] == 0.f)
+            {
+                continue;
+            }
+            Op &op   = ops_[num_ops_++];
+            op.src   = s;
+            op.dst   = d;
+            op.first = !(active_ & (1u << d));
+            op.depth = depth_[s][d];
+            active_ |= 1u << d;
+            sources_ |= 1u << s;
+        }
+    }
+    dirty_ = false;
+}
+
+void ModMatrix::Process(const float *const *sources)
+{
+    for(uint8_t i = 0; i < num_ops_; i++)
+    {
+        const Op    &op  = ops_[i];
+        const float *src = sources[op.src];
+        float       *out = out_[op.dst];
+        if(op.first)
+        {
+            float base = base_[op.dst];
+            for(size_t j = 0; j < BLOCK_SIZE; j++)
+            {
+                out[j] = base + op.depth * src[j];
+            }
+        }
+        else
+        {
+            for(size_t j = 0; j < BLOCK_SIZE; j++)
+            {
+                out[j] += op.depth * src[j];
+            }
+        }
+    }
+}
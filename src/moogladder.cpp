@@ -21,20 +21,90 @@
  * THE SOFTWARE.
  */
  
+#include <math.h>
+#include <string.h>
+#include <arm_math.h>
 #include <Utility/dsp.h>
 
 #include "../include/moogladder.h"
+#include "../include/denormal.h"
+#include "../include/scratch.h"
 
 using namespace custom;
 
-static inline float fast_tanh(float x)
+//Saturators are written without branches so the compiler can select instead of jump,
+//clamping maps to vmaxnm/vminnm on the M7 and minss/maxss on the host
+
+//Padé approximant of tanh, reaches exactly +-1 at +-3
+static inline float SatPade(float x)
 {
-    if (x > 3.0f) return 1.0f;
-    if (x < -3.0f) return -1.0f;
+    x = daisysp::fclamp(x, -3.0f, 3.0f);
     float x2 = x * x;
     return x * (27.0f + x2) / (27.0f + 9.0f * x2);
 }
 
+//Linearly interpolated tanh table, shared by every instance. Built during static
+//initialization, before any thread can call Init, and only read afterwards
+#define TANH_TABLE_SIZE 256
+#define TANH_TABLE_RANGE 4.0f
+
+static struct TanhTable
+{
+    float values[TANH_TABLE_SIZE + 2];
+
+    TanhTable()
+    {
+        for (int i = 0; i < TANH_TABLE_SIZE + 2; i++)
+        {
+            values[i] = tanhf(-TANH_TABLE_RANGE + i * (2.0f * TANH_TABLE_RANGE / TANH_TABLE_SIZE));
+        }
+    }
+} tanh_table;
+
+static inline float SatLut(float x)
+{
+    float idx = (daisysp::fclamp(x, -TANH_TABLE_RANGE, TANH_TABLE_RANGE) + TANH_TABLE_RANGE)
+                * (TANH_TABLE_SIZE / (2.0f * TANH_TABLE_RANGE));
+    int   i    = (int)idx;
+    float frac = idx - i;
+    return tanh_table.values[i] + frac * (tanh_table.values[i + 1] - tanh_table.values[i]);
+}
+
+//Antiderivative of SatPade, x^2/18 + 4/3 ln(27 + 9x^2) inside the knee and linear outside it.
+//Offset so F(0) = 0, which keeps the difference quotient accurate for small signals
+static inline float SatPadeAntiderivative(float x)
+{
+    const float kOffset = 4.3944492f; // 4/3 ln(27)
+    float ax = fabsf(x);
+    float xc = fminf(ax, 3.0f);
+    float x2 = xc * xc;
+    return x2 * (1.0f / 18.0f) + (4.0f / 3.0f) * logf(27.0f + 9.0f * x2) - kOffset + (ax - xc);
+}
+
+//First order antiderivative antialiasing of SatPade. Falls back to the midpoint when
+//the input barely moves and the difference quotient is ill conditioned
+static inline float SatAdaa(float x, float &x1, float &F1)
+{
+    const float kEpsilon = 1e-3f;
+    float F       = SatPadeAntiderivative(x);
+    float dx      = x - x1;
+    bool  ill     = fabsf(dx) < kEpsilon;
+    float safe_dx = ill ? 1.0f : dx;
+    float y       = ill ? SatPade(0.5f * (x + x1)) : (F - F1) / safe_dx;
+    x1 = x;
+    F1 = F;
+    return y;
+}
+
+//The open ladder: no resonance and a cutoff of at least kOpenFreq times the ladder rate
+//(sample_rate * oversample, 16 kHz at 96 kHz) up to its limit. Two one-pole stages at
+//fp = kOpenFit[0] + kOpenFit[1] * fc, both relative to the ladder rate, then match it within
+//0.7 dB up to the same frequency. The 2x interpolated ladder loses more top end to its averaging.
+static constexpr float kOpenFreq   = 1.0f / 6.0f;
+static constexpr float kOpenMaxRes = 0.01f;
+static const float kOpenFit[2]             = {-0.03172f, 0.834f};
+static const float kOpenFitInterpolated[2] = {0.02309f, 0.3477f};
+
 void MoogLadder::Init(float sample_rate)
 {
     sample_rate_ = sample_rate;
@@ -44,20 +114,51 @@ void MoogLadder::Init(float sample_rate)
     Qadjust_     = 1.0f;
     pbg_         = 0.5f;
     oldinput_    = 0.f;
+    saturator_   = SATURATOR_PADE;
+    oversampling_ = true;
+    oversample_  = kInterpolation;
+    adaa_x1_     = 0.f;
+    adaa_F1_     = 0.f;
+    open_enabled_ = true;
+    open_        = false;
+    open_fc_     = 0.f;
+    open_g_      = 0.f;
+    open_s_[0]   = 0.f;
+    open_s_[1]   = 0.f;
+    open_last_   = 0.f;
+
+    for (int i = 0; i < 4; i++)
+    {
+        z0_[i] = 0.f;
+        z1_[i] = 0.f;
+    }
 
     SetFreq(5000.f);
     SetRes(0.2f);
 }
 
-float MoogLadder::Process(const float input)
+template <uint8_t saturator, bool oversampled>
+inline float MoogLadder::Tick(float input)
 {
+    if (saturator == SATURATOR_ADAA || !oversampled)
+    {
+        //No oversampling, the antialiasing comes from the saturator or the caller's rate
+        float u = input - (z1_[3] - pbg_ * input) * K_ * Qadjust_;
+        u = saturator == SATURATOR_ADAA ? SatAdaa(u, adaa_x1_, adaa_F1_)
+            : saturator == SATURATOR_LUT ? SatLut(u) : SatPade(u);
+        float stage1 = LPF(u, 0);
+        float stage2 = LPF(stage1, 1);
+        float stage3 = LPF(stage2, 2);
+        return LPF(stage3, 3);
+    }
+
     float total = 0.0f;
     float interp = 0.0f;
     for (size_t os = 0; os < kInterpolation; os++)
     {
         float u = (interp * oldinput_ + (1.0f - interp) * input)
             - (z1_[3] - pbg_ * input) * K_ * Qadjust_;
-        u = fast_tanh(u);
+        u = saturator == SATURATOR_LUT ? SatLut(u) : SatPade(u);
         float stage1 = LPF(u, 0);
         float stage2 = LPF(stage1, 1);
         float stage3 = LPF(stage2, 2);
@@ -69,29 +170,193 @@ float MoogLadder::Process(const float input)
     return total;
 }
 
-void MoogLadder::ProcessBlock(float *buf, float *freq, size_t size)
+float MoogLadder::Process(const float input)
+{
+    float out;
+    switch (saturator_ | (oversample_ == 1) << 2)
+    {
+        case SATURATOR_LUT: out = Tick<SATURATOR_LUT, true>(input); break;
+        case SATURATOR_PADE: out = Tick<SATURATOR_PADE, true>(input); break;
+        case SATURATOR_LUT | 4: out = Tick<SATURATOR_LUT, false>(input); break;
+        case SATURATOR_PADE | 4: out = Tick<SATURATOR_PADE, false>(input); break;
+        default: out = Tick<SATURATOR_ADAA, false>(input); break;
+    }
+    FlushState();
+    return out;
+}
+
+template <uint8_t saturator, bool oversampled>
+void MoogLadder::ProcessBlockSaturator(float *buf, const BlockSignal &freq, size_t size)
 {
+    //A constant cutoff needs its coefficients at most once per block
+    if (freq.IsConstant())
+    {
+        if (freq.value != Fbase_)
+        {
+            SetFreq(freq.value);
+        }
+        for (size_t i = 0; i < size; i++)
+        {
+            buf[i] = Tick<saturator, oversampled>(buf[i]);
+        }
+        return;
+    }
+
     for (size_t i=0; i < size; i++) 
     {
         //I could definitely process the frequency in blocks later on but it's not terrible on CPU usage
-        SetFreq(freq[i]);
-        float input = buf[i];
-        float total = 0.0f;
-        float interp = 0.0f;
-        for (size_t os = 0; os < kInterpolation; os++) {
-            float u = (interp * oldinput_ + (1.0f - interp) * input)
-                - (z1_[3] - pbg_ * input) * K_ * Qadjust_;
-            u = fast_tanh(u);
-            float stage1 = LPF(u, 0);
-            float stage2 = LPF(stage1, 1);
-            float stage3 = LPF(stage2, 2);
-            float stage4 = LPF(stage3, 3);
-            total += stage4 * kInterpolationRecip;
-            interp += kInterpolationRecip;
+        SetFreq(freq.buf[i]);
+        buf[i] = Tick<saturator, oversampled>(buf[i]);
+    }
+}
+
+void MoogLadder::ProcessBlockLadder(float *buf, const BlockSignal &freq, size_t size)
+{
+    //Dispatch once per block so the per sample loop has no saturator or oversampling branch
+    switch (saturator_ | (oversample_ == 1) << 2)
+    {
+        case SATURATOR_LUT: ProcessBlockSaturator<SATURATOR_LUT, true>(buf, freq, size); break;
+        case SATURATOR_PADE: ProcessBlockSaturator<SATURATOR_PADE, true>(buf, freq, size); break;
+        case SATURATOR_LUT | 4: ProcessBlockSaturator<SATURATOR_LUT, false>(buf, freq, size); break;
+        case SATURATOR_PADE | 4: ProcessBlockSaturator<SATURATOR_PADE, false>(buf, freq, size); break;
+        default: ProcessBlockSaturator<SATURATOR_ADAA, false>(buf, freq, size); break;
+    }
+}
+
+//The stand-in for the open ladder, the same input saturation into two zero delay feedback one-poles
+void MoogLadder::ProcessBlockOpen(float *buf, float fc, size_t size)
+{
+    if (fc != open_fc_)
+    {
+        const float *fit  = oversample_ == 1 ? kOpenFit : kOpenFitInterpolated;
+        float        rate = sample_rate_ * oversample_;
+        float        t    = tanf(PI_F * (fit[0] * rate + fit[1] * fc) / sample_rate_);
+        open_fc_ = fc;
+        open_g_  = t / (1.0f + t);
+    }
+
+    float g = open_g_, s0 = open_s_[0], s1 = open_s_[1];
+    open_last_ = buf[size - 1];
+    for (size_t i = 0; i < size; i++)
+    {
+        float v  = g * (SatPade(buf[i]) - s0);
+        float y0 = v + s0;
+        s0       = y0 + v;
+        v        = g * (y0 - s1);
+        float y1 = v + s1;
+        s1       = y1 + v;
+        buf[i]   = y1;
+    }
+    open_s_[0] = s0;
+    open_s_[1] = s1;
+}
+
+bool MoogLadder::IsOpen(const BlockSignal &freq, size_t size, float &fc) const
+{
+    //The antialiased saturator runs at 1x and never gets near the open range
+    if (!open_enabled_ || saturator_ == SATURATOR_ADAA || K_ > 4.0f * kOpenMaxRes)
+    {
+        return false;
+    }
+    uint32_t index;
+    fc = freq.value;
+    if (!freq.IsConstant())
+    {
+        arm_min_f32(freq.buf, size, &fc, &index);
+    }
+    float rate = sample_rate_ * oversample_;
+    fc         = fminf(fc, rate * 0.2125f);
+    return fc >= kOpenFreq * rate;
+}
+
+//Seeds the model taking over from the one in use. Each one-pole of the stand-in takes the
+//output of the ladder stage it ends on, and the other way round.
+void MoogLadder::HandOver(bool to_open)
+{
+    if (to_open)
+    {
+        open_s_[0] = z1_[1];
+        open_s_[1] = z1_[3];
+        return;
+    }
+    z1_[0]    = open_s_[0];
+    z1_[1]    = open_s_[0];
+    z1_[2]    = open_s_[1];
+    z1_[3]    = open_s_[1];
+    z0_[0]    = SatPade(open_last_);
+    z0_[1]    = z1_[0];
+    z0_[2]    = z1_[1];
+    z0_[3]    = z1_[2];
+    oldinput_ = open_last_;
+}
+
+void MoogLadder::ProcessBlock(float *buf, BlockSignal freq, size_t size)
+{
+    float fc;
+    bool  open = IsOpen(freq, size, fc);
+    if (open == open_)
+    {
+        if (open)
+        {
+            ProcessBlockOpen(buf, fc, size);
+        }
+        else
+        {
+            ProcessBlockLadder(buf, freq, size);
         }
-        oldinput_ = input;
-        buf[i] = total;
     }
+    else
+    {
+        //Both models render the switching block, the output fades from the old one to the new
+        ScratchFrame scratch;
+        float       *next = scratch.Floats(size);
+        memcpy(next, buf, size * sizeof(float));
+        HandOver(open);
+        if (open)
+        {
+            ProcessBlockLadder(buf, freq, size);
+            ProcessBlockOpen(next, fc, size);
+        }
+        else
+        {
+            ProcessBlockOpen(buf, open_fc_, size);
+            ProcessBlockLadder(next, freq, size);
+        }
+        float step = 1.0f / size;
+        for (size_t i = 0; i < size; i++)
+        {
+            buf[i] += (next[i] - buf[i]) * ((i + 1) * step);
+        }
+        open_ = open;
+    }
+
+    //Once per block is enough to keep a silent tail from decaying into denormals
+    FlushState();
+}
+
+void MoogLadder::SetSaturator(uint8_t saturator)
+{
+    saturator_  = saturator < SATURATOR_LAST ? saturator : SATURATOR_PADE;
+    oversample_ = saturator_ == SATURATOR_ADAA || !oversampling_ ? 1 : kInterpolation;
+    adaa_x1_    = 0.f;
+    adaa_F1_    = 0.f;
+    compute_coeffs(Fbase_);
+}
+
+void MoogLadder::SetOversampling(bool enable)
+{
+    oversampling_ = enable;
+    SetSaturator(saturator_);
+}
+
+void MoogLadder::SetOpenApproximation(bool enable)
+{
+    open_enabled_ = enable;
+}
+
+bool MoogLadder::MayOpen(float res)
+{
+    return 4.0f * daisysp::fclamp(res, 0.0f, kMaxResonance) <= 4.0f * kOpenMaxRes;
 }
 
 void MoogLadder::SetFreq(float freq)
@@ -116,10 +381,26 @@ float MoogLadder::LPF(float s, int i)
     return ft;
 }
 
+void MoogLadder::FlushState()
+{
+    for (int i = 0; i < 4; i++)
+    {
+        z0_[i] = FlushDenormal(z0_[i]);
+        z1_[i] = FlushDenormal(z1_[i]);
+    }
+    oldinput_ = FlushDenormal(oldinput_);
+    adaa_x1_  = FlushDenormal(adaa_x1_);
+    adaa_F1_  = FlushDenormal(adaa_F1_);
+    open_s_[0] = FlushDenormal(open_s_[0]);
+    open_s_[1] = FlushDenormal(open_s_[1]);
+    open_last_ = FlushDenormal(open_last_);
+}
+
 void MoogLadder::compute_coeffs(float freq)
 {
-    freq = daisysp::fclamp(freq, 5.0f, sample_rate_ * 0.425f);
-    float wc = freq * (float)(2.0f * PI_F / ((float)kInterpolation * sample_rate_));
+    //Same warping range at either rate, so the 1x ADAA model tops out at half the cutoff
+    freq = daisysp::fclamp(freq, 5.0f, sample_rate_ * 0.2125f * oversample_);
+    float wc = freq * (float)(2.0f * PI_F / ((float)oversample_ * sample_rate_));
     float wc2 = wc * wc;
     alpha_ = 0.9892f * wc - 0.4324f * wc2 + 0.1381f * wc * wc2 - 0.0202f * wc2 * wc2;
     Qadjust_ = 1.006f + 0.0536f * wc - 0.095f * wc2 - 0.05f * wc2 * wc2;
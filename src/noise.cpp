@@ -0,0 +1,115 @@
+#include <math.h>
+
+#include "../include/noise.h"
+
+using namespace custom;
+
+//Maps a signed 32 bit integer onto -1 to 1
+static constexpr float kIntToFloat = 4.6566129e-010f;
+//Sum of NOISE_PINK_ROWS rows plus the white term, scaled back to the RMS of a single one
+static const float kPinkScale = 1.0f / sqrtf(NOISE_PINK_ROWS + 1);
+
+//Integer hash (lowbias32), spreads consecutive seeds over the whole state space
+static inline uint32_t Hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static inline uint32_t Xorshift(uint32_t x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+void Noise::Init(uint32_t seed)
+{
+    for(int l = 0; l < NOISE_LANES; l++)
+    {
+        //xorshift never leaves the all zero state
+        uint32_t s = Hash(seed * NOISE_LANES + l + 1);
+        state_[l]  = s ? s : 0x9e3779b9;
+    }
+    for(int r = 0; r < NOISE_PINK_ROWS; r++)
+    {
+        rows_[r] = 0.0f;
+    }
+    pink_sum_     = 0.0f;
+    pink_last_    = 0.0f;
+    pink_counter_ = 0;
+    amp_          = 1.0f;
+    mode_         = MODE_WHITE;
+}
+
+void Noise::WhiteBlock(float *buf, size_t size)
+{
+    //Local copy so the compiler can keep the lanes in one vector register
+    uint32_t state[NOISE_LANES];
+    float    amp = amp_ * kIntToFloat;
+    for(int l = 0; l < NOISE_LANES; l++)
+    {
+        state[l] = state_[l];
+    }
+    for(size_t i = 0; i < size; i += NOISE_LANES)
+    {
+        for(int l = 0; l < NOISE_LANES; l++)
+        {
+            state[l]   = Xorshift(state[l]);
+            buf[i + l] = (int32_t)state[l] * amp;
+        }
+    }
+    for(int l = 0; l < NOISE_LANES; l++)
+    {
+        state_[l] = state[l];
+    }
+}
+
+//One Voss-McCartney step. The counter's trailing zeros pick the row to refresh, so row k changes
+//every 2^(k+1) samples. A row takes the previous white sample, which keeps it uncorrelated with
+//the white term added on top.
+inline float Noise::PinkStep(float white)
+{
+    pink_counter_ = (pink_counter_ + 1) & ((1u << NOISE_PINK_ROWS) - 1);
+    if(pink_counter_ != 0)
+    {
+        int row = __builtin_ctz(pink_counter_);
+        pink_sum_ += pink_last_ - rows_[row];
+        rows_[row] = pink_last_;
+    }
+    else
+    {
+        //Once per cycle, so rounding in the running sum cannot accumulate
+        pink_sum_ = 0.0f;
+        for(int r = 0; r < NOISE_PINK_ROWS; r++)
+        {
+            pink_sum_ += rows_[r];
+        }
+    }
+    pink_last_ = white;
+    return (pink_sum_ + white) * kPinkScale;
+}
+
+void Noise::ProcessBlock(float *buf, size_t size)
+{
+    WhiteBlock(buf, size);
+    if(mode_ == MODE_PINK)
+    {
+        for(size_t i = 0; i < size; i++)
+        {
+            buf[i] = PinkStep(buf[i]);
+        }
+    }
+}
+
+float Noise::Process()
+{
+    state_[0] = Xorshift(state_[0]);
+    float out = (int32_t)state_[0] * (amp_ * kIntToFloat);
+    return mode_ == MODE_PINK ? PinkStep(out) : out;
+}
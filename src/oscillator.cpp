@@ -1,110 +1,171 @@
 #include <Utility/dsp.h>
 #include <arm_math.h>
-#include <arm_common_tables.h>
 
 #include "../include/oscillator.h"
+#include "../include/sine.h"
+#include "../include/scratch.h"
 using namespace custom;
 static inline float Polyblep(float phase_inc, float t);
-inline void SinBlock(float *buf, float *phase_vector, size_t size);
 
 constexpr float TWO_PI_RECIP = 1.0f / TWOPI_F;
 
-void Oscillator::ProcessBlock(float *buf, float *pw_buf, float *fm_buf, float *reset_vector, bool reset, size_t size)
+//Accuracy of WAVE_SIN in the block kernels, see sine.h
+#ifndef DUALIE_OSC_SINE
+#define DUALIE_OSC_SINE SINE_POLY
+#endif
+
+//One sample of the waveform at phase (radians) and t (the same phase in cycles), p is the
+//clamped pulse width. last carries the leaky integrator of WAVE_POLYBLEP_TRI.
+template <uint8_t waveform>
+inline float Oscillator::Shape(float phase, float t, float p, float &last) const
+{
+    const float double_pi_recip = 2.0f * TWO_PI_RECIP;
+    float       out;
+    switch(waveform)
+    {
+        case WAVE_SIN: out = Sine<DUALIE_OSC_SINE>(t); break;
+        case WAVE_TRI: out = (fabsf(phase * double_pi_recip - 1.0f) - 0.5f) * 2.0f; break;
+        case WAVE_SAW: out = -(phase * double_pi_recip - 1.0f); break;
+        case WAVE_RAMP: out = phase * double_pi_recip - 1.0f; break;
+        case WAVE_SQUARE: out = phase < p * TWOPI_F ? 1.0f : -1.0f; break;
+        //TODO: try to remove fmodf for cmsis function
+        case WAVE_POLYBLEP_TRI:
+            out = phase < PI_F ? 1.0f : -1.0f;
+            out += Polyblep(phase_inc_, t);
+            out -= Polyblep(phase_inc_, fmodf(t + 0.5f, 1.0f));
+            // Leaky Integrator:
+            // y[n] = A + x[n] + (1 - A) * y[n-1]
+            out  = phase_inc_ * out + (1.0f - phase_inc_) * last;
+            last = out;
+            break;
+        case WAVE_POLYBLEP_SAW:
+            out = (2.0f * t) - 1.0f;
+            out -= Polyblep(phase_inc_, t);
+            out *= -1.0f;
+            break;
+        case WAVE_POLYBLEP_SQUARE:
+            out = phase < p * TWOPI_F ? 1.0f : -1.0f;
+            out += Polyblep(phase_inc_, t);
+            out -= Polyblep(phase_inc_, fmodf(t + (1.0f - p), 1.0f));
+            out *= 0.707f; // ?
+            break;
+        default: out = 0.0f; break;
+    }
+    return out;
+}
+
+//Advances the phase by one sample and handles the sync role, returns the new phase
+template <uint8_t sync>
+inline float Oscillator::Advance(float phase, float inc, float *sync_vector, size_t i) const
 {
-    float double_pi_recip = 2.0f * TWO_PI_RECIP;
-    float phase_vector[size], t_vector[size], pw_vector[size], pw_rad_vector[size];
+    if(sync == SYNC_SLAVE)
+    {
+        //Restart on the samples where the master wrapped
+        phase *= sync_vector[i] == 0.0f;
+    }
+
+    phase += inc;
 
-    for (size_t i = 0; i < size; i++)
+    bool wrapped = phase > TWOPI_F;
+    if(wrapped)
     {
-        //Set phase to 0 if reset and at EOF for osc1
-        //Not sure why this isnt working anymore
-        phase_ *= !(reset && reset_vector[i]); 
-        //This is now going to be overwritten by Osc2
-        reset_vector[i] = (phase_ > TWOPI_F);
+        phase -= TWOPI_F;
+    }
+    if(sync == SYNC_MASTER)
+    {
+        sync_vector[i] = wrapped;
+    }
+    return phase;
+}
+
+//One kernel per waveform, sync role and constant or modulated pw and fm. The template arguments
+//are compile time constants, so every branch on them folds away and the loop only carries
+//the phase bookkeeping and shaping its configuration needs.
+template <uint8_t waveform, uint8_t sync, bool constant_pw, bool constant_fm>
+void Oscillator::BlockKernel(float *buf, const BlockSignal &pw, const BlockSignal &fm, float *sync_vector, size_t size)
+{
+    float inc      = phase_inc_ + fm.value;
+    float pw_const = daisysp::fclamp(pw.value, 0.f, 1.f);
+    float phase    = phase_;
+    float last     = last_out_;
+    ScratchFrame scratch;
+    float       *pw_vector = NULL;
+
+    if(!constant_pw)
+    {
+        pw_vector = scratch.Floats(size);
+        arm_clip_f32(pw.buf, pw_vector, 0.f, 1.f, size);
+    }
 
-        phase_ += phase_inc_ + fm_buf[i];
+    for(size_t i = 0; i < size; i++)
+    {
+        phase  = Advance<sync>(phase, constant_fm ? inc : phase_inc_ + fm.buf[i], sync_vector, i);
+        buf[i] = Shape<waveform>(phase, phase * TWO_PI_RECIP, constant_pw ? pw_const : pw_vector[i], last);
+    }
+    phase_    = phase;
+    last_out_ = last;
+}
 
-        if(phase_ > TWOPI_F)
-        {
-            phase_ -= TWOPI_F;
-        }
-        //eor_ = (phase_ - phase_inc_ < PI_F && phase_ >= PI_F); //end of rise - not using right now
+//Phase modulated kernels, pm is added to the phase (in cycles) after it is accumulated.
+//The accumulation is the only serial part, so it runs as its own pass and the shaping pass
+//has no loop carried state apart from WAVE_POLYBLEP_TRI's integrator.
+template <uint8_t waveform, uint8_t sync>
+void Oscillator::PmKernel(float *buf, const BlockSignal &pw, const BlockSignal &fm, const BlockSignal &pm, float *sync_vector, size_t size)
+{
+    ScratchFrame scratch;
+    float       *t_vector = scratch.Floats(size);
+    float        phase    = phase_;
+    float        last     = last_out_;
 
-        phase_vector[i] = phase_;
+    for(size_t i = 0; i < size; i++)
+    {
+        phase       = Advance<sync>(phase, phase_inc_ + fm[i], sync_vector, i);
+        t_vector[i] = phase * TWO_PI_RECIP + pm[i];
     }
+    for(size_t i = 0; i < size; i++)
+    {
+        float t = SineWrap(t_vector[i]);
+        buf[i]  = Shape<waveform>(t * TWOPI_F, t, daisysp::fclamp(pw[i], 0.f, 1.f), last);
+    }
+    phase_    = phase;
+    last_out_ = last;
+}
 
+template <uint8_t waveform, uint8_t sync>
+void Oscillator::ResolveKernels()
+{
+    //Only the pulse waveforms read pw, the others reuse the constant pw kernels
+    constexpr bool pulse = waveform == WAVE_SQUARE || waveform == WAVE_POLYBLEP_SQUARE;
+    kernels_[0] = &Oscillator::BlockKernel<waveform, sync, true, true>;
+    kernels_[1] = &Oscillator::BlockKernel<waveform, sync, !pulse, true>;
+    kernels_[2] = &Oscillator::BlockKernel<waveform, sync, true, false>;
+    kernels_[3] = &Oscillator::BlockKernel<waveform, sync, !pulse, false>;
+    pm_kernel_  = &Oscillator::PmKernel<waveform, sync>;
+}
+
+template <uint8_t sync>
+void Oscillator::ResolveWaveform()
+{
     switch(waveform_)
     {
-        case WAVE_SIN:
-            SinBlock(buf, phase_vector, size);
-            break;
-        case WAVE_TRI:
-            arm_scale_f32(phase_vector, double_pi_recip, t_vector, size);
-            arm_offset_f32(t_vector, -1.0f, t_vector, size);
-            arm_abs_f32(t_vector, t_vector, size);
-            arm_offset_f32(t_vector, -0.5f, t_vector, size);
-            arm_scale_f32(t_vector, 2.0f, buf, size);
-            break;
-        case WAVE_SAW:
-            arm_scale_f32(phase_vector, double_pi_recip, buf, size);
-            arm_offset_f32(buf, -1.0f, buf, size);
-            arm_negate_f32(buf, buf, size);
-            break;
-        case WAVE_RAMP:
-            arm_scale_f32(phase_vector, double_pi_recip, buf, size);
-            arm_offset_f32(buf, -1.0f, buf, size);
-            break;
-        case WAVE_SQUARE:
-            arm_clip_f32(pw_buf, pw_vector, 0.f, 1.f, size);
-            arm_scale_f32(pw_vector, TWOPI_F, pw_rad_vector, size);
-            
-            for (size_t i = 0; i < size; i++)
-            {
-                buf[i] = phase_vector[i] < pw_rad_vector[i] ? (1.0f) : -1.0f; 
-            }
-            break;
+        case WAVE_TRI: ResolveKernels<WAVE_TRI, sync>(); break;
+        case WAVE_SAW: ResolveKernels<WAVE_SAW, sync>(); break;
+        case WAVE_RAMP: ResolveKernels<WAVE_RAMP, sync>(); break;
+        case WAVE_SQUARE: ResolveKernels<WAVE_SQUARE, sync>(); break;
+        case WAVE_POLYBLEP_TRI: ResolveKernels<WAVE_POLYBLEP_TRI, sync>(); break;
+        case WAVE_POLYBLEP_SAW: ResolveKernels<WAVE_POLYBLEP_SAW, sync>(); break;
+        case WAVE_POLYBLEP_SQUARE: ResolveKernels<WAVE_POLYBLEP_SQUARE, sync>(); break;
+        default: ResolveKernels<WAVE_SIN, sync>(); break;
+    }
+}
 
-        //Implementing polyblep block processing will be harder
-        //I'll leave these as simple loops for now
-        
-        //Currently polyblep_tri and polyblep_square take double the processing power
-        //TODO: try to remove fmodf for cmsis function
-        case WAVE_POLYBLEP_TRI:
-            arm_scale_f32(phase_vector, TWO_PI_RECIP, t_vector, size);
-            for (size_t i = 0; i < size; i++)
-            {
-                buf[i] = phase_vector[i] < PI_F ? 1.0f : -1.0f; 
-                buf[i] += Polyblep(phase_inc_, t_vector[i]);
-                buf[i] -= Polyblep(phase_inc_, fmodf(t_vector[i] + 0.5f, 1.0f));
-                // Leaky Integrator:
-                // y[n] = A + x[n] + (1 - A) * y[n-1]
-                buf[i]       = phase_inc_ * buf[i] + (1.0f - phase_inc_) * last_out_;
-                last_out_ = buf[i];
-            }
-            break;
-        case WAVE_POLYBLEP_SAW:
-            arm_scale_f32(phase_vector, TWO_PI_RECIP, t_vector, size);
-            for (size_t i = 0; i < size; i++)
-            {
-                buf[i] = (2.0f * t_vector[i]) - 1.0f;
-                buf[i] -= Polyblep(phase_inc_, t_vector[i]);
-                buf[i] *= -1.0f;
-            }
-            break;
-        case WAVE_POLYBLEP_SQUARE:
-            arm_clip_f32(pw_buf, pw_vector, 0.f, 1.f, size);
-            arm_scale_f32(pw_vector, TWOPI_F, pw_rad_vector, size);
-
-            arm_scale_f32(phase_vector, TWO_PI_RECIP, t_vector, size);
-            for (size_t i = 0; i < size; i++)
-            {
-                buf[i] = phase_vector[i] < pw_rad_vector[i] ? 1.0f : -1.0f;
-                buf[i] += Polyblep(phase_inc_, t_vector[i]);
-                buf[i] -= Polyblep(phase_inc_, fmodf(t_vector[i] + (1.0f - pw_vector[i]), 1.0f));
-                buf[i] *= 0.707f; // ?
-            }
-            break;
-        default: arm_fill_f32(0, buf, size); break;
+void Oscillator::SelectKernels()
+{
+    switch(sync_)
+    {
+        case SYNC_MASTER: ResolveWaveform<SYNC_MASTER>(); break;
+        case SYNC_SLAVE: ResolveWaveform<SYNC_SLAVE>(); break;
+        default: ResolveWaveform<SYNC_NONE>(); break;
     }
 }
 
@@ -168,46 +229,6 @@ float Oscillator::CalcPhaseInc(float f)
     return (TWOPI_F * f) * sr_recip_;
 }
 
-void SinBlock(float *buf, float *phase_vector, size_t size)
-{
-    float in[size];
-    float sinVal, fract;                           /* Temporary variables for input, output */
-    uint16_t index;                                        /* Index variable */
-    float a, b;                                        /* Two nearest output values */
-    int32_t n;
-    float findex;
-
-    //Removed special case for small negative inputs
-
-    /* input x is in radians */
-    /* Scale the input to [0 1] range from [0 2*PI] , divide input by 2*pi */
-    arm_scale_f32(phase_vector, TWO_PI_RECIP, in, size);
-    for (size_t i = 0; i < size; i++)
-    {
-        /* Calculation of floor value of input */
-        n = (int32_t) in[i];
-        /* Make negative values towards -infinity */
-        if (phase_vector[i] < 0.0f)
-        {
-            n--;
-        }
-        /* Map input value to [0 1] */
-        in[i] = in[i] - (float) n;
-        /* Calculation of index of the table */
-        findex = (float) FAST_MATH_TABLE_SIZE * in[i];
-        index = ((uint16_t)findex) & 0x1ff;
-        /* fractional value calculation */
-        fract = findex - (float) index;
-        /* Read two nearest values of input value from the sin table */
-        a = sinTable_f32[index];
-        b = sinTable_f32[index+1];
-        /* Linear interpolation process */
-        sinVal = (1.0f-fract)*a + fract*b;
-        /* Return the output value */
-        buf[i] = sinVal;
-    }
-}
-
 static float Polyblep(float phase_inc, float t)
 {
     float dt = phase_inc * TWO_PI_RECIP;
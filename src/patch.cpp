@@ -0,0 +1,124 @@
+#include "../include/patch.h"
+#include "../include/lfo.h"
+
+using namespace custom;
+
+float ControlToValue(int param, uint8_t control)
+{
+    //TODO: investigate ways to calculate without using expensive divisions
+    switch(param)
+    {
+        //Disabling polybleps until I optimize them
+        case CTRL_OSC1WAVEFORM: return control / 26;
+        case CTRL_OSC1PULSEWIDTH: return control / 254.f;
+        //change the scaling on this
+        case CTRL_OSC1FREQUENCYMOD: return control / 127.f;
+        case CTRL_OSC1PWMOD: return control / 127.f;
+        case CTRL_OSC2WAVEFORM: return control / 26;
+        case CTRL_OSC2PULSEWIDTH: return control / 254.f;
+        case CTRL_OSC2FREQUENCYMOD: return control / 127.f;
+        case CTRL_OSC2PWMOD: return control / 127.f;
+        case CTRL_OSC2TUNEFINE: return (control / 64.f) - 1; //cents
+        case CTRL_OSC2TUNECOARSE: return ((int) (control / 2.646)) - 24.18; //semitones
+        case CTRL_OSC2SYNC: return control ? 1 : 0;
+        case CTRL_NOISE: return control / 127.f;
+        case CTRL_OSCMIX: return control / 127.f;
+        case CTRL_OSCSPLIT: return control ? 1 : 0;
+        //Use a Michaelis-Menten equation to scale frequency y = (-606.0853*x)/(-130.4988 + x)
+        case CTRL_FILTERCUTOFF: return (control * -606.0853) / (control - 130.4988);
+        case CTRL_FILTERRESONANCE: return control / 134.0f;
+        case CTRL_FILTERLFOMOD: return control / 127.f;
+        case CTRL_FILTERVELOCITYMOD: return control / 127.f;
+        case CTRL_FILTERKEYBEDTRACK: return control / 127.f;
+        case CTRL_FILTERATTACK: return control / 32.f;
+        case CTRL_FILTERDECAY: return control / 32.f;
+        case CTRL_FILTERSUSTAIN: return control / 127.f;
+        case CTRL_FILTERRELEASE: return control / 64.f;
+        case CTRL_AMPATTACK: return control / 32.f;
+        case CTRL_AMPDECAY: return control / 32.f;
+        case CTRL_AMPSUSTAIN: return control / 127.f;
+        case CTRL_AMPRELEASE: return control / 64.f;
+        case CTRL_AMPLFOMOD: return control / 127.f;
+        //No polybleps but have ramp
+        case CTRL_LFOWAVEFORM: return control / 26;
+        //Selects a note length from LfoSyncTicks instead when tempo synced
+        case CTRL_LFOFREQUENCY: return control / 6.4f;
+        case CTRL_LFOTEMPOSYNC: return control ? 1 : 0;
+        case CTRL_FXTYPE:
+        case CTRL_FXPARAM1:
+        case CTRL_FXPARAM2:
+        case CTRL_FXMIX: return control;
+        case CTRL_NOISETYPE: return control / 64;
+        //Peak phase deviation of osc2 in cycles
+        case CTRL_OSC2PHASEMOD: return control / 127.f;
+        case CTRL_RINGMOD: return control / 127.f;
+        //Ladder, 2-pole ladder, state-variable low, band and high pass
+        case CTRL_FILTERTYPE: return control / 26;
+        default: return 0;
+    }
+}
+
+static void EnvelopeCoeffs(AdsrCoeffs &coeffs, float sample_rate,
+                           float attack, float decay, float sustain, float release)
+{
+    Adsr env;
+    env.Init(sample_rate);
+    env.SetTime(ADSR_SEG_ATTACK, attack);
+    env.SetTime(ADSR_SEG_DECAY, decay);
+    env.SetSustainLevel(sustain);
+    env.SetTime(ADSR_SEG_RELEASE, release);
+    env.GetCoeffs(coeffs);
+}
+
+//Cycle lengths in MIDI clock ticks from 4 bars down to a 32nd, dotted and triplet values in between
+static const uint16_t kLfoSyncTicks[16] = {384, 192, 144, 96, 72, 48, 36, 24, 18, 16, 12, 9, 8, 6, 4, 3};
+
+static uint16_t LfoSyncTicks(uint8_t control)
+{
+    return kLfoSyncTicks[(control >> 3) & 15];
+}
+
+static const uint64_t kFiltEnvControls = PATCH_CONTROL_BIT(CTRL_FILTERATTACK) | PATCH_CONTROL_BIT(CTRL_FILTERDECAY)
+                                        | PATCH_CONTROL_BIT(CTRL_FILTERSUSTAIN) | PATCH_CONTROL_BIT(CTRL_FILTERRELEASE);
+static const uint64_t kAmpEnvControls = PATCH_CONTROL_BIT(CTRL_AMPATTACK) | PATCH_CONTROL_BIT(CTRL_AMPDECAY)
+                                       | PATCH_CONTROL_BIT(CTRL_AMPSUSTAIN) | PATCH_CONTROL_BIT(CTRL_AMPRELEASE);
+static const uint64_t kLfoControls = PATCH_CONTROL_BIT(CTRL_LFOWAVEFORM) | PATCH_CONTROL_BIT(CTRL_LFOFREQUENCY)
+                                    | PATCH_CONTROL_BIT(CTRL_LFOTEMPOSYNC);
+
+void PatchCompute(Patch &patch, float sample_rate, uint64_t changed)
+{
+    for(int i = 0; i < NUM_CONTROLS; i++)
+    {
+        if(changed & PATCH_CONTROL_BIT(i))
+        {
+            patch.values[i] = ControlToValue(i, patch.controls[i]);
+        }
+    }
+
+    //The envelope times go through expf and logf, a cutoff sweep should not pay for them
+    if(changed & kFiltEnvControls)
+    {
+        EnvelopeCoeffs(patch.filt_env, sample_rate,
+                       patch.values[CTRL_FILTERATTACK], patch.values[CTRL_FILTERDECAY],
+                       patch.values[CTRL_FILTERSUSTAIN], patch.values[CTRL_FILTERRELEASE]);
+    }
+    if(changed & kAmpEnvControls)
+    {
+        EnvelopeCoeffs(patch.amp_env, sample_rate,
+                       patch.values[CTRL_AMPATTACK], patch.values[CTRL_AMPDECAY],
+                       patch.values[CTRL_AMPSUSTAIN], patch.values[CTRL_AMPRELEASE]);
+    }
+
+    if(changed & kLfoControls)
+    {
+        patch.lfo[0].waveform   = patch.values[CTRL_LFOWAVEFORM];
+        patch.lfo[0].freq       = patch.values[CTRL_LFOFREQUENCY];
+        patch.lfo[0].sync_ticks = patch.values[CTRL_LFOTEMPOSYNC] ? LfoSyncTicks(patch.controls[CTRL_LFOFREQUENCY]) : 0;
+    }
+    for(int i = 1; i < NUM_LFOS; i++)
+    {
+        patch.lfo[i].waveform   = custom::Lfo::WAVE_TRI;
+        patch.lfo[i].freq       = 0.5f;
+        patch.lfo[i].sync_ticks = 0;
+    }
+}
@@ -0,0 +1,112 @@
+#include <string.h>
+
+#include "../include/preset.h"
+
+//Column names in etc/presets.csv
+static const char *const kControlNames[NUM_CONTROLS] = {
+    "CTRL_OSC1WAVEFORM",      "CTRL_OSC1PULSEWIDTH",   "CTRL_OSC1FREQUENCYMOD",
+    "CTRL_OSC1PWMOD",         "CTRL_OSC2WAVEFORM",     "CTRL_OSC2PULSEWIDTH",
+    "CTRL_OSC2FREQUENCYMOD",  "CTRL_OSC2PWMOD",        "CTRL_OSC2TUNEFINE",
+    "CTRL_OSC2TUNECOARSE",    "CTRL_OSC2SYNC",         "CTRL_NOISE",
+    "CTRL_OSCMIX",            "CTRL_OSCSPLIT",         "CTRL_FILTERCUTOFF",
+    "CTRL_FILTERRESONANCE",   "CTRL_FILTERLFOMOD",     "CTRL_FILTERVELOCITYMOD",
+    "CTRL_FILTERKEYBEDTRACK", "CTRL_FILTERATTACK",     "CTRL_FILTERDECAY",
+    "CTRL_FILTERSUSTAIN",     "CTRL_FILTERRELEASE",    "CTRL_AMPATTACK",
+    "CTRL_AMPDECAY",          "CTRL_AMPSUSTAIN",       "CTRL_AMPRELEASE",
+    "CTRL_AMPLFOMOD",         "CTRL_LFOWAVEFORM",      "CTRL_LFOFREQUENCY",
+    "CTRL_LFOTEMPOSYNC",      "CTRL_FXTYPE",           "CTRL_FXPARAM1",
+    "CTRL_FXPARAM2",          "CTRL_FXMIX",            "CTRL_NOISETYPE",
+    "CTRL_OSC2PHASEMOD",      "CTRL_RINGMOD",          "CTRL_FILTERTYPE",
+};
+
+//Flash may be memory mapped with no alignment guarantees for the fields, so every
+//access goes through memcpy
+static void ReadHeader(const uint8_t *bank, PresetBankHeader &header)
+{
+    memcpy(&header, bank, sizeof(header));
+}
+
+static uint32_t Checksum(const uint8_t *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+size_t PresetBankSize(uint16_t count)
+{
+    return sizeof(PresetBankHeader) + (size_t)count * PRESET_RECORD_SIZE;
+}
+
+bool PresetBankValid(const uint8_t *bank, size_t size)
+{
+    PresetBankHeader header;
+    if(size < sizeof(header))
+    {
+        return false;
+    }
+    ReadHeader(bank, header);
+    if(header.magic != PRESET_MAGIC || header.version == 0 || header.version > PRESET_VERSION)
+    {
+        return false;
+    }
+    if(header.count == 0 || header.count > PRESET_MAX_COUNT || header.num_controls == 0
+       || header.record_size < PRESET_NAME_LENGTH + header.num_controls || header.record_size > PRESET_MAX_RECORD_SIZE)
+    {
+        return false;
+    }
+    if(size - sizeof(header) < (size_t)header.count * header.record_size)
+    {
+        return false;
+    }
+    const uint8_t *records = bank + sizeof(PresetBankHeader);
+    return Checksum(records, (size_t)header.count * header.record_size) == header.checksum;
+}
+
+uint16_t PresetBankCount(const uint8_t *bank)
+{
+    PresetBankHeader header;
+    ReadHeader(bank, header);
+    return header.count;
+}
+
+bool PresetBankRead(const uint8_t *bank, uint16_t index, uint8_t *controls, char *name)
+{
+    PresetBankHeader header;
+    ReadHeader(bank, header);
+    if(index >= header.count)
+    {
+        return false;
+    }
+
+    const uint8_t *record = bank + sizeof(PresetBankHeader) + (size_t)index * header.record_size;
+    size_t num_controls = header.num_controls < NUM_CONTROLS ? header.num_controls : NUM_CONTROLS;
+    memcpy(controls, record + PRESET_NAME_LENGTH, num_controls);
+    if(name != NULL)
+    {
+        memcpy(name, record, PRESET_NAME_LENGTH);
+        name[PRESET_NAME_LENGTH] = '\0';
+    }
+    return true;
+}
+
+void PresetBankFinalize(uint8_t *bank, uint16_t count)
+{
+    PresetBankHeader header;
+    header.magic        = PRESET_MAGIC;
+    header.version      = PRESET_VERSION;
+    header.count        = count;
+    header.num_controls = NUM_CONTROLS;
+    header.record_size  = PRESET_RECORD_SIZE;
+    header.checksum     = Checksum(bank + sizeof(PresetBankHeader), (size_t)count * PRESET_RECORD_SIZE);
+    memcpy(bank, &header, sizeof(header));
+}
+
+const char *PresetControlName(int param)
+{
+    return param >= 0 && param < NUM_CONTROLS ? kControlNames[param] : NULL;
+}
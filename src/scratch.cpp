@@ -0,0 +1,21 @@
+#include "../include/scratch.h"
+
+#if defined(STM32H750xx)
+//libDaisy's linker script keeps this section in DTCM below the stack, NOLOAD
+static ScratchArena arena __attribute__((section(".dtcmram_bss")));
+#else
+//Zeroed for every thread like any thread local
+static thread_local ScratchArena arena;
+#endif
+
+void ScratchArena::Init()
+{
+    used_      = 0;
+    peak_      = 0;
+    overflows_ = 0;
+}
+
+ScratchArena &Scratch()
+{
+    return arena;
+}
@@ -0,0 +1,22 @@
+#include "../include/sine.h"
+
+//sin(2 pi (k - 1) / (4 * SINE_QUARTER_SIZE)) for k = 0 .. SINE_QUARTER_SIZE + 3
+const float custom::kSineQuarter[SINE_QUARTER_SIZE + 4] = {
+    -2.454122901e-02f, 0.0f, 2.454122901e-02f, 4.906767607e-02f,
+    7.356456667e-02f, 9.801714122e-02f, 1.224106774e-01f, 1.467304677e-01f,
+    1.709618866e-01f, 1.950903237e-01f, 2.191012353e-01f, 2.429801822e-01f,
+    2.667127550e-01f, 2.902846634e-01f, 3.136817515e-01f, 3.368898630e-01f,
+    3.598950505e-01f, 3.826834261e-01f, 4.052413106e-01f, 4.275550842e-01f,
+    4.496113360e-01f, 4.713967443e-01f, 4.928981960e-01f, 5.141027570e-01f,
+    5.349976420e-01f, 5.555702448e-01f, 5.758081675e-01f, 5.956993103e-01f,
+    6.152315736e-01f, 6.343932748e-01f, 6.531728506e-01f, 6.715589762e-01f,
+    6.895405650e-01f, 7.071067691e-01f, 7.242470980e-01f, 7.409511209e-01f,
+    7.572088242e-01f, 7.730104327e-01f, 7.883464098e-01f, 8.032075167e-01f,
+    8.175848126e-01f, 8.314695954e-01f, 8.448535800e-01f, 8.577286005e-01f,
+    8.700869679e-01f, 8.819212914e-01f, 8.932242990e-01f, 9.039893150e-01f,
+    9.142097831e-01f, 9.238795042e-01f, 9.329928160e-01f, 9.415440559e-01f,
+    9.495281577e-01f, 9.569403529e-01f, 9.637760520e-01f, 9.700312614e-01f,
+    9.757021070e-01f, 9.807852507e-01f, 9.852776527e-01f, 9.891765118e-01f,
+    9.924795628e-01f, 9.951847196e-01f, 9.972904325e-01f, 9.987954497e-01f,
+    9.996988177e-01f, 1.000000000e+00f, 9.996988177e-01f, 9.987954497e-01f,
+};
@@ -0,0 +1,40 @@
+#include "../include/stackpaint.h"
+
+//Left unpainted below the marker, covers StackPaint's own frame and the x86-64 red zone
+#define STACK_PAINT_MARGIN 256
+
+static volatile uint32_t *paint_low, *paint_top;
+
+//Not inlined, so its frame sits right below the caller's
+__attribute__((noinline)) void StackPaint(size_t bytes)
+{
+    volatile uint32_t marker = 0;
+    uintptr_t         top    = ((uintptr_t)&marker - STACK_PAINT_MARGIN) & ~(uintptr_t)(sizeof(uint32_t) - 1);
+    volatile uint32_t *low   = (volatile uint32_t *)(top - (bytes & ~(sizeof(uint32_t) - 1)));
+    //Word by word through a volatile pointer, a memset call would run on the stack being painted
+    for(volatile uint32_t *p = low; p < (volatile uint32_t *)top; p++)
+    {
+        *p = STACK_PAINT_WORD;
+    }
+    paint_low = low;
+    paint_top = (volatile uint32_t *)top;
+}
+
+size_t StackHighWater()
+{
+    volatile uint32_t *p = paint_low;
+    if(p == NULL)
+    {
+        return 0;
+    }
+    while(p < paint_top && *p == STACK_PAINT_WORD)
+    {
+        p++;
+    }
+    return (paint_top - p) * sizeof(uint32_t);
+}
+
+size_t StackPainted()
+{
+    return (paint_top - paint_low) * sizeof(uint32_t);
+}
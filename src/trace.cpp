@@ -0,0 +1,80 @@
+#include <stdio.h>
+
+#include "../include/trace.h"
+
+TraceEvent            trace_ring[DUALIE_TRACE_SIZE];
+std::atomic<uint32_t> trace_next{0};
+std::atomic<bool>     trace_frozen{false};
+
+static_assert((DUALIE_TRACE_SIZE & (DUALIE_TRACE_SIZE - 1)) == 0, "DUALIE_TRACE_SIZE must be a power of two");
+
+static const char *const kTypeNames[TRACE_NUM_TYPES] = {
+    "block",   "block",      "note_on", "note_off", "voice_alloc", "voice_drop",
+    "control", "patch_apply", "preset", "clock",    "trigger",
+};
+
+void TraceTimerInit()
+{
+#if defined(STM32H750xx)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+void TraceInit()
+{
+    TraceTimerInit();
+    for(size_t i = 0; i < DUALIE_TRACE_SIZE; i++)
+    {
+        trace_ring[i].seq.store(UINT32_MAX, std::memory_order_relaxed);
+    }
+    trace_next.store(0, std::memory_order_relaxed);
+    trace_frozen.store(false, std::memory_order_release);
+}
+
+void TraceTrigger(uint16_t load_percent)
+{
+    TraceRecord(TRACE_TRIGGER, 0, load_percent);
+    trace_frozen.store(true, std::memory_order_release);
+}
+
+void TraceResume()
+{
+    trace_frozen.store(false, std::memory_order_release);
+}
+
+size_t TraceSnapshot(TraceRecordCopy *out, size_t max)
+{
+    uint32_t next  = trace_next.load(std::memory_order_acquire);
+    uint32_t count = next < DUALIE_TRACE_SIZE ? next : DUALIE_TRACE_SIZE;
+    count          = count < max ? count : (uint32_t)max;
+    size_t n       = 0;
+    for(uint32_t seq = next - count; seq != next; seq++)
+    {
+        const TraceEvent &e = trace_ring[seq & (DUALIE_TRACE_SIZE - 1)];
+        if(e.seq.load(std::memory_order_acquire) != seq)
+        {
+            continue;
+        }
+        TraceRecordCopy c = {seq, e.time, e.type, e.a, e.b};
+        TRACE_FENCE(std::memory_order_acquire);
+        //Overwritten while it was copied
+        if(e.seq.load(std::memory_order_relaxed) != seq)
+        {
+            continue;
+        }
+        out[n++] = c;
+    }
+    return n;
+}
+
+const char *TraceTypeName(uint8_t type)
+{
+    return type < TRACE_NUM_TYPES ? kTypeNames[type] : "unknown";
+}
+
+int TraceFormat(const TraceRecordCopy &e, char *buf, size_t size)
+{
+    return snprintf(buf, size, "TR %lu %lu %u %u %u", (unsigned long)e.seq, (unsigned long)e.time, e.type, e.a, e.b);
+}
@@ -0,0 +1,275 @@
+#include <Utility/dsp.h>
+#include <arm_math.h>
+
+#include "../include/voice.h"
+#include "../include/scratch.h"
+
+using namespace daisysp;
+using namespace custom;
+
+static_assert(BLOCK_SIZE % NOISE_LANES == 0, "noise is generated in whole lane groups");
+
+//Saturator of every voice filter, chosen per build from the saturator scenarios of host/bench
+#ifndef DUALIE_LADDER_SATURATOR
+#define DUALIE_LADDER_SATURATOR MoogLadder::SATURATOR_PADE
+#endif
+
+//Brings a control rate signal up to the voice rate by holding every sample, scale converts
+//per sample quantities such as phase increments. Constant signals stay constant.
+static BlockSignal Hold(BlockSignal in, float *out, size_t size, uint8_t oversample, float scale)
+{
+    if(in.IsConstant())
+    {
+        return BlockSignal::Constant(in.value * scale);
+    }
+    if(oversample == 1)
+    {
+        return in;
+    }
+    for(size_t i = 0; i < size; i++)
+    {
+        for(uint8_t k = 0; k < oversample; k++)
+        {
+            out[i * oversample + k] = in.buf[i] * scale;
+        }
+    }
+    return BlockSignal::Block(out);
+}
+
+void Voice::Init(float sample_rate, uint32_t seed, uint8_t oversample)
+{
+    //The envelopes and modulation stay at the base rate, only the audio path is oversampled
+    oversample_ = oversample;
+    note_       = 0;
+    velocity_   = 0.f;
+    freq_       = 0.f;
+    env_gate_   = false;
+    osc1_.Init(sample_rate * oversample);
+    osc2_.Init(sample_rate * oversample);
+    noise_.Init(seed);
+    amp_env_.Init(sample_rate);
+    filt_env_.Init(sample_rate);
+    filt_.Init(sample_rate * oversample);
+    filt_.SetSaturator(DUALIE_LADDER_SATURATOR);
+    filt_.SetOversampling(oversample == 1);
+    zdf_.Init(sample_rate * oversample);
+    filter_type_ = FILTER_LADDER;
+}
+
+void Voice::Filter(float *buf, BlockSignal freq, size_t size)
+{
+    if(filter_type_ == FILTER_LADDER)
+    {
+        filt_.ProcessBlock(buf, freq, size);
+    }
+    else
+    {
+        zdf_.ProcessBlock(buf, freq, size);
+    }
+}
+
+void Voice::ProcessBlock(float *buf, const float *values, const ModMatrix &mod, size_t size)
+{
+    float       velocity_freq, kbd_freq, cutoff;
+    bool        split_high, split_low;
+    BlockSignal filt_mod, amp_mod, osc2_pm;
+    //Samples at the voice rate
+    size_t      n = size * oversample_;
+    float       fm_scale = 1.0f / oversample_;
+
+    //Blocks are taken from the scratch arena when a stage first needs them and all go back on return
+    ScratchFrame scratch;
+    float       *osc1_out = scratch.Floats(n), *osc2_out = scratch.Floats(n);
+    float       *sync_vector = scratch.Floats(n), *pw_os = scratch.Floats(n), *fm_os = scratch.Floats(n);
+
+    //Process osc1, marks its wraps in sync_vector when osc2 is synced to it
+    osc1_.ProcessBlock(osc1_out, Hold(mod.Get(MOD_DST_OSC1_PW), pw_os, size, oversample_, 1.0f),
+                       Hold(mod.Get(MOD_DST_OSC1_FM), fm_os, size, oversample_, fm_scale), BlockSignal::Constant(0.f),
+                       sync_vector, n);
+
+    //Adjust tuning
+    osc2_.SetFreq(mtof(note_ + values[CTRL_OSC2TUNECOARSE] + values[CTRL_OSC2TUNEFINE]));
+
+    //Osc1 phase modulates osc2 at audio rate, the plain kernels run while it is off
+    osc2_pm = BlockSignal::Constant(0.f);
+    if(values[CTRL_OSC2PHASEMOD] != 0.f)
+    {
+        float *pm_vector = scratch.Floats(n);
+        arm_scale_f32(osc1_out, values[CTRL_OSC2PHASEMOD], pm_vector, n);
+        osc2_pm = BlockSignal::Block(pm_vector);
+    }
+
+    //Process osc2, restarts on osc1's wraps when CTRL_OSC2SYNC is on
+    osc2_.ProcessBlock(osc2_out, Hold(mod.Get(MOD_DST_OSC2_PW), pw_os, size, oversample_, 1.0f),
+                       Hold(mod.Get(MOD_DST_OSC2_FM), fm_os, size, oversample_, fm_scale), osc2_pm, sync_vector, n);
+
+    //If CTRL_OSCSPLIT enabled, silence each oscillator on oposite sides
+    split_high = !values[CTRL_OSCSPLIT] || note_ > 63;
+    split_low  = !values[CTRL_OSCSPLIT] || note_ < 64;
+    arm_scale_f32(osc1_out, split_high, osc1_out, n);
+    arm_scale_f32(osc2_out, split_low, osc2_out, n);
+
+    //Ring modulator, taken before the mixer scales the oscillators
+    float *ring_out = NULL;
+    if(values[CTRL_RINGMOD] != 0.f)
+    {
+        ring_out = scratch.Floats(n);
+        arm_mult_f32(osc1_out, osc2_out, ring_out, n);
+    }
+
+    //Mixer
+    arm_scale_f32(osc1_out, (1-values[CTRL_OSCMIX]), osc1_out, n);
+    arm_scale_f32(osc2_out, values[CTRL_OSCMIX], osc2_out, n);
+    arm_add_f32(osc1_out, osc2_out, buf, n);
+
+    //CTRL_RINGMOD crossfades from the oscillator mix to the ring modulator
+    if(values[CTRL_RINGMOD] != 0.f)
+    {
+        arm_scale_f32(buf, 1 - values[CTRL_RINGMOD], buf, n);
+        arm_scale_f32(ring_out, values[CTRL_RINGMOD], ring_out, n);
+        arm_add_f32(buf, ring_out, buf, n);
+    }
+
+    //Noise, not generated at all when turned down
+    if(values[CTRL_NOISE] != 0.f)
+    {
+        noise_.SetAmp(values[CTRL_NOISE]);
+        float *noise_out = scratch.Floats(n);
+        noise_.ProcessBlock(noise_out, n);
+        arm_add_f32(buf, noise_out, buf, n);
+    }
+
+    //Filter
+    //Note filter modulated by Envelope, Velocity and Keybed
+    //Velocity and keybed can add to the cutoff frequency
+    //Velocity - add 20khz * (velocity mod * velocity)
+    velocity_freq = 20000.f * values[CTRL_FILTERVELOCITYMOD] * velocity_;
+    //Keybed - leaving this simple for now will refine later
+    kbd_freq = freq_ * values[CTRL_FILTERKEYBEDTRACK];
+    //Add them to existing cutoff
+    cutoff = values[CTRL_FILTERCUTOFF] + (velocity_freq + kbd_freq);
+    //The cutoff is scaled by the filter envelope and the LFO, a held envelope without
+    //LFO modulation keeps it constant and the filter skips its per sample coefficients
+    filt_mod = mod.Get(MOD_DST_FILTER);
+    if(filt_env_.IsSteady(env_gate_) && filt_mod.IsConstant())
+    {
+        Filter(buf, BlockSignal::Constant(filt_env_.GetValue() * (cutoff * filt_mod.value)), n);
+    }
+    else
+    {
+        float *filt_env_out = scratch.Floats(BLOCK_SIZE), *filt_freq = scratch.Floats(BLOCK_SIZE),
+              *filt_freq_os = scratch.Floats(n);
+        filt_env_.ProcessBlock(filt_env_out, BLOCK_SIZE, env_gate_);
+        if(filt_mod.IsConstant())
+        {
+            arm_scale_f32(filt_env_out, cutoff * filt_mod.value, filt_freq, BLOCK_SIZE);
+        }
+        else
+        {
+            arm_mult_f32(filt_mod.buf, filt_env_out, filt_freq, BLOCK_SIZE);
+            arm_scale_f32(filt_freq, cutoff, filt_freq, BLOCK_SIZE);
+        }
+        Filter(buf, Hold(BlockSignal::Block(filt_freq), filt_freq_os, size, oversample_, 1.0f), n);
+    }
+
+    //Amplifier
+    amp_mod = mod.Get(MOD_DST_AMP);
+    if(amp_env_.IsSteady(env_gate_) && amp_mod.IsConstant())
+    {
+        arm_scale_f32(buf, amp_env_.GetValue() * (velocity_ * amp_mod.value), buf, n);
+        return;
+    }
+    float *amp_env_out = scratch.Floats(BLOCK_SIZE), *amp_out = scratch.Floats(BLOCK_SIZE), *amp_os = scratch.Floats(n);
+    amp_env_.ProcessBlock(amp_env_out, BLOCK_SIZE, env_gate_);
+    if(amp_mod.IsConstant())
+    {
+        arm_scale_f32(amp_env_out, velocity_ * amp_mod.value, amp_out, BLOCK_SIZE);
+    }
+    else
+    {
+        arm_mult_f32(amp_env_out, amp_mod.buf, amp_out, BLOCK_SIZE);
+        arm_scale_f32(amp_out, velocity_, amp_out, BLOCK_SIZE);
+    }
+    arm_mult_f32(buf, Hold(BlockSignal::Block(amp_out), amp_os, size, oversample_, 1.0f).buf, buf, n);
+}
+
+float Voice::Process(const float *values, float lfo_out)
+{
+    float sig, amp;
+    amp = amp_env_.Process(env_gate_); //change to account for both envelopes
+    if(!amp_env_.IsRunning())
+    {
+        return 0;
+    }
+
+    osc1_.SetAmp(0);
+    osc2_.SetAmp(0);
+
+    if (!values[CTRL_OSCSPLIT] || note_ < 64 )
+    {
+        osc1_.SetAmp(velocity_ * (1-values[CTRL_OSCMIX]));
+        osc1_.SetPw(values[CTRL_OSC1PULSEWIDTH] 
+                        + (lfo_out * values[CTRL_OSC1PWMOD] 
+                        * (0.5-values[CTRL_OSC1PULSEWIDTH])));
+        osc1_.PhaseAdd(lfo_out * values[CTRL_OSC1FREQUENCYMOD]);  //Not sure if PhaseAdd is the best way to do frequency modulation
+    }
+
+    if (!values[CTRL_OSCSPLIT] || note_ > 63 )
+    {
+        osc2_.SetAmp(velocity_ * values[CTRL_OSCMIX]);
+        osc2_.SetPw(values[CTRL_OSC2PULSEWIDTH] 
+                        + (lfo_out * values[CTRL_OSC2PWMOD] 
+                        * (0.5-values[CTRL_OSC2PULSEWIDTH])));
+        osc2_.SetFreq(mtof(note_ + values[CTRL_OSC2TUNECOARSE] + values[CTRL_OSC2TUNEFINE]));
+        osc2_.PhaseAdd(lfo_out * values[CTRL_OSC2FREQUENCYMOD]);
+        if(values[CTRL_OSC2SYNC] && osc1_.IsEOC())
+        {
+            osc2_.Reset();
+        }
+    }
+
+    noise_.SetAmp(velocity_ * values[CTRL_NOISE]);
+
+    sig = osc1_.Process() + osc2_.Process() + noise_.Process();
+
+    //doesn't sound very good
+    //filt_.SetFreq(values[CTRL_FILTERCUTOFF] - (values[CTRL_FILTERLFOMOD] * lfo_out * values[CTRL_FILTERCUTOFF]));
+
+    return filter_type_ == FILTER_LADDER ? filt_.Process(sig * amp) : zdf_.Process(sig * amp);
+}
+
+void Voice::OnNoteOn(uint8_t note, uint8_t velocity)
+{
+    note_     = note;
+    velocity_ = velocity / 127.f;
+    freq_ = mtof(note_);
+    osc1_.SetFreq(freq_);
+    osc2_.SetFreq(freq_);
+    env_gate_ = true;
+    //Get envelope started so we can check if its active right away
+    //amp_env_.Process(env_gate_);
+    //filt_env_.Process(env_gate_);
+}
+
+void Voice::ApplyPatch(const Patch &patch)
+{
+    osc1_.SetWaveform(patch.values[CTRL_OSC1WAVEFORM]);
+    osc2_.SetWaveform(patch.values[CTRL_OSC2WAVEFORM]);
+    osc1_.SetSync(patch.values[CTRL_OSC2SYNC] ? custom::Oscillator::SYNC_MASTER : custom::Oscillator::SYNC_NONE);
+    osc2_.SetSync(patch.values[CTRL_OSC2SYNC] ? custom::Oscillator::SYNC_SLAVE : custom::Oscillator::SYNC_NONE);
+    filter_type_ = patch.values[CTRL_FILTERTYPE] < FILTER_LAST ? patch.values[CTRL_FILTERTYPE] : FILTER_LADDER;
+    if(filter_type_ == FILTER_LADDER)
+    {
+        filt_.SetFreq(patch.values[CTRL_FILTERCUTOFF]);
+        filt_.SetRes(patch.values[CTRL_FILTERRESONANCE]);
+    }
+    else
+    {
+        zdf_.SetMode(filter_type_ - FILTER_LADDER2 + ZdfFilter::MODE_LADDER2);
+        zdf_.SetRes(patch.values[CTRL_FILTERRESONANCE]);
+        zdf_.SetFreq(patch.values[CTRL_FILTERCUTOFF]);
+    }
+    noise_.SetMode(patch.values[CTRL_NOISETYPE]);
+    filt_env_.SetCoeffs(patch.filt_env);
+    amp_env_.SetCoeffs(patch.amp_env);
+}
@@ -0,0 +1,187 @@
+#include <math.h>
+#include <Utility/dsp.h>
+
+#include "../include/zdffilter.h"
+#include "../include/denormal.h"
+
+using namespace custom;
+
+//Prewarped cutoff limit, tan() has its pole at pi / 2
+static constexpr float kMaxCutoff = 0.45f;
+//State-variable damping at resonance 1, Q = 1 / k
+static constexpr float kMinDamping = 0.05f;
+//Ladder feedback at resonance 1, the peak has Q = sqrt(1 + feedback) / 2
+static constexpr float kLadderMaxFeedback = 16.0f;
+//Part of the pass band lost to the ladder feedback that is made up at the output
+static constexpr float kLadderGainComp = 0.5f;
+
+//tan(x) = x * num / den, the [5/4] Padé approximant. Relative error below 2e-7 up to
+//x = 1 (0.32 * sample_rate) and 2.5e-5 at kMaxCutoff.
+static inline void TanRatio(float x, float &num, float &den)
+{
+    float x2 = x * x;
+    num      = x * (945.0f + x2 * (-105.0f + x2));
+    den      = 945.0f + x2 * (-420.0f + 15.0f * x2);
+}
+
+//Padé approximant of tanh, reaches exactly +-1 at +-3, as in MoogLadder
+static inline float Sat(float x)
+{
+    x        = daisysp::fclamp(x, -3.0f, 3.0f);
+    float x2 = x * x;
+    return x * (27.0f + x2) / (27.0f + 9.0f * x2);
+}
+
+void ZdfFilter::Init(float sample_rate)
+{
+    sample_rate_ = sample_rate;
+    pi_over_sr_  = (float)M_PI / sample_rate;
+    max_freq_    = kMaxCutoff * sample_rate;
+    s1_          = 0.f;
+    s2_          = 0.f;
+    mode_        = MODE_LOWPASS;
+    freq_        = 5000.f;
+    SetRes(0.2f);
+}
+
+void ZdfFilter::SetMode(uint8_t mode)
+{
+    mode_ = mode < MODE_LAST ? mode : MODE_LOWPASS;
+    SetFreq(freq_);
+}
+
+void ZdfFilter::SetFreq(float freq)
+{
+    freq_ = freq;
+    if(mode_ == MODE_LADDER2)
+    {
+        Coeffs<MODE_LADDER2>(freq);
+    }
+    else
+    {
+        Coeffs<MODE_LOWPASS>(freq);
+    }
+}
+
+void ZdfFilter::SetRes(float res)
+{
+    res_ = daisysp::fclamp(res, 0.0f, 1.0f);
+    k_   = 2.0f - (2.0f - kMinDamping) * res_;
+    fb_  = kLadderMaxFeedback * res_;
+    SetFreq(freq_);
+}
+
+template <uint8_t mode>
+inline void ZdfFilter::Coeffs(float freq)
+{
+    float num, den;
+    TanRatio(daisysp::fclamp(freq, 0.0f, max_freq_) * pi_over_sr_, num, den);
+    if(mode == MODE_LADDER2)
+    {
+        //One-pole gain G = g / (1 + g) with g = num / den
+        g_       = num / (den + num);
+        fb_norm_ = 1.0f / (1.0f + fb_ * g_ * g_);
+    }
+    else
+    {
+        //a1 = 1 / (1 + g (g + k)), a2 = g a1, a3 = g a2, multiplied through by den^2
+        //so g never needs a division of its own
+        float inv = 1.0f / (den * den + num * (num + k_ * den));
+        a1_       = den * den * inv;
+        a2_       = num * den * inv;
+        a3_       = num * num * inv;
+    }
+}
+
+template <uint8_t mode>
+inline float ZdfFilter::Tick(float input)
+{
+    if(mode == MODE_LADDER2)
+    {
+        //Solve the feedback loop linearly, then run the stages on the saturated input
+        float one_g = 1.0f - g_;
+        float y     = (g_ * g_ * input + g_ * one_g * s1_ + one_g * s2_) * fb_norm_;
+        float u     = Sat(input - fb_ * y);
+        float v     = g_ * (u - s1_);
+        float y1    = v + s1_;
+        s1_         = y1 + v;
+        v           = g_ * (y1 - s2_);
+        float y2    = v + s2_;
+        s2_         = y2 + v;
+        return y2 * (1.0f + kLadderGainComp * fb_);
+    }
+
+    //s1_ and s2_ hold the integrator states ic1eq and ic2eq
+    float v3 = input - s2_;
+    float v1 = a1_ * s1_ + a2_ * v3;
+    float v2 = s2_ + a2_ * s1_ + a3_ * v3;
+    s1_      = 2.0f * v1 - s1_;
+    s2_      = 2.0f * v2 - s2_;
+    if(mode == MODE_LOWPASS)
+    {
+        return v2;
+    }
+    else if(mode == MODE_BANDPASS)
+    {
+        return v1;
+    }
+    return input - k_ * v1 - v2;
+}
+
+template <uint8_t mode>
+void ZdfFilter::ProcessBlockMode(float *buf, const BlockSignal &freq, size_t size)
+{
+    if(freq.IsConstant())
+    {
+        if(freq.value != freq_)
+        {
+            freq_ = freq.value;
+            Coeffs<mode>(freq.value);
+        }
+        for(size_t i = 0; i < size; i++)
+        {
+            buf[i] = Tick<mode>(buf[i]);
+        }
+        return;
+    }
+
+    for(size_t i = 0; i < size; i++)
+    {
+        Coeffs<mode>(freq.buf[i]);
+        buf[i] = Tick<mode>(buf[i]);
+    }
+    freq_ = freq.buf[size - 1];
+}
+
+void ZdfFilter::ProcessBlock(float *buf, BlockSignal freq, size_t size)
+{
+    //Dispatch once per block so the per sample loop has no mode branch
+    switch(mode_)
+    {
+        case MODE_LADDER2: ProcessBlockMode<MODE_LADDER2>(buf, freq, size); break;
+        case MODE_BANDPASS: ProcessBlockMode<MODE_BANDPASS>(buf, freq, size); break;
+        case MODE_HIGHPASS: ProcessBlockMode<MODE_HIGHPASS>(buf, freq, size); break;
+        default: ProcessBlockMode<MODE_LOWPASS>(buf, freq, size); break;
+    }
+    FlushState();
+}
+
+float ZdfFilter::Process(float input)
+{
+    float out;
+    switch(mode_)
+    {
+        case MODE_LADDER2: out = Tick<MODE_LADDER2>(input); break;
+        case MODE_BANDPASS: out = Tick<MODE_BANDPASS>(input); break;
+        case MODE_HIGHPASS: out = Tick<MODE_HIGHPASS>(input); break;
+        default: out = Tick<MODE_LOWPASS>(input); break;
+    }
+    FlushState();
+    return out;
+}
+
+void ZdfFilter::FlushState()
+{
+    s1_ = FlushDenormal(s1_);
+    s2_ = FlushDenormal(s2_);
+}